@@ -13,6 +13,7 @@
 #include "ff.h"         /* Obtains integer types */
 #include "diskio.h"     /* Declarations of disk functions */
 #include "sdcard_new.h"
+#include "prof.h"
 #include "DEBUG_PRINTF.h"
 
 
@@ -113,6 +114,7 @@ DRESULT disk_read(
 {
     DRESULT res;
     uint32_t size;
+    uint32_t prof_start;
 
     if (pdrv)
     {
@@ -120,7 +122,8 @@ DRESULT disk_read(
         return res;
     }
 
-    if (count == 0 || count > 2)
+    /* SpiRead() reads the sectors one block at a time, a refill of the PCM buffer takes several */
+    if (count == 0)
     {
         res = (DRESULT)STA_NOINIT;
         return res;
@@ -128,7 +131,9 @@ DRESULT disk_read(
 
     size = count * 512;
     /* Read data from SD card */
+    prof_start = PROF_START();
     SpiRead(sector, size, buff);
+    PROF_STOP(PROF_DISK_READ, prof_start);
 
     res = RES_OK;   /* Clear STA_NOINIT */;
 
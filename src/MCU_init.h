@@ -26,6 +26,13 @@
 #define TMR0_OPERATING_MODE   TIMER_PERIODIC_MODE // ONESHOT, PERIODIC, TOGGLE, CONTINUOUS
 #define TMR0_OPERATING_FREQ   200  // Hz, Equals 5 ms
 
+// Timer 1, free running clock of the profiler, see utils/prof.h
+#define MCU_INTERFACE_TMR1
+#define TMR1_CLOCK_SOURCE_HXT // HXT, LXT, HCLK, EXT, LIRC, HIRC
+#define TMR1_CLOCK_DIVIDER    1
+#define TMR1_OPERATING_MODE   TIMER_CONTINUOUS_MODE // ONESHOT, PERIODIC, TOGGLE, CONTINUOUS
+#define TMR1_OPERATING_FREQ   __HXT  // Hz, only the clock is used, prof_init() sets the timer up
+
 // // PWM output to Buzzer
 // #define MCU_INTERFACE_PWM1
 // #define PWM1_CH01_CLOCK_SOURCE_HXT
@@ -40,12 +47,12 @@
 // #define ADC_INPUT_MODE        ADC_INPUT_MODE_SINGLE_END // SINGLE_END, DIFFERENTIAL
 // #define ADC_OPERATION_MODE    ADC_OPERATION_MODE_SINGLE // SINGLE, SINGLE_CYCLE, CONTINUOUS
 
-// // UART 0
-// #define MCU_INTERFACE_UART0
-// #define UART_CLOCK_SOURCE_HXT // HXT, LXT, PLL, HIRC
-// #define UART_CLOCK_DIVIDER     3
-// #define PIN_UART0_RX_PB0
-// #define PIN_UART0_TX_PB1
+// UART 0, profiler dump
+#define MCU_INTERFACE_UART0
+#define UART_CLOCK_SOURCE_HXT // HXT, LXT, PLL, HIRC
+#define UART_CLOCK_DIVIDER     3
+#define PIN_UART0_RX_PB0
+#define PIN_UART0_TX_PB1
 
 // I2C 0
 #define MCU_INTERFACE_I2C0
@@ -0,0 +1,116 @@
+/**
+ * @brief Test of the static arena (utils/arena.c), on a PC
+ * @details
+ *   Buffers are carved until the region is full, each must be aligned, inside the region and apart from the
+ *   others, and the one that doesn't fit must be refused and counted. A mark and a release must free only
+ *   what came after the mark, a reset all of it, and the peak must remember the most carved.
+ *   Then the modes of main.c enter and leave in turn, each carving its own buffers out of the same region,
+ *   with the sizes of the target. The region is MODE_ARENA_SIZE of main.c, sized for the player, which must
+ *   fill it exactly.
+ * @usage gcc -O2 -Wall -Iutils arena_host_test.c utils/arena.c -o arena_host_test && ./arena_host_test
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "arena.h"
+
+#define REGION_SIZE 5360    // MODE_ARENA_SIZE of main.c on the target, the player's buffers
+
+static uint64_t region[REGION_SIZE / 8];
+static int errors = 0;
+
+static bool inside(const arena_t *a, const void *p, uint32_t size)
+{
+    return (const uint8_t *)p >= a->base && (const uint8_t *)p + size <= a->base + a->size;
+}
+
+static void test_alloc(void)
+{
+    arena_t a;
+    uint8_t *p, *last = NULL;
+    uint32_t size, n = 0, mark;
+    int before = errors;
+
+    arena_init(&a, region, REGION_SIZE);
+    // Odd sizes, so the alignment matters
+    for (size = 1; (p = arena_alloc(&a, size * 7)) != NULL; ++size) {
+        if (((uintptr_t)p % ARENA_ALIGN) != 0 || !inside(&a, p, size * 7) || (last != NULL && p < last)) {
+            printf("  buffer %u at offset %u\n", size, (unsigned)(p - a.base));
+            errors += 1;
+        }
+        // Fill it, a later buffer must not overlap
+        memset(p, (uint8_t)size, size * 7);
+        last = p + size * 7;
+        n += 1;
+    }
+    if (a.failed != 1 || n == 0 || a.peak != a.top || arena_free(&a) >= (n + 1) * 7 + ARENA_ALIGN) {
+        printf("  %u carved, %u failed, %u free\n", n, a.failed, arena_free(&a));
+        errors += 1;
+    }
+
+    mark = arena_mark(&a);
+    arena_reset(&a);
+    if (arena_free(&a) != REGION_SIZE || a.peak != mark) errors += 1;
+
+    p = arena_alloc(&a, 100);
+    mark = arena_mark(&a);
+    arena_alloc(&a, 1000);
+    arena_release(&a, mark);
+    if (arena_mark(&a) != mark || arena_alloc(&a, 1) != p + 104) {
+        printf("  release didn't keep the first buffer\n");
+        errors += 1;
+    }
+    if (arena_alloc(&a, REGION_SIZE) != NULL || a.failed != 2) errors += 1;
+    printf("Alloc: %s\n", (errors == before) ? "ok" : "failed");
+}
+
+// Buffers of the modes in main.c, in bytes
+static const uint32_t player_buffers[] = {556, 64, 32 * 4, 128 * 2 * 2, 2048 * 2};
+static const uint32_t playback_buffers[] = {512 * 2};
+static const uint32_t init_buffers[] = {512};
+
+static bool enter_mode(arena_t *a, const char *name, const uint32_t *sizes, uint32_t n)
+{
+    uint32_t i;
+    uint8_t *p;
+
+    for (i = 0; i < n; ++i) {
+        if ((p = arena_alloc(a, sizes[i])) == NULL) {
+            printf("  %s: buffer %u of %u bytes doesn't fit\n", name, i, sizes[i]);
+            return false;
+        }
+        memset(p, 0xA5, sizes[i]);
+    }
+    printf("  %-8s %5u of %u bytes\n", name, arena_mark(a), a->size);
+    return true;
+}
+
+static void test_modes(void)
+{
+    arena_t a;
+    uint8_t round;
+    int before = errors;
+
+    arena_init(&a, region, REGION_SIZE);
+    for (round = 0; round < 2; ++round) {
+        if (!enter_mode(&a, "init", init_buffers, 1)) errors += 1;
+        arena_reset(&a);
+        if (!enter_mode(&a, "player", player_buffers, sizeof(player_buffers) / sizeof(player_buffers[0]))) errors += 1;
+        arena_reset(&a);
+        if (!enter_mode(&a, "playback", playback_buffers, 1)) errors += 1;
+        arena_reset(&a);
+    }
+    if (arena_free(&a) != REGION_SIZE || a.failed != 0 || a.peak != REGION_SIZE) errors += 1;
+    printf("Modes: %s, peak %u\n", (errors == before) ? "ok" : "failed", a.peak);
+}
+
+int main(void)
+{
+    test_alloc();
+    test_modes();
+    printf("\nErrors: %d\n", errors);
+    return (errors == 0) ? 0 : 1;
+}
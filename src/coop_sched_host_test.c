@@ -0,0 +1,333 @@
+/**
+ * @brief Test of the cooperative scheduler (utils/coop_sched.c), on a PC
+ * @details
+ *   The clock is a counter the tasks move forward by the time their steps take, starting just below
+ *   the wrap around, and an "interrupt" is checked between the steps, like the I2S one of the play loop.
+ *   Same tasks as the play loop of main.c: refill (given a deadline when the buffer is sent), input, meter,
+ *   LCD flush and UI, where the UI and the LCD flush yield between parts of their work.
+ *
+ *   Checks that the macros continue where a task left off, that a task that yielded runs again but one
+ *   that waits only once its condition holds, that the earliest deadline goes first and before priority,
+ *   and that a deadline counts as missed only when the task ends after it. The refill latency is
+ *   compared with a UI that doesn't yield, where the refill has to wait for the whole frame.
+ * @usage gcc -O2 -Wall -DCOOP_SCHED_HOST -Iutils coop_sched_host_test.c utils/coop_sched.c -o coop_sched_host_test && ./coop_sched_host_test
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "coop_sched.h"
+
+#define CLOCK_START 0xFFFF0000u
+#define BUFFER_PERIOD 1013      // Clock ticks between refill requests
+#define REFILL_SLACK 400        // Deadline after the request
+#define REFILL_COST 150
+#define FRAME_PARTS 6
+#define FRAME_PART_COST 120
+#define FLUSH_SLICES 8
+#define FLUSH_SLICE_COST 30
+#define RUN_TICKS 2000000
+
+enum {
+    TASK_REFILL,
+    TASK_INPUT,
+    TASK_METER,
+    TASK_LCD_FLUSH,
+    TASK_UI,
+    TASK_NUM,
+};
+
+static uint32_t clock_now;
+static int errors = 0;
+
+static uint32_t now(void)
+{
+    return clock_now;
+}
+
+/* -------------------- */
+// Macros
+/* -------------------- */
+static uint8_t trace[16];
+static uint8_t trace_len;
+static bool gate;
+
+static uint8_t steps_task(sched_task_t *t)
+{
+    SCHED_BEGIN(t);
+    trace[trace_len++] = 1;
+    SCHED_YIELD(t);
+    trace[trace_len++] = 2;
+    SCHED_WAIT_UNTIL(t, gate);
+    trace[trace_len++] = 3;
+    SCHED_END(t);
+}
+
+static bool never_ready(void)
+{
+    return false;
+}
+
+static bool always_ready(void)
+{
+    return true;
+}
+
+static void test_macros(void)
+{
+    sched_task_t task = {"steps", steps_task, never_ready};
+    sched_t s;
+    const uint8_t expected[] = {1, 2, 3, 1};
+    uint8_t i;
+
+    sched_init(&s, &task, 1, now);
+    trace_len = 0;
+    gate = false;
+    // Not ready until it yields
+    if (sched_dispatch(&s)) errors += 1;
+    task.ready = always_ready;
+    if (!sched_dispatch(&s)) errors += 1;     // 1, yields
+    task.ready = never_ready;
+    if (!sched_dispatch(&s)) errors += 1;     // Ready after the yield, 2, waits
+    if (sched_ready(&s)) {
+        printf("  a waiting task is ready\n");
+        errors += 1;
+    }
+    gate = true;
+    task.ready = always_ready;
+    sched_dispatch(&s);                       // 3, ends
+    sched_dispatch(&s);                       // 1 again
+    if (trace_len != sizeof(expected)) {
+        printf("  %u steps, %u expected\n", trace_len, (unsigned)sizeof(expected));
+        errors += 1;
+    }
+    for (i = 0; i < trace_len && i < sizeof(expected); ++i) {
+        if (trace[i] != expected[i]) {
+            printf("  step %u went to %u, %u expected\n", i, trace[i], expected[i]);
+            errors += 1;
+        }
+    }
+    if (task.runs != 4) {
+        printf("  %u runs, 4 expected\n", task.runs);
+        errors += 1;
+    }
+    printf("Macros: %s\n", (errors == 0) ? "ok" : "failed");
+}
+
+/* -------------------- */
+// Deadlines
+/* -------------------- */
+static uint8_t order[8];
+static uint8_t order_len;
+
+static uint8_t mark_task(sched_task_t *t)
+{
+    SCHED_BEGIN(t);
+    order[order_len++] = (uint8_t)(t->name[0] - '0');
+    clock_now += 10;
+    SCHED_END(t);
+}
+
+static void test_deadlines(void)
+{
+    sched_task_t tasks[3] = {
+        {"0", mark_task, always_ready},
+        {"1", mark_task, always_ready},
+        {"2", mark_task, always_ready},
+    };
+    sched_t s;
+    int before = errors;
+
+    clock_now = CLOCK_START;
+    sched_init(&s, tasks, 3, now);
+    order_len = 0;
+    // Across the wrap around, 2 is the earliest
+    sched_set_deadline(&tasks[1], CLOCK_START + 0x20000);
+    sched_set_deadline(&tasks[2], CLOCK_START + 5);
+    sched_dispatch(&s);
+    sched_dispatch(&s);
+    sched_dispatch(&s);
+    if (order_len != 3 || order[0] != 2 || order[1] != 1 || order[2] != 0) {
+        printf("  order %u %u %u, 2 1 0 expected\n", order[0], order[1], order[2]);
+        errors += 1;
+    }
+    // 2 ended 5 ticks late, 1 in time
+    if (tasks[2].misses != 1 || tasks[1].misses != 0) {
+        printf("  misses %u %u, 1 0 expected\n", tasks[2].misses, tasks[1].misses);
+        errors += 1;
+    }
+    // Done, so back to priority
+    order_len = 0;
+    sched_dispatch(&s);
+    if (order[0] != 0) errors += 1;
+    sched_reset_stats(&s);
+    if (tasks[0].runs != 0 || tasks[2].misses != 0) errors += 1;
+    printf("Deadlines: %s\n", (errors == before) ? "ok" : "failed");
+}
+
+/* -------------------- */
+// Play loop
+/* -------------------- */
+static sched_task_t tasks[TASK_NUM];
+static sched_t play;
+static bool ui_yields;
+static bool needs_refill;
+static uint32_t refill_requested, next_request;
+static uint32_t worst_latency;
+static uint8_t flush_left;
+static uint32_t next_frame, next_meter, next_key;
+static bool key_pending;
+static uint8_t part;
+
+// The I2S sends the buffer, the refill gets its deadline
+static void interrupts(void)
+{
+    if ((int32_t)(clock_now - next_request) >= 0) {
+        // When it came, the step that was running delayed the handler too
+        if (!needs_refill) {
+            needs_refill = true;
+            refill_requested = next_request;
+            sched_set_deadline(&tasks[TASK_REFILL], next_request + REFILL_SLACK);
+        }
+        next_request += BUFFER_PERIOD;
+    }
+    if ((int32_t)(clock_now - next_key) >= 0) {
+        next_key += 7919;
+        key_pending = true;
+    }
+}
+
+static bool refill_ready(void)
+{
+    return needs_refill;
+}
+
+static uint8_t refill_task(sched_task_t *t)
+{
+    uint32_t latency = clock_now - refill_requested;
+
+    SCHED_BEGIN(t);
+    if (latency > worst_latency) worst_latency = latency;
+    clock_now += REFILL_COST;
+    needs_refill = false;
+    SCHED_END(t);
+}
+
+static bool input_ready(void)
+{
+    return key_pending;
+}
+
+static uint8_t input_task(sched_task_t *t)
+{
+    SCHED_BEGIN(t);
+    clock_now += 20;
+    key_pending = false;
+    SCHED_END(t);
+}
+
+static bool meter_ready(void)
+{
+    return (int32_t)(clock_now - next_meter) >= 0;
+}
+
+static uint8_t meter_task(sched_task_t *t)
+{
+    SCHED_BEGIN(t);
+    next_meter = clock_now + 500;
+    clock_now += 15;
+    SCHED_END(t);
+}
+
+static bool flush_ready(void)
+{
+    return flush_left > 0;
+}
+
+static uint8_t flush_task(sched_task_t *t)
+{
+    SCHED_BEGIN(t);
+    while (flush_left > 0) {
+        clock_now += FLUSH_SLICE_COST;
+        flush_left -= 1;
+        SCHED_YIELD(t);
+    }
+    SCHED_END(t);
+}
+
+static bool ui_ready(void)
+{
+    return flush_left == 0 && (int32_t)(clock_now - next_frame) >= 0;
+}
+
+static uint8_t ui_task(sched_task_t *t)
+{
+    SCHED_BEGIN(t);
+    next_frame = clock_now + 3000;
+    for (part = 0; part < FRAME_PARTS; ++part) {
+        clock_now += FRAME_PART_COST;
+        if (ui_yields) SCHED_YIELD(t);
+    }
+    flush_left = FLUSH_SLICES;
+    SCHED_END(t);
+}
+
+static void run(bool yields)
+{
+    sched_task_t init[TASK_NUM] = {
+        {"refill", refill_task, refill_ready},
+        {"input", input_task, input_ready},
+        {"meter", meter_task, meter_ready},
+        {"lcd", flush_task, flush_ready},
+        {"ui", ui_task, ui_ready},
+    };
+    uint8_t i;
+
+    for (i = 0; i < TASK_NUM; ++i) tasks[i] = init[i];
+    ui_yields = yields;
+    clock_now = CLOCK_START;
+    needs_refill = false;
+    next_request = clock_now + BUFFER_PERIOD;
+    next_frame = next_meter = next_key = clock_now;
+    key_pending = false;
+    flush_left = 0;
+    worst_latency = 0;
+    sched_init(&play, tasks, TASK_NUM, now);
+
+    while ((int32_t)(clock_now - (CLOCK_START + RUN_TICKS)) < 0) {
+        interrupts();
+        // Sleeps until the next tick when nothing is ready
+        if (!sched_dispatch(&play)) clock_now += 1;
+    }
+
+    printf("\nUI %s, refill latency at most %u ticks, deadline after %u\n", yields ? "yields" : "doesn't yield",
+           worst_latency, REFILL_SLACK);
+    for (i = 0; i < TASK_NUM; ++i) {
+        printf("  %-6s %7u runs, %4.1f%% cpu, max %4u, %u missed\n", tasks[i].name, tasks[i].runs,
+               100.0 * tasks[i].time / RUN_TICKS, tasks[i].max_time, tasks[i].misses);
+    }
+    if (tasks[TASK_REFILL].runs < RUN_TICKS / BUFFER_PERIOD - 1) {
+        printf("  refills lost\n");
+        errors += 1;
+    }
+    // A refill waits at most for the longest step of another task
+    if (yields && (worst_latency > FRAME_PART_COST || tasks[TASK_REFILL].misses != 0)) {
+        printf("  refill late with a yielding UI\n");
+        errors += 1;
+    }
+    if (!yields && tasks[TASK_REFILL].misses == 0) {
+        printf("  the test doesn't stress the deadline\n");
+        errors += 1;
+    }
+}
+
+int main(void)
+{
+    test_macros();
+    test_deadlines();
+    run(false);
+    run(true);
+    printf("\nErrors: %d\n", errors);
+    return (errors == 0) ? 0 : 1;
+}
@@ -0,0 +1,350 @@
+/**
+ * @brief Accuracy test of the Q15 biquad cascade (utils/dsp_biquad.c), on a PC
+ * @details
+ *   Each filter of the player (the 1st order 30 Hz high pass and the 3 kHz peaking EQ of main.c) and a few others
+ *   are designed with dsp_biquad_design_q15() and run on noise and on sines, at 44.1 kHz. The reference is the
+ *   same design and direct form I in double, with unquantized coefficients, so the error takes in the
+ *   coefficient rounding, the truncation and the saturation.
+ *   - Noise at -6 dBFS: the RMS error must stay below MAX_ERR_RMS LSB and the peak error below MAX_ERR_PEAK LSB
+ *   - The error of 2nd order stages with a low f0 is printed, to show where Q15 coefficients fall short, and a
+ *     2nd order 30 Hz high pass must be refused by the design, but stay stable
+ *   - Sines: the gain must match |H| of the reference within MAX_GAIN_ERR_DB
+ *   - A DC step through the high pass must settle to 0 within MAX_DC_LSB, the error feedback is what does it
+ *   - Interleaved stereo (stride 2) must give each channel the same samples as mono, and a block split in two
+ *     the same as the whole block within the same error bounds
+ *   - A full scale square wave must saturate, not wrap
+ * @usage gcc -O2 -Wall -Iutils dsp_biquad_host_test.c utils/dsp_biquad.c -lm -o dsp_biquad_host_test && ./dsp_biquad_host_test
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "dsp_biquad.h"
+
+#define FS 44100
+#define N 8192
+#define SETTLE 2048         // Samples left out before measuring, for the filters to settle
+#define POST_SHIFT 1        // As main.c
+#define MAX_ERR_RMS 2.0
+#define MAX_ERR_PEAK 8.0
+#define MAX_GAIN_ERR_DB 0.05
+#define MAX_DC_LSB 2
+
+typedef struct filter_t {
+    const char *name;
+    dsp_biquad_type_t type;
+    uint32_t f0;
+    float q;
+    float gain_db;
+} filter_t;
+
+static const filter_t filters[] = {
+    {"HPF1 30 Hz",      DSP_BIQUAD_HIGHPASS_1ST, 30, 0.707f, 0.0f},
+    {"HPF 200 Hz",      DSP_BIQUAD_HIGHPASS,  200,   0.707f, 0.0f},
+    {"Peak 3 kHz +6",   DSP_BIQUAD_PEAKING,   3000,  1.0f,   6.0f},
+    {"Peak 3 kHz -6",   DSP_BIQUAD_PEAKING,   3000,  1.0f,   -6.0f},
+    {"LPF 8 kHz",       DSP_BIQUAD_LOWPASS,   8000,  0.707f, 0.0f},
+    {"Low shelf +6",    DSP_BIQUAD_LOWSHELF,  1000,  0.707f, 6.0f},
+    {"High shelf -6",   DSP_BIQUAD_HIGHSHELF, 6000,  0.707f, -6.0f},
+};
+#define FILTER_NUM (sizeof(filters) / sizeof(filters[0]))
+
+static int errors = 0;
+static dsp_q15_t in[N * 2], out[N * 2];
+static double ref[N];
+
+/**
+ * @brief The RBJ design of dsp_biquad_design_q15() in double, b0, b1, b2, a1, a2 normalized, a1 and a2 not negated
+ */
+static void design_ref(const filter_t *f, double c[5])
+{
+    double A = pow(10.0, f->gain_db / 40.0);
+    double w0 = 2.0 * M_PI * f->f0 / FS;
+    double cw = cos(w0), alpha = sin(w0) / (2.0 * f->q), sq = 2.0 * sqrt(A) * alpha;
+    double b[3], a[3];
+
+    switch (f->type) {
+    case DSP_BIQUAD_LOWPASS:
+        b[0] = (1 - cw) / 2; b[1] = 1 - cw; b[2] = b[0];
+        a[0] = 1 + alpha; a[1] = -2 * cw; a[2] = 1 - alpha;
+        break;
+    case DSP_BIQUAD_HIGHPASS:
+        b[0] = (1 + cw) / 2; b[1] = -(1 + cw); b[2] = b[0];
+        a[0] = 1 + alpha; a[1] = -2 * cw; a[2] = 1 - alpha;
+        break;
+    case DSP_BIQUAD_HIGHPASS_1ST:
+        b[0] = 1; b[1] = -1; b[2] = 0;
+        a[0] = 1 + tan(w0 / 2); a[1] = tan(w0 / 2) - 1; a[2] = 0;
+        break;
+    case DSP_BIQUAD_PEAKING:
+        b[0] = 1 + alpha * A; b[1] = -2 * cw; b[2] = 1 - alpha * A;
+        a[0] = 1 + alpha / A; a[1] = -2 * cw; a[2] = 1 - alpha / A;
+        break;
+    case DSP_BIQUAD_LOWSHELF:
+        b[0] = A * ((A + 1) - (A - 1) * cw + sq);
+        b[1] = 2 * A * ((A - 1) - (A + 1) * cw);
+        b[2] = A * ((A + 1) - (A - 1) * cw - sq);
+        a[0] = (A + 1) + (A - 1) * cw + sq;
+        a[1] = -2 * ((A - 1) + (A + 1) * cw);
+        a[2] = (A + 1) + (A - 1) * cw - sq;
+        break;
+    case DSP_BIQUAD_HIGHSHELF:
+    default:
+        b[0] = A * ((A + 1) + (A - 1) * cw + sq);
+        b[1] = -2 * A * ((A - 1) + (A + 1) * cw);
+        b[2] = A * ((A + 1) + (A - 1) * cw - sq);
+        a[0] = (A + 1) - (A - 1) * cw + sq;
+        a[1] = 2 * ((A - 1) - (A + 1) * cw);
+        a[2] = (A + 1) - (A - 1) * cw - sq;
+        break;
+    }
+    c[0] = b[0] / a[0];
+    c[1] = b[1] / a[0];
+    c[2] = b[2] / a[0];
+    c[3] = a[1] / a[0];
+    c[4] = a[2] / a[0];
+}
+
+/**
+ * @brief Direct form I in double, in and out in LSB
+ */
+static void filter_ref(const double c[5], const dsp_q15_t *x, double *y, uint32_t n)
+{
+    double x1 = 0, x2 = 0, y1 = 0, y2 = 0;
+    uint32_t i;
+
+    for (i = 0; i < n; ++i) {
+        y[i] = c[0] * x[i] + c[1] * x1 + c[2] * x2 - c[3] * y1 - c[4] * y2;
+        x2 = x1;
+        x1 = x[i];
+        y2 = y1;
+        y1 = y[i];
+    }
+}
+
+/**
+ * @brief |H| of the reference at f
+ */
+static double gain_ref(const double c[5], double f)
+{
+    double w = 2.0 * M_PI * f / FS;
+    double br = c[0] + c[1] * cos(w) + c[2] * cos(2 * w), bi = -c[1] * sin(w) - c[2] * sin(2 * w);
+    double ar = 1.0 + c[3] * cos(w) + c[4] * cos(2 * w), ai = -c[3] * sin(w) - c[4] * sin(2 * w);
+    return sqrt((br * br + bi * bi) / (ar * ar + ai * ai));
+}
+
+static void run_q15(const filter_t *f, const dsp_q15_t *x, dsp_q15_t *y, uint32_t n, uint32_t stride)
+{
+    dsp_biquad_casd_df1_inst_q15 S;
+    dsp_q15_t coeffs[6], state[4];
+
+    if (dsp_biquad_design_q15(f->type, FS, f->f0, f->q, f->gain_db, POST_SHIFT, coeffs) != 0) {
+        printf("  %s: coefficients out of range\n", f->name);
+        errors += 1;
+    }
+    dsp_biquad_cascade_df1_init_q15(&S, 1, coeffs, state, POST_SHIFT);
+    dsp_biquad_cascade_df1_q15(&S, x, y, n, stride);
+}
+
+// Same noise on every run
+static uint32_t rand_state;
+static dsp_q15_t noise(void)
+{
+    rand_state = rand_state * 1664525u + 1013904223u;
+    return (dsp_q15_t)((int32_t)(rand_state >> 16) - 32768) / 2;
+}
+
+/**
+ * @brief Error of the filter on the noise in in[], RMS and peak in LSB, and the status of the design
+ */
+static uint8_t noise_error(const filter_t *f, double *rms, double *peak)
+{
+    dsp_biquad_casd_df1_inst_q15 S;
+    dsp_q15_t coeffs[6], state[4];
+    double c[5], e, sum = 0;
+    uint8_t status;
+    uint32_t i;
+
+    status = dsp_biquad_design_q15(f->type, FS, f->f0, f->q, f->gain_db, POST_SHIFT, coeffs);
+    dsp_biquad_cascade_df1_init_q15(&S, 1, coeffs, state, POST_SHIFT);
+    dsp_biquad_cascade_df1_q15(&S, in, out, N, 1);
+    design_ref(f, c);
+    filter_ref(c, in, ref, N);
+    for (i = SETTLE, *peak = 0; i < N; ++i) {
+        e = out[i] - ref[i];
+        sum += e * e;
+        if (fabs(e) > *peak) *peak = fabs(e);
+    }
+    *rms = sqrt(sum / (N - SETTLE));
+    return status;
+}
+
+static void test_noise(void)
+{
+    double rms, peak;
+    uint32_t k, i;
+    int before = errors;
+
+    rand_state = 1;
+    for (i = 0; i < N; ++i) in[i] = noise();
+    for (k = 0; k < FILTER_NUM; ++k) {
+        if (noise_error(&filters[k], &rms, &peak) != 0) {
+            printf("  %s: coefficients out of range\n", filters[k].name);
+            errors += 1;
+        }
+        printf("  %-14s error %.3f LSB RMS, %.2f LSB peak\n", filters[k].name, rms, peak);
+        if (rms > MAX_ERR_RMS || peak > MAX_ERR_PEAK) errors += 1;
+    }
+    printf("Noise: %s\n", (errors == before) ? "ok" : "failed");
+}
+
+/**
+ * @brief Where Q15 coefficients stop being enough, printed only, except the 2nd order 30 Hz high pass
+ * @details The poles of a 2nd order stage near DC are 1 - a1 - a2 from the unit circle, a few LSB of Q14 or less,
+ *          the rounding moves them. A 30 Hz 2nd order high pass can't be placed at all, the design must say so,
+ *          and the stage it gives must still be stable.
+ */
+static void test_limits(void)
+{
+    static const uint32_t f0[] = {30, 100, 200, 400, 800};
+    filter_t f;
+    double rms, peak;
+    uint8_t status;
+    uint32_t k, i;
+    int before = errors;
+
+    rand_state = 1;
+    for (i = 0; i < N; ++i) in[i] = noise();
+    for (k = 0; k < sizeof(f0) / sizeof(f0[0]); ++k) {
+        f = (filter_t){"HPF", DSP_BIQUAD_HIGHPASS, f0[k], 0.707f, 0.0f};
+        status = noise_error(&f, &rms, &peak);
+        printf("  HPF at %3u Hz: %8.3f LSB RMS%s", f0[k], rms, status ? " (pole moved)" : "");
+        if (f0[k] == 30 && (status != 1 || rms > 32768.0)) errors += 1;
+        f = (filter_t){"Low shelf", DSP_BIQUAD_LOWSHELF, f0[k], 0.707f, 6.0f};
+        status = noise_error(&f, &rms, &peak);
+        printf(", low shelf +6 dB: %8.3f LSB RMS%s\n", rms, status ? " (pole moved)" : "");
+    }
+    printf("Limits: %s\n", (errors == before) ? "ok" : "failed");
+}
+
+static void test_gain(void)
+{
+    // Whole periods in the N - SETTLE samples measured, about 20 Hz, 100 Hz, 1 kHz, 3 kHz, 8 kHz and 15 kHz
+    static const uint32_t periods[] = {3, 14, 139, 418, 1115, 2090};
+    double c[5], a_in, a_out, gain, f;
+    uint32_t k, j, i;
+    int before = errors;
+
+    for (k = 0; k < FILTER_NUM; ++k) {
+        design_ref(&filters[k], c);
+        for (j = 0; j < sizeof(periods) / sizeof(periods[0]); ++j) {
+            f = (double)FS * periods[j] / (N - SETTLE);
+            // -12 dBFS, so a boost of 6 dB doesn't saturate
+            for (i = 0; i < N; ++i) in[i] = (dsp_q15_t)lrint(8192.0 * sin(2.0 * M_PI * f * i / FS));
+            run_q15(&filters[k], in, out, N, 1);
+            for (i = SETTLE, a_in = 0, a_out = 0; i < N; ++i) {
+                a_in += (double)in[i] * in[i];
+                a_out += (double)out[i] * out[i];
+            }
+            gain = 10.0 * log10(a_out / a_in);
+            // Below -40 dB the signal is a few LSB, the rounding is what's measured
+            if (20.0 * log10(gain_ref(c, f)) < -40.0) continue;
+            if (fabs(gain - 20.0 * log10(gain_ref(c, f))) > MAX_GAIN_ERR_DB) {
+                printf("  %s at %.0f Hz: %.3f dB, %.3f dB expected\n", filters[k].name, f, gain,
+                       20.0 * log10(gain_ref(c, f)));
+                errors += 1;
+            }
+        }
+    }
+    printf("Gain: %s\n", (errors == before) ? "ok" : "failed");
+}
+
+static void test_dc(void)
+{
+    int32_t max = 0;
+    uint32_t i;
+    int before = errors;
+
+    for (i = 0; i < N; ++i) in[i] = 16384;
+    run_q15(&filters[0], in, out, N, 1);
+    for (i = N - SETTLE; i < N; ++i) {
+        if (out[i] > max) max = out[i];
+        if (-out[i] > max) max = -out[i];
+    }
+    printf("  DC left after the high pass: %d LSB\n", max);
+    if (max > MAX_DC_LSB) errors += 1;
+    printf("DC: %s\n", (errors == before) ? "ok" : "failed");
+}
+
+static void test_stride_block(void)
+{
+    static dsp_q15_t mono[N], split[N];
+    dsp_biquad_casd_df1_inst_q15 S;
+    dsp_q15_t coeffs[6], state[4];
+    double c[5], e, peak = 0;
+    uint32_t i;
+    int before = errors;
+
+    // Left is noise, right is the same noise negated
+    rand_state = 2;
+    for (i = 0; i < N; ++i) {
+        in[2 * i] = noise();
+        in[2 * i + 1] = (dsp_q15_t)-in[2 * i];
+        mono[i] = in[2 * i];
+    }
+    run_q15(&filters[2], in, out, N, 2);
+    run_q15(&filters[2], in + 1, out + 1, N, 2);
+    run_q15(&filters[2], mono, split, N, 1);
+    for (i = 0; i < N; ++i) {
+        if (out[2 * i] != split[i]) errors += 1;
+    }
+    mono[0] = split[0];
+
+    // The same mono noise in two blocks, the state goes on, the truncation error starts again at 0
+    for (i = 0; i < N; ++i) mono[i] = in[2 * i];
+    dsp_biquad_design_q15(filters[2].type, FS, filters[2].f0, filters[2].q, filters[2].gain_db, POST_SHIFT, coeffs);
+    dsp_biquad_cascade_df1_init_q15(&S, 1, coeffs, state, POST_SHIFT);
+    dsp_biquad_cascade_df1_q15(&S, mono, split, N / 2, 1);
+    dsp_biquad_cascade_df1_q15(&S, mono + N / 2, split + N / 2, N / 2, 1);
+    design_ref(&filters[2], c);
+    filter_ref(c, mono, ref, N);
+    for (i = SETTLE; i < N; ++i) {
+        e = fabs(split[i] - ref[i]);
+        if (e > peak) peak = e;
+    }
+    printf("  Two blocks: %.2f LSB peak error\n", peak);
+    if (peak > MAX_ERR_PEAK) errors += 1;
+    printf("Stride and blocks: %s\n", (errors == before) ? "ok" : "failed");
+}
+
+static void test_saturation(void)
+{
+    uint32_t i;
+    int before = errors;
+
+    // Full scale square at 100 Hz through the +6 dB low shelf, the output must clip at the rails, never flip sign
+    for (i = 0; i < N; ++i) in[i] = ((i / (FS / 200)) & 1) ? -32768 : 32767;
+    run_q15(&filters[5], in, out, N, 1);
+    for (i = SETTLE; i < N; ++i) {
+        if ((in[i] > 0 && out[i] < -16384) || (in[i] < 0 && out[i] > 16384)) {
+            printf("  wrapped at %u: in %d, out %d\n", i, in[i], out[i]);
+            errors += 1;
+            break;
+        }
+    }
+    printf("Saturation: %s\n", (errors == before) ? "ok" : "failed");
+}
+
+int main(void)
+{
+    test_noise();
+    test_limits();
+    test_gain();
+    test_dc();
+    test_stride_block();
+    test_saturation();
+    printf("\nErrors: %d\n", errors);
+    return (errors == 0) ? 0 : 1;
+}
@@ -0,0 +1,158 @@
+/**
+ * @brief Accuracy test of the Q15 FFT and the magnitude (utils/dsp_fft.c), on a PC
+ * @details
+ *   Each size from 2 to DSP_FFT_MAX_LEN is run on noise, the bins must match a DFT in double of the same
+ *   input, divided by the size as dsp_cfft_radix2_q15() scales, within MAX_ERR_LSB. Each stage rounds, so the
+ *   error grows with the number of stages, MAX_ERR_LSB is for 7 stages. The noise is within +-23170, so |z| is
+ *   within q15, which is what the FFT can take without overflow.
+ *   Then a sine on bin k of the 128 points the visualizer uses must peak at bin k (and 128 - k), and a full
+ *   scale square wave must not overflow.
+ *   dsp_cmplx_mag_approx_q15() must be within 0% ~ +12% of |z| (max + min / 2 never underestimates), checked
+ *   at every angle of the circle.
+ * @usage gcc -O2 -Wall -Iutils dsp_fft_host_test.c utils/dsp_fft.c -lm -o dsp_fft_host_test && ./dsp_fft_host_test
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "dsp_fft.h"
+
+#define MAX_ERR_LSB 4.5
+#define VIS_LEN 128         // VIS_FFT_LEN of main.c
+
+static int errors = 0;
+static dsp_q15_t buf[2 * DSP_FFT_MAX_LEN];
+static dsp_q15_t in[2 * DSP_FFT_MAX_LEN];
+
+// Same noise on every run, within +-limit
+static uint32_t rand_state = 1;
+static dsp_q15_t noise(int32_t limit)
+{
+    rand_state = rand_state * 1664525u + 1013904223u;
+    return (dsp_q15_t)(((int32_t)(rand_state >> 16) - 32768) * limit / 32768);
+}
+
+/**
+ * @brief Largest difference of buf to the DFT of in, divided by len, in LSB
+ */
+static double dft_error(uint16_t len)
+{
+    double re, im, a, e, max = 0;
+    uint32_t k, n;
+
+    for (k = 0; k < len; ++k) {
+        re = 0;
+        im = 0;
+        for (n = 0; n < len; ++n) {
+            a = -2.0 * M_PI * k * n / len;
+            re += in[2 * n] * cos(a) - in[2 * n + 1] * sin(a);
+            im += in[2 * n] * sin(a) + in[2 * n + 1] * cos(a);
+        }
+        e = hypot(buf[2 * k] - re / len, buf[2 * k + 1] - im / len);
+        if (e > max) max = e;
+    }
+    return max;
+}
+
+static void test_dft(void)
+{
+    uint16_t len;
+    uint32_t i, run;
+    double e, max;
+    int before = errors;
+
+    for (len = 2; len <= DSP_FFT_MAX_LEN; len <<= 1) {
+        max = 0;
+        for (run = 0; run < 20; ++run) {
+            for (i = 0; i < 2u * len; ++i) in[i] = buf[i] = noise(23170);
+            dsp_cfft_radix2_q15(buf, len);
+            e = dft_error(len);
+            if (e > max) max = e;
+        }
+        printf("  %3u points: %.2f LSB max error\n", len, max);
+        if (max > MAX_ERR_LSB) errors += 1;
+    }
+    printf("DFT: %s\n", (errors == before) ? "ok" : "failed");
+}
+
+static void test_sine(void)
+{
+    static const uint32_t bins[] = {1, 5, 17, 40, 63};
+    uint32_t j, i, k, peak;
+    int32_t m, m_peak;
+    int before = errors;
+
+    for (j = 0; j < sizeof(bins) / sizeof(bins[0]); ++j) {
+        for (i = 0; i < VIS_LEN; ++i) {
+            in[2 * i] = buf[2 * i] = (dsp_q15_t)lrint(16384.0 * sin(2.0 * M_PI * bins[j] * i / VIS_LEN));
+            in[2 * i + 1] = buf[2 * i + 1] = 0;
+        }
+        dsp_cfft_radix2_q15(buf, VIS_LEN);
+        peak = 0;
+        m_peak = 0;
+        for (k = 0; k < VIS_LEN / 2; ++k) {
+            m = buf[2 * k] * buf[2 * k] + buf[2 * k + 1] * buf[2 * k + 1];
+            if (m > m_peak) {
+                m_peak = m;
+                peak = k;
+            }
+        }
+        // A real sine of amplitude A gives A / 2 on bin k, and its conjugate on bin len - k
+        k = VIS_LEN - bins[j];
+        if (peak != bins[j] || fabs(sqrt(m_peak) - 8192.0) > MAX_ERR_LSB ||
+            hypot(buf[2 * k] - buf[2 * peak], buf[2 * k + 1] + buf[2 * peak + 1]) > MAX_ERR_LSB) {
+            printf("  sine on bin %u peaks at bin %u, %.1f\n", bins[j], peak, sqrt(m_peak));
+            errors += 1;
+        }
+    }
+
+    // Full scale square wave, real as the visualizer's, every stage at its largest
+    for (i = 0; i < VIS_LEN; ++i) {
+        in[2 * i] = buf[2 * i] = (i & 8) ? -32768 : 32767;
+        in[2 * i + 1] = buf[2 * i + 1] = 0;
+    }
+    dsp_cfft_radix2_q15(buf, VIS_LEN);
+    if (dft_error(VIS_LEN) > MAX_ERR_LSB) {
+        printf("  square wave: %.2f LSB error\n", dft_error(VIS_LEN));
+        errors += 1;
+    }
+    printf("Sine: %s\n", (errors == before) ? "ok" : "failed");
+}
+
+static void test_magnitude(void)
+{
+    dsp_q15_t c[2], mag;
+    double a, exact, ratio, lo = 2.0, hi = 0.0;
+    uint32_t i;
+    int before = errors;
+
+    for (i = 0; i < 3600; ++i) {
+        a = 2.0 * M_PI * i / 3600;
+        c[0] = (dsp_q15_t)lrint(20000.0 * cos(a));
+        c[1] = (dsp_q15_t)lrint(20000.0 * sin(a));
+        dsp_cmplx_mag_approx_q15(c, &mag, 1);
+        exact = hypot(c[0], c[1]);
+        ratio = mag / exact;
+        if (ratio < lo) lo = ratio;
+        if (ratio > hi) hi = ratio;
+    }
+    printf("  %.2f%% ~ %+.2f%% of |z|\n", (lo - 1.0) * 100.0, (hi - 1.0) * 100.0);
+    if (lo < 1.0 - 1e-4 || hi > 1.12) errors += 1;
+
+    // Saturates, not wraps
+    c[0] = -32768;
+    c[1] = -32768;
+    dsp_cmplx_mag_approx_q15(c, &mag, 1);
+    if (mag != 32767) errors += 1;
+    printf("Magnitude: %s\n", (errors == before) ? "ok" : "failed");
+}
+
+int main(void)
+{
+    test_dft();
+    test_sine();
+    test_magnitude();
+    printf("\nErrors: %d\n", errors);
+    return (errors == 0) ? 0 : 1;
+}
@@ -0,0 +1,233 @@
+/**
+ * @brief Stress test of the event queue (utils/event_queue.c), on a PC
+ * @details
+ *   Same queues as main.c: one per interrupt handler (key, EINT1, I2S, timer 0), each filled by its own
+ *   producer thread and all drained by one consumer thread with event_queue_pop_oldest(), like the play loop.
+ *   The producers post thousands of events per second each, the timestamps come from one shared counter
+ *   that starts just below the wrap around.
+ *
+ *   An event carries its producer in type and its sequence number in arg, so the consumer can check that
+ *   every accepted event comes out once, in order, and intact.
+ *   In the first run a producer tries again when its queue is full, so nothing may be missing at all.
+ *   In the second run it gives up like an interrupt handler does, so every missing event must be in dropped.
+ * @usage gcc -O2 -Wall -pthread -DEVENT_QUEUE_HOST -Iutils event_queue_host_test.c utils/event_queue.c -o event_queue_host_test && ./event_queue_host_test
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include "event_queue.h"
+
+#define PRODUCER_NUM 4
+#define RUN_SEC 1
+
+typedef struct producer_t {
+    const char *name;
+    uint8_t size;       // Same as main.c
+    uint32_t rate;      // Events per second
+    event_queue_t queue;
+    event_t buf[128];
+    bool retry;
+    // Results
+    uint32_t sent;      // Accepted by the queue
+    uint32_t rejected;  // Push returned false
+    uint32_t received;
+    uint8_t next_arg;
+    uint32_t last_time;
+} producer_t;
+
+static producer_t producers[PRODUCER_NUM] = {
+    {"key",   16, 5000},
+    {"stop",   4, 2000},
+    {"i2s",    8, 20000},
+    {"timer",  4, 2000},
+};
+static event_queue_t *queues[PRODUCER_NUM];
+static atomic_uint clock_count;
+static atomic_int producers_running;
+static int errors = 0;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * @brief Posts events at the rate of the producer for RUN_SEC, like its interrupt handler
+ */
+static void *produce(void *arg)
+{
+    producer_t *p = arg;
+    uint64_t start = now_ns(), period = 1000000000ull / p->rate;
+    uint32_t i, n = p->rate * RUN_SEC;
+    bool ok;
+
+    for (i = 0; i < n; ++i) {
+        while (now_ns() < start + i * period) sched_yield();
+        do {
+            ok = event_queue_push(&p->queue, p - producers, (uint8_t)p->sent, atomic_fetch_add(&clock_count, 1));
+            if (!ok) {
+                p->rejected += 1;
+                sched_yield();
+            }
+        } while (!ok && p->retry);
+        if (ok) p->sent += 1;
+    }
+    atomic_fetch_sub(&producers_running, 1);
+    return NULL;
+}
+
+/**
+ * @brief Takes the events of all the producers until they are done, and checks each one
+ */
+static void *consume(void *arg)
+{
+    event_t e;
+    producer_t *p;
+    bool first[PRODUCER_NUM] = {true, true, true, true};
+    (void)arg;
+
+    while (1) {
+        if (!event_queue_pop_oldest(queues, PRODUCER_NUM, &e)) {
+            if (atomic_load(&producers_running) != 0) {
+                sched_yield();
+                continue;
+            }
+            // All done, the queues are checked once more, for the events posted before the producers ended
+            if (!event_queue_pop_oldest(queues, PRODUCER_NUM, &e)) break;
+        }
+        if (e.type >= PRODUCER_NUM) {
+            printf("  bad type %u\n", e.type);
+            errors += 1;
+            continue;
+        }
+        p = &producers[e.type];
+        // With retry every accepted event comes in order, without it the rejected ones leave gaps
+        if (p->retry && e.arg != p->next_arg) {
+            if (errors < 10) printf("  %s: arg %u, expected %u\n", p->name, e.arg, p->next_arg);
+            errors += 1;
+        }
+        if (!first[e.type] && (int32_t)(e.time - p->last_time) <= 0) {
+            if (errors < 10) printf("  %s: time %u after %u\n", p->name, e.time, p->last_time);
+            errors += 1;
+        }
+        first[e.type] = false;
+        p->next_arg = e.arg + 1;
+        p->last_time = e.time;
+        p->received += 1;
+    }
+    return NULL;
+}
+
+static void run(bool retry)
+{
+    pthread_t threads[PRODUCER_NUM], consumer;
+    uint64_t start;
+    uint32_t total = 0;
+    int i;
+
+    printf("%s:\n", retry ? "Producers retry when full" : "Producers drop when full");
+    atomic_store(&clock_count, 0xFFFFFFFFu - 1000);
+    atomic_store(&producers_running, PRODUCER_NUM);
+    for (i = 0; i < PRODUCER_NUM; ++i) {
+        producer_t *p = &producers[i];
+        event_queue_init(&p->queue, p->buf, p->size);
+        p->retry = retry;
+        p->sent = p->rejected = p->received = 0;
+        p->next_arg = 0;
+        queues[i] = &p->queue;
+    }
+
+    start = now_ns();
+    pthread_create(&consumer, NULL, consume, NULL);
+    for (i = 0; i < PRODUCER_NUM; ++i) pthread_create(&threads[i], NULL, produce, &producers[i]);
+    for (i = 0; i < PRODUCER_NUM; ++i) pthread_join(threads[i], NULL);
+    pthread_join(consumer, NULL);
+
+    for (i = 0; i < PRODUCER_NUM; ++i) {
+        producer_t *p = &producers[i];
+        uint32_t dropped = p->queue.dropped;
+        printf("  %-5s queue %3u: %6u sent, %6u received, %5u rejected, dropped %3u\n",
+               p->name, p->size, p->sent, p->received, p->rejected, dropped);
+        if (p->received != p->sent) {
+            printf("  %s: %u events lost\n", p->name, p->sent - p->received);
+            errors += 1;
+        }
+        // dropped saturates at 255
+        if (dropped != (p->rejected < 255 ? p->rejected : 255)) {
+            printf("  %s: dropped %u, rejected %u\n", p->name, dropped, p->rejected);
+            errors += 1;
+        }
+        total += p->received;
+    }
+    printf("  %u events in %.2f s, %.0f events/s\n", total, (now_ns() - start) / 1e9, total / ((now_ns() - start) / 1e9));
+}
+
+/**
+ * @brief Single thread checks: full queue, wrap around of the indexes, merging by timestamp, clear
+ */
+static void test_basic(void)
+{
+    event_t buf_a[4], buf_b[4], e;
+    event_queue_t a, b;
+    event_queue_t *const qs[] = {&a, &b};
+    uint32_t i;
+
+    event_queue_init(&a, buf_a, 4);
+    event_queue_init(&b, buf_b, 4);
+    for (i = 0; i < 4; ++i) {
+        if (!event_queue_push(&a, 0, i, i)) errors += 1;
+    }
+    if (event_queue_push(&a, 0, 4, 4) || a.dropped != 1 || event_queue_count(&a) != 4) {
+        printf("  full queue not detected\n");
+        errors += 1;
+    }
+    for (i = 0; i < 4; ++i) {
+        if (!event_queue_pop(&a, &e) || e.arg != i) errors += 1;
+    }
+    if (event_queue_pop(&a, &e)) errors += 1;
+
+    // The byte indexes wrap many times
+    for (i = 0; i < 1000; ++i) {
+        event_queue_push(&a, 1, (uint8_t)i, i);
+        if (!event_queue_pop(&a, &e) || e.arg != (uint8_t)i || e.time != i) {
+            printf("  wrap around at %u\n", i);
+            errors += 1;
+            break;
+        }
+    }
+
+    // Oldest first, across the wrap around of the timestamp
+    event_queue_push(&a, 0, 0, 0xFFFFFFF0u);
+    event_queue_push(&a, 0, 2, 0x00000010u);
+    event_queue_push(&b, 1, 1, 0xFFFFFFF8u);
+    event_queue_push(&b, 1, 3, 0x00000020u);
+    for (i = 0; i < 4; ++i) {
+        if (!event_queue_pop_oldest(qs, 2, &e) || e.arg != i) {
+            printf("  merge order wrong at %u\n", i);
+            errors += 1;
+        }
+    }
+    if (event_queue_pop_oldest(qs, 2, &e)) errors += 1;
+
+    event_queue_push(&b, 1, 0, 0);
+    event_queue_clear(&b);
+    if (event_queue_count(&b) != 0) errors += 1;
+    printf("Basic checks: %s\n", (errors == 0) ? "ok" : "failed");
+}
+
+int main(void)
+{
+    test_basic();
+    run(true);
+    run(false);
+    printf("\nErrors: %d\n", errors);
+    return (errors == 0) ? 0 : 1;
+}
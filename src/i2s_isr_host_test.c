@@ -0,0 +1,333 @@
+/**
+ * @brief Cycle count of the I2S IRQ handler of the audio player, before and after the per-format handlers, on a PC
+ * @details
+ *   The old handler (checks pgm_state, the channels and block_align for every sample, and counts
+ *   wav_header.data_chunk_size down) is copied from main.c before the per-format handlers. The new one is
+ *   I2S_IRQHandler() of i2s_play.c, the one main.c runs, calling the handler bound by i2s_bind_play().
+ *   Both are built with I2S_PLAY_HOST, the I2S registers are the mock of i2s_play.h that records the TX FIFO,
+ *   and without the profiler probes and the trace.
+ *   Both play the same song, refilled from memory when they post EV_REFILL, until EV_SONG_END.
+ *   The samples sent, the frames counted and the level meter must be the same, the cycles (rdtsc) of the
+ *   handler calls are compared, best of RUNS, at 44.1 kHz stereo and mono. The cost of timing an empty call
+ *   is taken off. For mono the old handler sends each sample twice in a word, the new one packs two samples
+ *   in a word for the I2S in mono (low half first), so it takes half the interrupts.
+ *   The mono song has an odd number of frames, for the last word that carries a single sample.
+ *   These are PC cycles, only the ratio says something about the M0.
+ * @usage gcc -O2 -Wall -DI2S_PLAY_HOST -DEVENT_QUEUE_HOST -DLEVEL_METER_HOST -DPROF_HOST -DPROFILING=0 -DTRACING=0 -I. -Iutils i2s_isr_host_test.c i2s_play.c utils/event_queue.c utils/level_meter.c -o i2s_isr_host_test && ./i2s_isr_host_test
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <x86intrin.h>
+
+#include "event_queue.h"
+#include "level_meter.h"
+#include "i2s_play.h"
+
+#define SAMPLE_RATE 44100
+#define SONG_SEC 10
+#define SONG_FRAMES (SAMPLE_RATE * SONG_SEC + 1)
+#define RUNS 5
+
+/* -------------------- */
+// What main.c gives the handlers, and the state the old handler used
+/* -------------------- */
+typedef enum { P_MODE_AUDIO_PLAY, P_MODE_PLAYBACK } Program_State;
+
+typedef struct {
+    uint16_t num_of_channels;
+    uint16_t block_align;
+    uint16_t bits_per_sample;
+    uint32_t data_chunk_size;
+} wav_header_t;
+
+static Program_State pgm_state = P_MODE_AUDIO_PLAY;
+static wav_header_t wav_header;
+static uint16_t pcm_buffer_data[PLAY_PCM_BUFF_SIZE];
+uint16_t *pcm_buffer = pcm_buffer_data;
+uint32_t pcm_buffer_len = PLAY_PCM_BUFF_SIZE;
+uint32_t pcm_buffer_idx;
+level_meter_t meter;
+volatile uint64_t play_frames;
+static event_t i2s_event_buf[8];
+event_queue_t i2s_events;
+
+uint32_t ui_timestamp(void) { return 0; }
+void apply_sw_filter(uint16_t *samples, uint32_t sample_count, uint16_t num_of_channels)
+{
+    (void)samples; (void)sample_count; (void)num_of_channels;
+}
+void play_refill_requested(void) {}
+
+/* -------------------- */
+// Old handler, the TX and RX parts of I2S_IRQHandler() before the per-format handlers
+/* -------------------- */
+static void old_I2S_IRQHandler(void)
+{
+    uint32_t u32status;
+    uint32_t u32data = 0;
+    uint32_t i;
+    uint32_t meter_peak = 0, meter_sum_sq = 0, meter_count = 0;
+    uint32_t frames = 0;
+    u32status = I2S_GET_INT_FLAG(I2S, I2S_STATUS_TXTHF_Msk | I2S_STATUS_RXTHF_Msk);
+
+    if (u32status & I2S_STATUS_TXTHF_Msk) {
+        if (pgm_state == P_MODE_AUDIO_PLAY) {
+            if (I2S_GET_INT_FLAG(I2S, I2S_STATUS_TXUDF_Msk)) {
+                I2S_CLR_INT_FLAG(I2S, I2S_STATUS_TXUDF_Msk);
+                event_queue_push(&i2s_events, EV_UNDERRUN, 0, ui_timestamp());
+            }
+            for (i = 0; i < 4; ++i) {
+                if (wav_header.num_of_channels == 1) {
+                    u32data = (pcm_buffer[pcm_buffer_idx] << 16) | pcm_buffer[pcm_buffer_idx];
+                    LEVEL_METER_ACCUMULATE(meter_peak, meter_sum_sq, (int16_t)pcm_buffer[pcm_buffer_idx]);
+                    meter_count += 1;
+                    pcm_buffer_idx += 1;
+                    wav_header.data_chunk_size -= 2;
+                } else if (wav_header.num_of_channels == 2) {
+                    if (wav_header.block_align == 4) {
+                        u32data = pcm_buffer[pcm_buffer_idx] << 16 | pcm_buffer[pcm_buffer_idx + 1];
+                        LEVEL_METER_ACCUMULATE(meter_peak, meter_sum_sq, (int16_t)pcm_buffer[pcm_buffer_idx]);
+                        LEVEL_METER_ACCUMULATE(meter_peak, meter_sum_sq, (int16_t)pcm_buffer[pcm_buffer_idx + 1]);
+                        meter_count += 2;
+                        pcm_buffer_idx += 2;
+                        wav_header.data_chunk_size -= 4;
+                    }
+                }
+
+                I2S_WRITE_TX_FIFO(I2S, u32data);
+                frames += 1;
+
+                if (wav_header.data_chunk_size == 0) {
+                    I2S_DisableInt(I2S, I2S_IE_TXTHIE_Msk | I2S_IE_RXTHIE_Msk);
+                    level_meter_fold(&meter, meter_peak, meter_sum_sq, meter_count);
+                    play_frames += frames;
+                    event_queue_push(&i2s_events, EV_SONG_END, 0, ui_timestamp());
+                    return;
+                }
+            }
+            level_meter_fold(&meter, meter_peak, meter_sum_sq, meter_count);
+            play_frames += frames;
+
+            if (pcm_buffer_idx >= pcm_buffer_len) {
+                I2S_DisableInt(I2S, I2S_IE_TXTHIE_Msk | I2S_IE_RXTHIE_Msk);
+                event_queue_push(&i2s_events, EV_REFILL, 0, ui_timestamp());
+            }
+        } else if (pgm_state == P_MODE_PLAYBACK) {
+            uint32_t u32Len;
+            uint16_t *pBuffTx = &pcm_buffer[0];
+            u32Len = 8 - I2S_GET_TX_FIFO_LEVEL(I2S);
+            if (pcm_buffer_idx >= 8) {
+                for (i = 0; i < u32Len; ++i) {
+                    u32data = (pBuffTx[i] << 16) | pBuffTx[i];
+                    I2S_WRITE_TX_FIFO(I2S, u32data);
+                }
+                play_frames += u32Len;
+                for (i = 0; i < pcm_buffer_len - u32Len; ++i) {
+                    pBuffTx[i] = pBuffTx[i + u32Len];
+                }
+                pcm_buffer_idx -= u32Len;
+            } else {
+                for (i = 0; i < u32Len; i++) {
+                    I2S_WRITE_TX_FIFO(I2S, 0x00000000);
+                }
+            }
+        }
+    }
+
+    if (u32status & I2S_STATUS_RXTHF_Msk) {
+        if (pgm_state == P_MODE_PLAYBACK) {
+            uint32_t u32Len;
+            uint16_t *pBuffRx = &pcm_buffer[pcm_buffer_idx];
+            if (pcm_buffer_idx < (pcm_buffer_len - 8)) {
+                u32Len = I2S_GET_RX_FIFO_LEVEL(I2S);
+                for (i = 0; i < u32Len; i++) {
+                    pBuffRx[i] = I2S_READ_RX_FIFO(I2S) & 0x0000FFFF;
+                }
+                apply_sw_filter(pBuffRx, u32Len, 1);
+                pcm_buffer_idx += u32Len;
+                if (pcm_buffer_idx >= pcm_buffer_len) {
+                    pcm_buffer_idx = 0;
+                }
+            }
+        }
+    }
+}
+
+/* -------------------- */
+// Test
+/* -------------------- */
+typedef struct result_t {
+    uint64_t cycles;
+    uint32_t calls;
+    uint32_t words;
+    uint64_t frames;
+    level_meter_t meter;
+} result_t;
+
+static uint16_t *song;
+static int errors = 0;
+
+/**
+ * @brief Plays the song with a handler, refills like start_play() does
+ * @param irq The IRQ handler
+ * @param channels 1 or 2
+ * @param words[out] Words sent to the TX FIFO
+ * @param r[out] Cycles and totals
+ */
+static void play(void (*irq)(void), uint16_t channels, uint32_t *words, result_t *r)
+{
+    uint32_t song_samples = SONG_FRAMES * channels, read_idx = 0, n;
+    uint64_t t0;
+    event_t e;
+    bool done = false;
+
+    memset(r, 0, sizeof(*r));
+    i2s_play_host.tx_out = words;
+    i2s_play_host.tx_count = 0;
+    play_frames = 0;
+    level_meter_reset(&meter);
+    event_queue_init(&i2s_events, i2s_event_buf, 8);
+    wav_header.num_of_channels = channels;
+    wav_header.bits_per_sample = 16;
+    wav_header.block_align = 2 * channels;
+    wav_header.data_chunk_size = song_samples * 2;
+    i2s_bind_play(wav_header.num_of_channels, wav_header.bits_per_sample);
+    i2s_frames_left = SONG_FRAMES;
+    i2s_play_host.IE = 0;
+
+    while (!done) {
+        if (i2s_play_host.IE == 0) {
+            // Refill
+            n = (song_samples - read_idx < pcm_buffer_len) ? song_samples - read_idx : pcm_buffer_len;
+            memcpy(pcm_buffer, &song[read_idx], n * sizeof(pcm_buffer[0]));
+            read_idx += n;
+            pcm_buffer_idx = 0;
+            i2s_play_host.IE = I2S_IE_TXTHIE_Msk | I2S_IE_RXTHIE_Msk;
+        }
+        while (i2s_play_host.IE != 0) {
+            t0 = __rdtsc();
+            irq();
+            r->cycles += __rdtsc() - t0;
+            r->calls += 1;
+        }
+        while (event_queue_pop(&i2s_events, &e)) {
+            if (e.type == EV_SONG_END) done = true;
+        }
+    }
+    r->words = i2s_play_host.tx_count;
+    r->frames = play_frames;
+    r->meter = meter;
+}
+
+/**
+ * @brief Cycles of the rdtsc pair around an empty call, taken off the results
+ */
+static double overhead_per_call(void)
+{
+    void (*volatile irq)(void) = i2s_none;
+    uint64_t t0, best = UINT64_MAX, total;
+    uint32_t i;
+    int run;
+
+    for (run = 0; run < RUNS; ++run) {
+        total = 0;
+        for (i = 0; i < 100000; ++i) {
+            t0 = __rdtsc();
+            irq();
+            total += __rdtsc() - t0;
+        }
+        if (total < best) best = total;
+    }
+    return best / 100000.0;
+}
+
+/**
+ * @brief Takes the samples out of the words sent
+ * @param words Words sent to the TX FIFO
+ * @param count Number of words
+ * @param channels 1 or 2
+ * @param packed Two mono samples in a word, low half first
+ * @param samples[out] The samples, SONG_FRAMES * channels
+ * @return Number of samples
+ */
+static uint32_t unpack(const uint32_t *words, uint32_t count, uint16_t channels, bool packed, uint16_t *samples)
+{
+    uint32_t i, n = 0;
+
+    for (i = 0; i < count; ++i) {
+        if (channels == 2) {
+            samples[n++] = words[i] >> 16;
+            samples[n++] = words[i] & 0xFFFF;
+        } else if (packed) {
+            samples[n++] = words[i] & 0xFFFF;
+            if (n < SONG_FRAMES) samples[n++] = words[i] >> 16;
+        } else {
+            samples[n++] = words[i] & 0xFFFF;
+        }
+    }
+    return n;
+}
+
+static void compare(uint16_t channels, double overhead)
+{
+    static uint32_t words_old[SONG_FRAMES], words_new[SONG_FRAMES];
+    static uint16_t samples_old[SONG_FRAMES * 2], samples_new[SONG_FRAMES * 2];
+    result_t old_r, new_r, r;
+    uint64_t old_best = UINT64_MAX, new_best = UINT64_MAX;
+    double old_cycles, new_cycles;
+    uint32_t old_n, new_n;
+    int run;
+
+    for (run = 0; run < RUNS; ++run) {
+        play(old_I2S_IRQHandler, channels, words_old, &r);
+        if (r.cycles < old_best) old_best = r.cycles;
+        old_r = r;
+        play(I2S_IRQHandler, channels, words_new, &r);
+        if (r.cycles < new_best) new_best = r.cycles;
+        new_r = r;
+    }
+
+    old_n = unpack(words_old, old_r.words, channels, false, samples_old);
+    new_n = unpack(words_new, new_r.words, channels, true, samples_new);
+    if (old_n != SONG_FRAMES * channels || new_n != old_n || memcmp(samples_old, samples_new, old_n * sizeof(samples_old[0])) != 0) {
+        printf("  samples sent differ, %u and %u\n", old_n, new_n);
+        errors += 1;
+    }
+    if (old_r.frames != new_r.frames || old_r.meter.acc_peak != new_r.meter.acc_peak ||
+        old_r.meter.acc_sum_sq != new_r.meter.acc_sum_sq || old_r.meter.acc_count != new_r.meter.acc_count) {
+        printf("  frames or level meter differ\n");
+        errors += 1;
+    }
+    old_cycles = old_best - overhead * old_r.calls;
+    new_cycles = new_best - overhead * new_r.calls;
+    printf("%s\n", (channels == 2) ? "Stereo" : "Mono");
+    printf("  old: %6u interrupts, %6u words, %6.1f cycles/interrupt, %5.1f cycles/frame\n",
+           old_r.calls, old_r.words, old_cycles / old_r.calls, old_cycles / SONG_FRAMES);
+    printf("  new: %6u interrupts, %6u words, %6.1f cycles/interrupt, %5.1f cycles/frame (%.0f%% of old)\n",
+           new_r.calls, new_r.words, new_cycles / new_r.calls, new_cycles / SONG_FRAMES, 100.0 * new_cycles / old_cycles);
+    // On the M0 each interrupt also costs its entry and exit, about 16 cycles each, which the calls above don't include
+    printf("  new: %.0f%% of the interrupts\n", 100.0 * new_r.calls / old_r.calls);
+}
+
+int main(void)
+{
+    uint32_t i;
+    double overhead;
+
+    song = malloc(SONG_FRAMES * 2 * sizeof(song[0]));
+    // Noise, full scale
+    for (i = 0; i < SONG_FRAMES * 2; ++i) song[i] = (uint16_t)((i * 2654435761u) >> 16);
+
+    overhead = overhead_per_call();
+    printf("%d s at %d Hz, rdtsc cycles of the handler calls, best of %d, less %.1f cycles of an empty call\n\n",
+           SONG_SEC, SAMPLE_RATE, RUNS, overhead);
+    compare(2, overhead);
+    compare(1, overhead);
+    printf("\nErrors: %d\n", errors);
+    free(song);
+    return (errors == 0) ? 0 : 1;
+}
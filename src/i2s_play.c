@@ -0,0 +1,226 @@
+#include "i2s_play.h"
+#include "prof.h"
+#include "trace.h"
+#ifdef I2S_PLAY_HOST
+#include "debug_printf.h"
+#else
+#include "NUC100Series.h"
+#include "DEBUG_PRINTF.h"
+#endif
+
+#ifdef I2S_PLAY_HOST
+i2s_play_host_t i2s_play_host = {I2S_STATUS_TXTHF_Msk, 0, NULL, 0};
+#endif
+
+/* -------------------- */
+// I2S IRQ handler, to send data to WAU8822
+/* -------------------- */
+// Bound to the mode and the song format by i2s_bind_play() or i2s_bind_playback()
+void (*i2s_tx_handler)(void) = i2s_none;
+void (*i2s_rx_handler)(void) = i2s_none;
+// Frames of the song not sent yet, written by the I2S IRQ handler, or by the play loop while the I2S interrupt is disabled
+uint32_t i2s_frames_left = 0;
+
+/**
+ * @brief IRQ handler for I2S
+ * @details send and recieve data to or from I2S, by the handlers bound to the mode
+ */
+void I2S_IRQHandler(void)
+{
+    uint32_t u32status;
+    uint32_t prof_start = PROF_START();
+    u32status = I2S_GET_INT_FLAG(I2S, I2S_STATUS_TXTHF_Msk | I2S_STATUS_RXTHF_Msk);
+
+    // I2S TX threshold interrupt
+    if (u32status & I2S_STATUS_TXTHF_Msk) {
+        i2s_tx_handler();
+    }
+    // I2S RX threshold interrupt
+    if (u32status & I2S_STATUS_RXTHF_Msk) {
+        i2s_rx_handler();
+    }
+    PROF_STOP(PROF_I2S_ISR, prof_start);
+}
+
+/**
+ * @brief Binds the sample path of the audio player to the format of the opened song
+ * @param num_of_channels Channels of the song
+ * @param bits_per_sample Bits of a sample of the song
+ */
+void i2s_bind_play(uint16_t num_of_channels, uint16_t bits_per_sample)
+{
+    if (bits_per_sample == 16 && num_of_channels == 1) {
+        i2s_tx_handler = i2s_tx_play_mono16;
+    } else if (bits_per_sample == 16 && num_of_channels == 2) {
+        i2s_tx_handler = i2s_tx_play_stereo16;
+    } else {
+        DEBUG_PRINTF("[WARN] %d channels of %d bits can't be played\n", num_of_channels, bits_per_sample);
+        i2s_tx_handler = i2s_tx_play_unsupported;
+    }
+    i2s_rx_handler = i2s_none;
+}
+
+/**
+ * @brief Binds the sample path of the playback mode
+ */
+void i2s_bind_playback(void)
+{
+    i2s_tx_handler = i2s_tx_playback;
+    i2s_rx_handler = i2s_rx_playback;
+}
+
+/**
+ * @brief Handler for an interrupt the mode doesn't use
+ */
+void i2s_none(void)
+{
+}
+
+/**
+ * @brief After the frames of a TX interrupt are sent, for the audio player
+ * @details Folds the level meter, moves the playback clock, and holds the interrupt at the end of the song or of the buffer
+ * @param frames Frames sent
+ * @param meter_peak Peak of the samples sent
+ * @param meter_sum_sq Sum of squares of the samples sent
+ * @param meter_count Samples sent, of all channels
+ */
+void i2s_tx_play_done(uint32_t frames, uint32_t meter_peak, uint32_t meter_sum_sq, uint32_t meter_count)
+{
+    level_meter_fold(&meter, meter_peak, meter_sum_sq, meter_count);
+    play_frames += frames;
+    i2s_frames_left -= frames;
+
+    // The FIFO ran empty since the last interrupt
+    if (I2S_GET_INT_FLAG(I2S, I2S_STATUS_TXUDF_Msk)) {
+        I2S_CLR_INT_FLAG(I2S, I2S_STATUS_TXUDF_Msk);
+        event_queue_push(&i2s_events, EV_UNDERRUN, 0, ui_timestamp());
+        TRACE(UNDERRUN, i2s_frames_left, 0);
+    }
+
+    // Check end of the song, then if buffer needs refill sound data
+    if (i2s_frames_left == 0) {
+        I2S_DisableInt(I2S, I2S_IE_TXTHIE_Msk | I2S_IE_RXTHIE_Msk);
+        event_queue_push(&i2s_events, EV_SONG_END, 0, ui_timestamp());
+        TRACE(SONG_END, play_frames, 0);
+    } else if (pcm_buffer_idx >= pcm_buffer_len) {
+        I2S_DisableInt(I2S, I2S_IE_TXTHIE_Msk | I2S_IE_RXTHIE_Msk);
+        event_queue_push(&i2s_events, EV_REFILL, 0, ui_timestamp());
+        TRACE(REFILL_REQ, i2s_frames_left, 0);
+        play_refill_requested();
+    }
+}
+
+/**
+ * @brief TX handler of the audio player, 16-bit mono, the I2S is opened in mono (see init_audio_stuff())
+ * @details Each FIFO word carries two samples, the first in the low half, so an interrupt sends twice the frames of stereo.
+ *          An odd last frame of the song goes alone in the low half
+ */
+void i2s_tx_play_mono16(void)
+{
+    uint32_t meter_peak = 0, meter_sum_sq = 0;
+    uint32_t i, n = (i2s_frames_left < 2 * I2S_TX_WORDS_PER_INT) ? i2s_frames_left : 2 * I2S_TX_WORDS_PER_INT;
+    const uint16_t *p = &pcm_buffer[pcm_buffer_idx];
+
+    for (i = 0; i + 1 < n; i += 2) {
+        LEVEL_METER_ACCUMULATE(meter_peak, meter_sum_sq, (int16_t)p[i]);
+        LEVEL_METER_ACCUMULATE(meter_peak, meter_sum_sq, (int16_t)p[i + 1]);
+        I2S_WRITE_TX_FIFO(I2S, ((uint32_t)p[i + 1] << 16) | p[i]);
+    }
+    if (n & 1) {
+        LEVEL_METER_ACCUMULATE(meter_peak, meter_sum_sq, (int16_t)p[n - 1]);
+        I2S_WRITE_TX_FIFO(I2S, p[n - 1]);
+    }
+    pcm_buffer_idx += n;
+    i2s_tx_play_done(n, meter_peak, meter_sum_sq, n);
+}
+
+/**
+ * @brief TX handler of the audio player, 16-bit stereo
+ */
+void i2s_tx_play_stereo16(void)
+{
+    uint32_t meter_peak = 0, meter_sum_sq = 0;
+    uint32_t i, n = (i2s_frames_left < I2S_TX_WORDS_PER_INT) ? i2s_frames_left : I2S_TX_WORDS_PER_INT;
+    const uint16_t *p = &pcm_buffer[pcm_buffer_idx];
+
+    for (i = 0; i < n; ++i) {
+        LEVEL_METER_ACCUMULATE(meter_peak, meter_sum_sq, (int16_t)p[0]);
+        LEVEL_METER_ACCUMULATE(meter_peak, meter_sum_sq, (int16_t)p[1]);
+        I2S_WRITE_TX_FIFO(I2S, ((uint32_t)p[0] << 16) | p[1]);
+        p += 2;
+    }
+    pcm_buffer_idx += 2 * n;
+    i2s_tx_play_done(n, meter_peak, meter_sum_sq, 2 * n);
+}
+
+/**
+ * @brief TX handler of the audio player, for the formats it can't play, ends the song at once
+ */
+void i2s_tx_play_unsupported(void)
+{
+    I2S_DisableInt(I2S, I2S_IE_TXTHIE_Msk | I2S_IE_RXTHIE_Msk);
+    event_queue_push(&i2s_events, EV_SONG_END, 0, ui_timestamp());
+}
+
+/**
+ * @brief TX handler of the playback mode, sends what the RX handler collected
+ * @note From https://github.com/OpenNuvoton/NUC472_442BSP/blob/master/SampleCode/StdDriver/I2S_NAU8822/nuc472_442_isr.c
+ */
+void i2s_tx_playback(void)
+{
+    uint32_t u32Len;
+    uint32_t u32data;
+    uint32_t i;
+    uint16_t *pBuffTx = &pcm_buffer[0];
+    // Read Tx FIFO free size
+    u32Len = 8 - I2S_GET_TX_FIFO_LEVEL(I2S);
+
+    if (pcm_buffer_idx >= 8) {
+        for (i = 0; i < u32Len; ++i) {
+            u32data = (pBuffTx[i] << 16) | pBuffTx[i];
+            I2S_WRITE_TX_FIFO(I2S, u32data);
+        }
+        play_frames += u32Len;
+
+        for (i = 0; i < pcm_buffer_len - u32Len; ++i) {
+            pBuffTx[i] = pBuffTx[i + u32Len];
+        }
+
+        pcm_buffer_idx -= u32Len;
+        TRACE(PLAYBACK_TX, u32Len, pcm_buffer_idx);
+    } else {
+        for (i = 0; i < u32Len; i++) {
+            I2S_WRITE_TX_FIFO(I2S, 0x00000000);
+        }
+    // I2S_DisableInt(I2S, I2S_IE_TXTHIE_Msk);
+    }
+}
+
+/**
+ * @brief RX handler of the playback mode, collects the samples from the codec
+ */
+void i2s_rx_playback(void)
+{
+    uint32_t u32Len;
+    uint32_t i;
+    uint16_t *pBuffRx = &pcm_buffer[pcm_buffer_idx];
+
+    if (pcm_buffer_idx < (pcm_buffer_len - 8)) {
+        /* Read Rx FIFO Level */
+        u32Len = I2S_GET_RX_FIFO_LEVEL(I2S);
+
+        for (i = 0; i < u32Len; i++) {
+            pBuffRx[i] = I2S_READ_RX_FIFO(I2S) & 0x0000FFFF;
+        }
+        apply_sw_filter(pBuffRx, u32Len, 1);
+
+        pcm_buffer_idx += u32Len;
+        TRACE(PLAYBACK_RX, u32Len, pcm_buffer_idx);
+
+        if (pcm_buffer_idx >= pcm_buffer_len) {
+            pcm_buffer_idx = 0;
+        }
+    } else {
+    // I2S_DisableInt(I2S, I2S_IE_RXTHIE_Msk);
+    }
+}
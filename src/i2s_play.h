@@ -0,0 +1,101 @@
+/**
+ * @brief Sample path of the I2S interrupts, for the audio player and the playback mode
+ * @details
+ *   I2S_IRQHandler() calls the TX and RX handlers bound to the mode and the song format by i2s_bind_play() or
+ *   i2s_bind_playback(), so it doesn't check them for every sample.
+ *   The buffer, the level meter, the playback clock and the event queue the handlers use are the program's,
+ *   main.c defines them, see below.
+ *   main.c runs the handlers on the target, i2s_isr_host_test.c and level_meter_host_test.c run them on a PC,
+ *   both with this file. Built with I2S_PLAY_HOST the I2S registers are the mock below.
+ */
+
+#ifndef _I2S_PLAY_H_
+#define _I2S_PLAY_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "event_queue.h"
+#include "level_meter.h"
+
+// PCM buffer of each mode, in samples, main.c carves it out of the mode arena
+#define PLAY_PCM_BUFF_SIZE 2048
+#define PLAYBACK_PCM_BUFF_SIZE 512
+#define I2S_TX_WORDS_PER_INT 4    // FIFO words sent by a TX threshold interrupt of the audio player, 4 frames of stereo or 8 of mono
+
+/**
+ * @brief Events from the interrupt handlers to the state machine
+ */
+typedef enum Event_Type {
+    EV_KEY_DOWN,    // Keypad, arg is the key 1 ~ 9
+    EV_KEY_UP,      // Keypad, arg is the released key
+    EV_STOP,        // EINT1, quit the song
+    EV_REFILL,      // I2S sent the PCM buffer, its interrupt is held until the refill
+    EV_UNDERRUN,    // I2S TX FIFO ran empty, the refill was late
+    EV_SONG_END,    // I2S sent the last frame of the song
+    EV_TICK,        // Timer 0, every UI_STATS_TICKS
+} Event_Type;
+
+#ifdef I2S_PLAY_HOST
+// Bits of I2S STATUS and IE used by the handlers, same as the NUC100 series
+#define I2S_STATUS_RXTHF_Msk (1ul << 10)
+#define I2S_STATUS_TXUDF_Msk (1ul << 16)
+#define I2S_STATUS_TXTHF_Msk (1ul << 18)
+#define I2S_IE_RXTHIE_Msk (1ul << 3)
+#define I2S_IE_TXTHIE_Msk (1ul << 11)
+
+/**
+ * @brief Mock of the I2S, the words written to the TX FIFO are stored in tx_out, given by the test
+ */
+typedef struct i2s_play_host_t {
+    uint32_t STATUS;
+    uint32_t IE;
+    uint32_t *tx_out;
+    uint32_t tx_count;
+} i2s_play_host_t;
+
+extern i2s_play_host_t i2s_play_host;
+
+#define I2S (&i2s_play_host)
+#define I2S_GET_INT_FLAG(i2s, mask) ((i2s)->STATUS & (mask))
+#define I2S_CLR_INT_FLAG(i2s, mask) ((i2s)->STATUS &= ~(mask))
+#define I2S_DisableInt(i2s, mask) ((i2s)->IE &= ~(mask))
+#define I2S_WRITE_TX_FIFO(i2s, data) ((i2s)->tx_out[(i2s)->tx_count++] = (data))
+#define I2S_GET_TX_FIFO_LEVEL(i2s) 0
+#define I2S_GET_RX_FIFO_LEVEL(i2s) 0
+#define I2S_READ_RX_FIFO(i2s) 0
+#endif
+
+/* -------------------- */
+// Defined by the program
+/* -------------------- */
+extern uint16_t *pcm_buffer;
+extern uint32_t pcm_buffer_len;    // Samples
+extern uint32_t pcm_buffer_idx;
+extern level_meter_t meter;
+extern volatile uint64_t play_frames;
+extern event_queue_t i2s_events;
+uint32_t ui_timestamp(void);
+void apply_sw_filter(uint16_t *samples, uint32_t sample_count, uint16_t num_of_channels);
+// Called when EV_REFILL is posted, the refill has until the TX FIFO runs empty
+void play_refill_requested(void);
+
+/* -------------------- */
+// Sample path
+/* -------------------- */
+extern void (*i2s_tx_handler)(void);
+extern void (*i2s_rx_handler)(void);
+extern uint32_t i2s_frames_left;
+
+void I2S_IRQHandler(void);
+void i2s_bind_play(uint16_t num_of_channels, uint16_t bits_per_sample);
+void i2s_bind_playback(void);
+void i2s_none(void);
+void i2s_tx_play_done(uint32_t frames, uint32_t meter_peak, uint32_t meter_sum_sq, uint32_t meter_count);
+void i2s_tx_play_mono16(void);
+void i2s_tx_play_stereo16(void);
+void i2s_tx_play_unsupported(void);
+void i2s_tx_playback(void);
+void i2s_rx_playback(void);
+
+#endif // _I2S_PLAY_H_
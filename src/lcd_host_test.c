@@ -0,0 +1,608 @@
+/**
+ * @brief Tests and benchmarks of the LCD section of myLib.h, on a PC
+ * @details
+ *   (1) Flush: draws the menu and now playing screens of ui_screens.c, flushes them with mlh_show_lcd(),
+ *       counts the SPI3 words, and checks the emulated LCD matches mlh_lcd_buffer after every frame.
+ *       Like main.c, a screen is cleared when it's entered, and drawn over after that.
+ *       "shadow" is what the old flush (compare with a copy of the LCD) would have sent, for comparison
+ *   (2) Draw: the byte-oriented draw functions against the old pixel by pixel ones (kept here as reference),
+ *       they must give the same lcd buf, and the time of a full-screen text redraw is compared
+ *   (3) Bus: time on SPI3 of a full refresh and a clear, streamed through the FIFO under one chip select,
+ *       against the old path (1 MHz, one transfer a word, 9 us each, the CPU overhead not counted)
+ *   (4) Background flush: frames are submitted and sent by mlh_step_flush_lcd() like the timer 0 tick does,
+ *       the longest step is the time the timer interrupt holds SPI3, and the LCD is checked after each frame
+ *   (5) Screens: the screens of ui_screens.c are flushed to the emulated LCD and compared pixel by pixel with the
+ *       images in lcd_golden/. A screen that differs is saved as lcd_fail_<name>.pbm, to look at
+ *   (6) Primitives: time of each draw function, and the SPI3 words its flush costs on a blank screen
+ * @usage Run in src/, to find lcd_golden/
+ *   gcc -O2 -I. -I../Library/Nu-LB-NUC140/Include lcd_host_test.c ui_screens.c -o lcd_host_test && ./lcd_host_test
+ *   ./lcd_host_test -u  // Save the screens as the new images in lcd_golden/, after an intended change
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#define MLH_HOST
+#define MLH_LCD
+#define MLH_LCD_DYNAMIC_UPDATE
+#include "myLib.h"
+#include "ui_screens.h"
+
+#define MODE_NUM 3
+#define SONG_NUM 7
+
+// Words of a mode menu move with the old flush, a move must not cost more
+#define MENU_MOVE_MAX_WORDS 72
+
+const char mode_names[MODE_NUM][17] = {"Player", "Playback", "Recorder"};
+const char song_names[SONG_NUM][13] = {"stereo.wav", "Do_8192.wav", "test.wav", "Do_5sec.wav", "gb10.wav", "im60.wav", "happy.wav"};
+
+// What the LCD shows, for counting the words the old flush would send
+uint8_t shadow[128 * 8];
+uint32_t total_words = 0, total_shadow_words = 0;
+int errors = 0;
+
+/**
+ * @brief Words the old flush would send, the one that compares every byte with a copy of the LCD
+ * @return Number of 9-bit words, and updates the copy
+ */
+uint32_t count_shadow_flush(void)
+{
+    uint16_t x, y, idx;
+    uint32_t words = 0;
+    bool flag;
+    for (y = 0; y < 8; ++y) {
+        words += 3;
+        flag = false;
+        for (x = 0; x < LCD_Xmax; ++x) {
+            idx = y * LCD_Xmax + ((LCD_Xmax - 1) - x);
+            if (mlh_lcd_buffer[idx] != shadow[idx]) {
+                if (flag) {
+                    words += 3;
+                    flag = false;
+                }
+                words += 1;
+                shadow[idx] = mlh_lcd_buffer[idx];
+            } else {
+                flag = true;
+            }
+        }
+    }
+    return words;
+}
+
+/**
+ * @brief Flush, print the counts, and check the emulated LCD
+ * @param name Name of the frame
+ * @return The SPI3 words sent
+ */
+uint32_t flush_frame(const char *name)
+{
+    uint16_t x, y;
+    uint32_t words, shadow_words;
+
+    shadow_words = count_shadow_flush();
+    mlh_host_spi_reset_count();
+    mlh_show_lcd();
+    words = mlh_host_spi3.cmd_count + mlh_host_spi3.data_count;
+    total_words += words;
+    total_shadow_words += shadow_words;
+
+    // Buffer column x is on CA (129 - x)
+    for (y = 0; y < 8; ++y) {
+        for (x = 0; x < LCD_Xmax; ++x) {
+            if (mlh_host_spi3.gdram[y][(LCD_Xmax + 1) - x] != mlh_lcd_buffer[y * LCD_Xmax + x]) {
+                errors += 1;
+            }
+        }
+    }
+    printf("%-26s data %4u  cmd %3u  words %4u (%5u us)  shadow %4u\n", name,
+           mlh_host_spi3.data_count, mlh_host_spi3.cmd_count, words,
+           (unsigned)(mlh_host_spi3.bus_ps / 1000000), shadow_words);
+    return words;
+}
+
+const char *mode_name(uint16_t idx)
+{
+    return mode_names[idx];
+}
+
+const char *song_name(uint16_t idx)
+{
+    return song_names[idx];
+}
+
+/* -------------------- */
+// Reference, the pixel by pixel draw functions from before the byte-oriented ones
+/* -------------------- */
+void ref_draw_bitmap(const uint8_t *bitmap, uint16_t x, uint16_t y, uint16_t width_px, uint16_t height_px, uint16_t color, bool force_draw)
+{
+    uint16_t i, j;
+    if (x > (LCD_Xmax - width_px) || y > (LCD_Ymax - height_px)) return;
+    for (i = 0; i < width_px; i += 1) {
+        for (j = 0; j < height_px; j += 1) {
+            if (bitmap[(j / 8) * width_px + i] & (0x01 << (j % 8))) {
+                mlh_draw_pixel_lcd_buf(x + i, y + j, color);
+            } else if (force_draw == true) {
+                mlh_draw_pixel_lcd_buf(x + i, y + j, ~(color));
+            }
+        }
+    }
+}
+
+void ref_print_char(uint16_t x, uint16_t y, uint8_t font_size, unsigned char ascii_code)
+{
+    uint16_t i, j, base_idx;
+    uint8_t font_bitmap[8];
+    if (font_size == 8 && (x <= (LCD_Xmax - 8) && y <= (LCD_Ymax - 8))) {
+        base_idx = (ascii_code - 0x20) * 16;
+        for (j = 0; j < 2; ++j) {
+            for (i = 0; i < 8; ++i) {
+                font_bitmap[i] = Font8x16[base_idx + j * 8 + i];
+            }
+            ref_draw_bitmap(font_bitmap, x, y + j * 8, 8, 8, FG_COLOR, true);
+        }
+    } else if (font_size == 5 && (x <= (LCD_Xmax - 5) && y <= (LCD_Ymax - 7))) {
+        if (ascii_code < 0x20) ascii_code = 0x20;
+        base_idx = (ascii_code - 0x20) * 5;
+        for (i = 0; i < 5; ++i) {
+            font_bitmap[i] = Font5x7[base_idx + i];
+        }
+        ref_draw_bitmap(font_bitmap, x, y, 5, 8, FG_COLOR, true);
+    }
+}
+
+void ref_draw_rectangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color, bool fill)
+{
+    int16_t x, y, tmp;
+    if (x0 > x1) { tmp = x1; x1 = x0; x0 = tmp; }
+    if (y0 > y1) { tmp = y1; y1 = y0; y0 = tmp; }
+    if (fill) {
+        for (x = x0; x <= x1; x++) {
+            for (y = y0; y <= y1; y++) {
+                mlh_draw_pixel_lcd_buf(x, y, color);
+            }
+        }
+    } else {
+        for (x = x0; x <= x1; x++) mlh_draw_pixel_lcd_buf(x, y0, color);
+        for (y = y0; y <= y1; y++) mlh_draw_pixel_lcd_buf(x0, y, color);
+        for (x = x0; x <= x1; x++) mlh_draw_pixel_lcd_buf(x, y1, color);
+        for (y = y0; y <= y1; y++) mlh_draw_pixel_lcd_buf(x1, y, color);
+    }
+}
+
+void ref_invert_region(uint16_t x, uint16_t y, uint16_t width_px, uint16_t height_px)
+{
+    uint16_t i, j;
+    if (x > (LCD_Xmax - width_px) || y > (LCD_Ymax - height_px)) return;
+    for (i = x; i < x + width_px; ++i) {
+        for (j = y; j < y + height_px; ++j) {
+            mlh_lcd_buffer[(j / 8) * LCD_Xmax + i] ^= (0x01 << (j % 8));
+        }
+    }
+}
+
+/**
+ * @brief Full-screen text, 4 lines of 8x16 or 8 lines of 5x7, the lines are 3 rows up to hit the unaligned path
+ * @param use_ref Use the reference draw functions
+ * @param font_size 8 or 5
+ */
+void draw_full_screen_text(bool use_ref, uint8_t font_size)
+{
+    uint16_t x, y, line_height = (font_size == 8) ? 16 : 8;
+    unsigned char c = 'A';
+    for (y = 0; y + line_height <= LCD_Ymax; y += line_height) {
+        for (x = 0; x + font_size <= LCD_Xmax; x += font_size) {
+            if (use_ref) ref_print_char(x, (y == 0) ? 0 : y - 3, font_size, c);
+            else mlh_print_char_lcd_buf(x, (y == 0) ? 0 : y - 3, font_size, c);
+            c = (c == 'z') ? 'A' : c + 1;
+        }
+    }
+}
+
+/**
+ * @brief Nanoseconds of one full-screen text redraw, on this PC
+ */
+double time_full_screen_text(bool use_ref, uint8_t font_size)
+{
+    struct timespec t0, t1;
+    uint32_t i, n = 20000;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < n; ++i) {
+        draw_full_screen_text(use_ref, font_size);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / n;
+}
+
+/**
+ * @brief Checks the byte-oriented draw functions give the same lcd buf as the reference, and times them
+ */
+void test_draw(void)
+{
+    static uint8_t start[128 * 8], expected[128 * 8];
+    uint32_t i, k;
+    int16_t x0, y0, x1, y1;
+    uint16_t color, w, h;
+    unsigned char c;
+    bool flag;
+    uint8_t bitmap[3 * 20];
+    double t_ref, t_new;
+    int draw_errors = 0;
+
+    srand(1);
+    for (i = 0; i < 4000; ++i) {
+        for (k = 0; k < sizeof(start); ++k) start[k] = rand();
+        for (k = 0; k < sizeof(bitmap); ++k) bitmap[k] = rand();
+        x0 = rand() % LCD_Xmax; x1 = rand() % LCD_Xmax;
+        y0 = rand() % LCD_Ymax; y1 = rand() % LCD_Ymax;
+        w = 1 + rand() % 20; h = 1 + rand() % 24;
+        color = (rand() & 1) ? FG_COLOR : BG_COLOR;
+        flag = rand() & 1;
+        c = 0x20 + rand() % 95;
+
+        // Reference first, then the same on the same start
+        for (k = 0; k < 2; ++k) {
+            memcpy(mlh_lcd_buffer, start, sizeof(start));
+            switch (i % 4) {
+            case 0:
+                if (k == 0) ref_draw_rectangle(x0, y0, x1, y1, color, flag);
+                else mlh_draw_rectangle_lcd_buf(x0, y0, x1, y1, color, flag);
+                break;
+            case 1:
+                if (k == 0) ref_invert_region(x0, y0, w, h);
+                else mlh_invert_region_lcd_buf(x0, y0, w, h);
+                break;
+            case 2:
+                if (k == 0) ref_draw_bitmap(bitmap, x0, y0, w, h, color, flag);
+                else mlh_draw_bitmap_lcd_buf(bitmap, x0, y0, w, h, color, flag);
+                break;
+            case 3:
+                if (k == 0) ref_print_char(x0, y0, flag ? 8 : 5, c);
+                else mlh_print_char_lcd_buf(x0, y0, flag ? 8 : 5, c);
+                break;
+            }
+            if (k == 0) memcpy(expected, mlh_lcd_buffer, sizeof(expected));
+        }
+        if (memcmp(expected, mlh_lcd_buffer, sizeof(expected)) != 0) {
+            draw_errors += 1;
+        }
+    }
+
+    for (k = 0; k < 2; ++k) {
+        uint8_t font_size = (k == 0) ? 8 : 5;
+        memset(mlh_lcd_buffer, 0, sizeof(mlh_lcd_buffer));
+        draw_full_screen_text(true, font_size);
+        memcpy(expected, mlh_lcd_buffer, sizeof(expected));
+        memset(mlh_lcd_buffer, 0, sizeof(mlh_lcd_buffer));
+        draw_full_screen_text(false, font_size);
+        if (memcmp(expected, mlh_lcd_buffer, sizeof(expected)) != 0) {
+            draw_errors += 1;
+        }
+        t_ref = time_full_screen_text(true, font_size);
+        t_new = time_full_screen_text(false, font_size);
+        printf("full-screen text %dx%s  pixel by pixel %8.0f ns  byte-oriented %8.0f ns  (%.1fx)\n",
+               font_size, (font_size == 8) ? "16" : "7", t_ref, t_new, t_ref / t_new);
+    }
+    printf("Draw mismatch: %d\n", draw_errors);
+    errors += draw_errors;
+}
+
+/**
+ * @brief Flushes the screens of ui_screens.c and counts the SPI3 words
+ */
+void test_flush(void)
+{
+    uint16_t i;
+    char name[32];
+
+    mlh_init_lcd();
+    mlh_show_lcd();
+
+    // Mode selection, first frame, then down and up
+    mlh_clear_lcd_buf();
+    ui_draw_mode_menu(0, MODE_NUM, mode_name);
+    flush_frame("mode menu");
+    // The cursor and the scroll bar are on both ends of a page, they must be sent as two spans
+    ui_draw_mode_menu(1, MODE_NUM, mode_name);
+    if (flush_frame("mode menu, down") > MENU_MOVE_MAX_WORDS) {
+        printf("mode menu, down costs more than %d words\n", MENU_MOVE_MAX_WORDS);
+        errors += 1;
+    }
+    ui_draw_mode_menu(0, MODE_NUM, mode_name);
+    if (flush_frame("mode menu, up") > MENU_MOVE_MAX_WORDS) {
+        printf("mode menu, up costs more than %d words\n", MENU_MOVE_MAX_WORDS);
+        errors += 1;
+    }
+    ui_draw_mode_menu(0, MODE_NUM, mode_name);
+    flush_frame("mode menu, no change");
+
+    // Song menu, scroll through all the songs
+    mlh_clear_lcd_buf();
+    for (i = 0; i < SONG_NUM; ++i) {
+        ui_draw_song_menu(i, (i < 3) ? i : 3, SONG_NUM, song_name);
+        sprintf(name, "song menu %d", i);
+        flush_frame(name);
+    }
+
+    // Now playing, a 3 minutes song, the time is drawn over every second
+    mlh_clear_lcd_buf();
+    ui_draw_now_playing(song_names[0], false, 0, 180);
+    flush_frame("now playing 0 s");
+    for (i = 1; i < 4; ++i) {
+        ui_draw_play_status(false, i, 180 - i);
+        sprintf(name, "now playing %d s", i);
+        flush_frame(name);
+    }
+    ui_draw_play_status(true, 3, 177);
+    flush_frame("now playing, paused");
+
+    printf("\ntotal words %u, shadow %u\n", total_words, total_shadow_words);
+    printf("RAM for the flush: %u bytes, shadow %u bytes\n",
+           (unsigned)(sizeof(_mlh_dirty_x0) + sizeof(_mlh_dirty_x1) + sizeof(_mlh_ink_x0) + sizeof(_mlh_ink_x1)),
+           (unsigned)sizeof(shadow));
+    printf("LCD mismatch: %d bytes\n", errors);
+}
+
+/**
+ * @brief Print the bus time of what was sent since the counters were cleared, against the old path
+ * @param name Name of the operation
+ */
+void print_bus_time(const char *name)
+{
+    uint32_t words = mlh_host_spi3.cmd_count + mlh_host_spi3.data_count;
+    uint32_t us = (uint32_t)(mlh_host_spi3.bus_ps / 1000000);
+    printf("%-14s words %4u  cs %2u  bus %5u us  old %5u us  (%.1fx)\n", name, words,
+           mlh_host_spi3.ss_count, us, words * 9, (double)(words * 9) / us);
+}
+
+/**
+ * @brief Bus time of a full refresh and a clear of the LCD
+ */
+void test_bus(void)
+{
+    uint16_t x, y;
+
+    printf("SPI3 clock %u Hz\n", mlh_host_spi3.clock_hz);
+    for (x = 0; x < 128 * 8; ++x) {
+        mlh_lcd_buffer[x] = rand() & 0xFF;
+    }
+    mlh_mark_dirty_lcd_buf(0, 0, LCD_Xmax - 1, LCD_Ymax - 1);
+    mlh_host_spi_reset_count();
+    mlh_show_lcd();
+    print_bus_time("full refresh");
+    for (y = 0; y < 8; ++y) {
+        for (x = 0; x < LCD_Xmax; ++x) {
+            if (mlh_host_spi3.gdram[y][(LCD_Xmax + 1) - x] != mlh_lcd_buffer[y * LCD_Xmax + x]) {
+                errors += 1;
+            }
+        }
+    }
+
+    mlh_host_spi_reset_count();
+    mlh_clear_lcd_only();
+    print_bus_time("clear");
+    for (y = 0; y < 8; ++y) {
+        for (x = 0; x < MLH_HOST_LCD_CA_NUM; ++x) {
+            if (mlh_host_spi3.gdram[y][x] != 0) {
+                errors += 1;
+            }
+        }
+    }
+    printf("LCD mismatch: %d bytes\n", errors);
+}
+
+/**
+ * @brief Send the submitted frame by steps, print the steps, and check the emulated LCD
+ * @param name Name of the frame
+ */
+void flush_frame_by_steps(const char *name)
+{
+    uint16_t x, y;
+    uint32_t steps = 0, max_us = 0, us;
+    uint64_t total_ps = 0;
+
+    mlh_submit_lcd();
+    while (!mlh_lcd_frame_done) {
+        mlh_host_spi_reset_count();
+        mlh_step_flush_lcd(MLH_LCD_FLUSH_BUDGET);
+        us = (uint32_t)(mlh_host_spi3.bus_ps / 1000000);
+        if (us > max_us) max_us = us;
+        total_ps += mlh_host_spi3.bus_ps;
+        steps += 1;
+    }
+    for (y = 0; y < 8; ++y) {
+        for (x = 0; x < LCD_Xmax; ++x) {
+            if (mlh_host_spi3.gdram[y][(LCD_Xmax + 1) - x] != mlh_lcd_buffer[y * LCD_Xmax + x]) {
+                errors += 1;
+            }
+        }
+    }
+    printf("%-16s steps %2u (%3u ms at 200 Hz)  bus %5u us  longest step %3u us\n", name, steps, steps * 5,
+           (unsigned)(total_ps / 1000000), max_us);
+}
+
+/**
+ * @brief Frames sent in slices by the background flush
+ */
+void test_background_flush(void)
+{
+    uint16_t i;
+
+    printf("Budget %u bytes a step\n", MLH_LCD_FLUSH_BUDGET);
+    for (i = 0; i < 128 * 8; ++i) {
+        mlh_lcd_buffer[i] = rand() & 0xFF;
+    }
+    mlh_mark_dirty_lcd_buf(0, 0, LCD_Xmax - 1, LCD_Ymax - 1);
+    flush_frame_by_steps("full screen");
+
+    mlh_clear_lcd_buf();
+    ui_draw_mode_menu(0, MODE_NUM, mode_name);
+    flush_frame_by_steps("mode menu");
+    ui_draw_mode_menu(1, MODE_NUM, mode_name);
+    flush_frame_by_steps("mode menu, down");
+    flush_frame_by_steps("no change");
+
+    mlh_clear_lcd_buf();
+    ui_draw_now_playing(song_names[0], false, 0, 180);
+    flush_frame_by_steps("now playing");
+    for (i = 1; i < 3; ++i) {
+        ui_draw_play_status(false, i, 180 - i);
+        flush_frame_by_steps("time tick");
+    }
+    printf("LCD mismatch: %d bytes\n", errors);
+}
+
+/**
+ * @brief Draw a screen on a blank lcd buf, flush it, and compare the LCD with the image in lcd_golden/
+ * @param name Name of the screen, the image is lcd_golden/<name>.pbm
+ * @param id Screen to draw
+ * @param update Save the LCD as the image instead
+ */
+void check_screen(const char *name, uint16_t id, bool update)
+{
+    static uint8_t panel[128 * 8];
+    char path[64];
+    int32_t diff;
+
+    mlh_clear_lcd_buf();
+    switch (id) {
+    case 0: ui_draw_start(0); break;
+    case 1: ui_draw_start(1); break;
+    case 2: ui_draw_mode_menu(0, MODE_NUM, mode_name); break;
+    case 3: ui_draw_mode_menu(2, MODE_NUM, mode_name); break;
+    case 4: ui_draw_song_menu(0, 0, SONG_NUM, song_name); break;
+    case 5: ui_draw_song_menu(5, 3, SONG_NUM, song_name); break;
+    case 6: ui_draw_now_playing(song_names[0], false, 0, 180); break;
+    case 7: ui_draw_now_playing(song_names[0], true, 95, 85); break;
+    }
+    mlh_show_lcd();
+    mlh_host_panel_to_buf(panel);
+    if (memcmp(panel, mlh_lcd_buffer, sizeof(panel)) != 0) {
+        errors += 1;
+    }
+
+    sprintf(path, "lcd_golden/%s.pbm", name);
+    if (update) {
+        if (mlh_host_write_pbm(path, panel) != 0) {
+            printf("%-16s can't write %s\n", name, path);
+            errors += 1;
+        } else {
+            printf("%-16s saved\n", name);
+        }
+        return;
+    }
+    diff = mlh_host_diff_pbm(path, panel);
+    if (diff == 0) {
+        printf("%-16s ok\n", name);
+        return;
+    }
+    if (diff < 0) {
+        printf("%-16s can't read %s\n", name, path);
+    } else {
+        printf("%-16s %d pixels differ\n", name, diff);
+    }
+    sprintf(path, "lcd_fail_%s.pbm", name);
+    mlh_host_write_pbm(path, panel);
+    errors += 1;
+}
+
+/**
+ * @brief The screens of ui_screens.c against the images in lcd_golden/
+ * @param update Save the screens as the new images
+ */
+void test_screens(bool update)
+{
+    check_screen("start", 0, update);
+    check_screen("usage", 1, update);
+    check_screen("mode_menu", 2, update);
+    check_screen("mode_menu_2", 3, update);
+    check_screen("song_menu", 4, update);
+    check_screen("song_menu_5", 5, update);
+    check_screen("now_playing", 6, update);
+    check_screen("paused", 7, update);
+}
+
+/**
+ * @brief Run a draw function once, with fixed arguments
+ * @param id Draw function
+ */
+void draw_primitive(uint16_t id)
+{
+    static const uint8_t bitmap[2 * 16] = {
+        0x00, 0xFF, 0x81, 0xBD, 0xA5, 0xA5, 0xBD, 0x81, 0x81, 0xBD, 0xA5, 0xA5, 0xBD, 0x81, 0xFF, 0x00,
+        0x00, 0xFF, 0x81, 0xBD, 0xA5, 0xA5, 0xBD, 0x81, 0x81, 0xBD, 0xA5, 0xA5, 0xBD, 0x81, 0xFF, 0x00,
+    };
+    switch (id) {
+    case 0: mlh_draw_pixel_lcd_buf(61, 27, FG_COLOR); break;
+    case 1: mlh_draw_byte_lcd_buf(0x5A, 61, 27, FG_COLOR); break;
+    case 2: mlh_draw_line_lcd_buf(3, 5, 120, 58, FG_COLOR); break;
+    case 3: mlh_draw_rectangle_lcd_buf(10, 5, 117, 58, FG_COLOR, false); break;
+    case 4: mlh_draw_rectangle_lcd_buf(10, 5, 117, 58, FG_COLOR, true); break;
+    case 5: mlh_draw_circle_lcd_buf(64, 32, 25, FG_COLOR, false); break;
+    case 6: mlh_draw_circle_lcd_buf(64, 32, 25, FG_COLOR, true); break;
+    case 7: mlh_draw_triangle_lcd_buf(5, 60, 64, 3, 122, 60, FG_COLOR); break;
+    case 8: mlh_draw_bitmap_lcd_buf(bitmap, 61, 27, 16, 16, FG_COLOR, false); break;
+    case 9: mlh_print_char_lcd_buf(61, 27, 8, 'A'); break;
+    case 10: mlh_print_char_lcd_buf(61, 27, 5, 'A'); break;
+    case 11: mlh_print_line_lcd_buf(0, 27, 8, "WAV PLAYER 1234"); break;
+    case 12: mlh_invert_region_lcd_buf(10, 5, 108, 54); break;
+    }
+}
+
+/**
+ * @brief Time of each draw function on this PC, and the SPI3 words to flush it on a blank screen
+ */
+void test_primitives(void)
+{
+    static const char *names[] = {
+        "pixel", "byte", "line", "rectangle", "rectangle, fill", "circle", "circle, fill",
+        "triangle", "bitmap 16x16", "char 8x16", "char 5x7", "line 8x16, 15 ch", "invert 108x54",
+    };
+    struct timespec t0, t1;
+    uint32_t i, n = 100000;
+    uint16_t id;
+    double ns;
+
+    for (id = 0; id < sizeof(names) / sizeof(names[0]); ++id) {
+        mlh_clear_lcd_buf();
+        mlh_show_lcd();
+        draw_primitive(id);
+        mlh_host_spi_reset_count();
+        mlh_show_lcd();
+
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (i = 0; i < n; ++i) {
+            draw_primitive(id);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        ns = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / n;
+        printf("%-18s %8.1f ns  words %4u  bus %5u us\n", names[id], ns,
+               mlh_host_spi3.cmd_count + mlh_host_spi3.data_count, (unsigned)(mlh_host_spi3.bus_ps / 1000000));
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && strcmp(argv[1], "-u") == 0) {
+        mlh_init_lcd();
+        test_screens(true);
+        return (errors == 0) ? 0 : 1;
+    }
+
+    test_flush();
+    printf("\n");
+    test_draw();
+    printf("\n");
+    test_bus();
+    printf("\n");
+    test_background_flush();
+    printf("\n");
+    test_screens(false);
+    printf("\n");
+    test_primitives();
+    return (errors == 0) ? 0 : 1;
+}
@@ -0,0 +1,221 @@
+/**
+ * @brief Test of the level meter (utils/level_meter.c) and what it costs in the sample path, on a PC
+ * @details
+ *   Sines at 0, -6, -20 and -40 dBFS and a full scale square wave are sent by i2s_tx_play_stereo16() of
+ *   i2s_play.c, the TX handler main.c runs, which meters them in interrupts of I2S_TX_WORDS_PER_INT frames, and
+ *   level_meter_update() runs every 50 ms of audio. The peak and RMS must match the ones in double within
+ *   MAX_LEVEL_ERR, and level_meter_to_db() the dB of the peak within 1 dB. A full scale square wave at 96 kHz
+ *   stereo, the most samples between two updates, must not overflow the sum of squares.
+ *   The ballistics: after the sound stops the peak must fall by 1/8 per update, and the RMS rise by 1/2.
+ *
+ *   The overhead: the cycles (rdtsc) of i2s_tx_play_stereo16() are compared with the same handler without
+ *   LEVEL_METER_ACCUMULATE(), best of RUNS. The handlers are built with I2S_PLAY_HOST, the TX FIFO is the mock
+ *   of i2s_play.h, and without the profiler probes and the trace. These are PC cycles, only the ratio says
+ *   something about the M0.
+ * @usage gcc -O2 -Wall -DLEVEL_METER_HOST -DI2S_PLAY_HOST -DEVENT_QUEUE_HOST -DPROF_HOST -DPROFILING=0 -DTRACING=0 -I. -Iutils level_meter_host_test.c i2s_play.c utils/level_meter.c utils/event_queue.c -lm -o level_meter_host_test && ./level_meter_host_test
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include <x86intrin.h>
+
+#include "level_meter.h"
+#include "i2s_play.h"
+
+#define SAMPLE_RATE 44100
+#define UPDATE_FRAMES (SAMPLE_RATE / 20)
+#define SONG_FRAMES (SAMPLE_RATE * 2)
+#define MAX_LEVEL_ERR 0.02        // Of the level, at -40 dBFS each square is only a few LSB after the >> 15
+#define RUNS 5
+
+static int errors = 0;
+static uint16_t song[SONG_FRAMES * 2];
+static uint32_t tx_words[SONG_FRAMES];
+
+/* -------------------- */
+// What main.c gives the handlers
+/* -------------------- */
+uint16_t *pcm_buffer;
+uint32_t pcm_buffer_len;
+uint32_t pcm_buffer_idx;
+level_meter_t meter;
+volatile uint64_t play_frames;
+static event_t i2s_event_buf[8];
+event_queue_t i2s_events;
+
+uint32_t ui_timestamp(void) { return 0; }
+void apply_sw_filter(uint16_t *samples, uint32_t sample_count, uint16_t num_of_channels)
+{
+    (void)samples; (void)sample_count; (void)num_of_channels;
+}
+void play_refill_requested(void) {}
+
+/**
+ * @brief i2s_tx_play_stereo16() without LEVEL_METER_ACCUMULATE(), the baseline of the overhead
+ * @details The fold in i2s_tx_play_done() is left in, it is once per interrupt
+ */
+static void tx_stereo16_no_meter(void)
+{
+    uint32_t i, n = (i2s_frames_left < I2S_TX_WORDS_PER_INT) ? i2s_frames_left : I2S_TX_WORDS_PER_INT;
+    const uint16_t *p = &pcm_buffer[pcm_buffer_idx];
+
+    for (i = 0; i < n; ++i) {
+        I2S_WRITE_TX_FIFO(I2S, ((uint32_t)p[0] << 16) | p[1]);
+        p += 2;
+    }
+    pcm_buffer_idx += 2 * n;
+    i2s_tx_play_done(n, 0, 0, 2 * n);
+}
+
+/**
+ * @brief Hands frames of song to the TX handler as the PCM buffer, like a refill of start_play() does
+ */
+static void refill(const uint16_t *samples, uint32_t frames)
+{
+    pcm_buffer = (uint16_t *)samples;
+    pcm_buffer_len = 2 * frames;
+    pcm_buffer_idx = 0;
+    i2s_frames_left = frames;
+    i2s_play_host.tx_out = tx_words;
+    i2s_play_host.tx_count = 0;
+    event_queue_clear(&i2s_events);
+}
+
+/**
+ * @brief Play frames of song through the meter, updated every update_frames
+ */
+static void play(const uint16_t *samples, uint32_t frames, uint32_t update_frames)
+{
+    uint32_t sent = 0, last;
+
+    refill(samples, frames);
+    while (sent < frames) {
+        last = sent;
+        i2s_tx_play_stereo16();
+        sent = pcm_buffer_idx / 2;
+        if (sent % update_frames < sent - last) level_meter_update(&meter);
+    }
+}
+
+static void check_level(const char *name, double peak, double rms)
+{
+    uint8_t db = level_meter_to_db(meter.peak);
+    double db_ref = (peak < 32767.0 * 1e-3) ? 60.0 : -20.0 * log10(peak / 32767.0);
+
+    printf("  %-8s peak %5u (%7.1f), RMS %5u (%7.1f), %2u dB\n", name, meter.peak, peak, meter.rms, rms, db);
+    if (fabs(meter.peak - peak) > MAX_LEVEL_ERR * peak + 1 || fabs(meter.rms - rms) > MAX_LEVEL_ERR * rms + 1 ||
+        fabs(db - db_ref) > 1.0) {
+        errors += 1;
+    }
+}
+
+static void test_levels(void)
+{
+    static const double dbfs[] = {0, -6, -20, -40};
+    char name[16];
+    double a;
+    uint32_t j, i;
+    int before = errors;
+
+    for (j = 0; j < sizeof(dbfs) / sizeof(dbfs[0]); ++j) {
+        a = 32767.0 * pow(10.0, dbfs[j] / 20.0);
+        for (i = 0; i < SONG_FRAMES; ++i) {
+            song[2 * i] = (uint16_t)(int16_t)lrint(a * sin(2.0 * M_PI * 1000.0 * i / SAMPLE_RATE));
+            song[2 * i + 1] = song[2 * i];
+        }
+        level_meter_reset(&meter);
+        play(song, SONG_FRAMES, UPDATE_FRAMES);
+        snprintf(name, sizeof(name), "%+.0f dB", dbfs[j]);
+        check_level(name, a, a / sqrt(2.0));
+    }
+
+    // 50 ms at 96 kHz stereo, full scale, in one update
+    for (i = 0; i < SONG_FRAMES; ++i) {
+        song[2 * i] = (uint16_t)(int16_t)((i & 32) ? -32768 : 32767);
+        song[2 * i + 1] = song[2 * i];
+    }
+    level_meter_reset(&meter);
+    for (i = 0; i < 20; ++i) play(song, 96000 / 20, 96000 / 20);
+    check_level("Square", 32767.0, 32767.0);
+
+    printf("Levels: %s\n", (errors == before) ? "ok" : "failed");
+}
+
+static void test_ballistics(void)
+{
+    uint16_t last_peak, last_rms;
+    uint32_t i;
+    int before = errors;
+
+    // From full scale to silence
+    last_peak = meter.peak;
+    for (i = 0; i < 4; ++i) {
+        level_meter_fold(&meter, 0, 0, 2 * UPDATE_FRAMES);
+        level_meter_update(&meter);
+        if (meter.peak != last_peak - ((last_peak + 7) >> 3)) {
+            printf("  peak %u after %u, %u expected\n", meter.peak, last_peak, last_peak - ((last_peak + 7) >> 3));
+            errors += 1;
+        }
+        last_peak = meter.peak;
+    }
+
+    // From silence to full scale, the peak at once, the RMS half way each update
+    level_meter_reset(&meter);
+    for (i = 1; i <= 4; ++i) {
+        play(song, UPDATE_FRAMES, UPDATE_FRAMES);
+        last_rms = (uint16_t)(32767 - (32767 >> i));
+        if (meter.peak != 32767 || fabs(meter.rms - last_rms) > MAX_LEVEL_ERR * last_rms) {
+            printf("  peak %u, RMS %u, %u expected\n", meter.peak, meter.rms, last_rms);
+            errors += 1;
+        }
+    }
+    printf("Ballistics: %s\n", (errors == before) ? "ok" : "failed");
+}
+
+/**
+ * @brief Cycles of the whole song through a TX handler, best of RUNS
+ */
+static uint64_t time_handler(void (*handler)(void))
+{
+    uint64_t t0, t, best = UINT64_MAX;
+    int run;
+
+    for (run = 0; run < RUNS; ++run) {
+        level_meter_reset(&meter);
+        refill(song, SONG_FRAMES);
+        t0 = __rdtsc();
+        while (pcm_buffer_idx < pcm_buffer_len) handler();
+        t = __rdtsc() - t0;
+        if (t < best) best = t;
+    }
+    return best;
+}
+
+static void test_overhead(void)
+{
+    uint64_t with, without;
+    uint32_t i, rand_state = 1;
+
+    // Noise, full scale, so the compare of the peak goes both ways
+    for (i = 0; i < SONG_FRAMES * 2; ++i) {
+        rand_state = rand_state * 1664525u + 1013904223u;
+        song[i] = (uint16_t)(rand_state >> 16);
+    }
+    without = time_handler(tx_stereo16_no_meter);
+    with = time_handler(i2s_tx_play_stereo16);
+    printf("Overhead\n");
+    printf("  without the meter: %5.2f cycles/sample\n", (double)without / (SONG_FRAMES * 2));
+    printf("  with the meter:    %5.2f cycles/sample, %+.2f (%.0f%% of without)\n", (double)with / (SONG_FRAMES * 2),
+           ((double)with - (double)without) / (SONG_FRAMES * 2), 100.0 * with / without);
+}
+
+int main(void)
+{
+    event_queue_init(&i2s_events, i2s_event_buf, 8);
+    test_levels();
+    test_ballistics();
+    test_overhead();
+    printf("\nErrors: %d\n", errors);
+    return (errors == 0) ? 0 : 1;
+}
@@ -5,31 +5,98 @@
 #include "MCU_init.h"
 #include "NUC100Series.h"
 #include "SYS_init.h"
+#include "PowerDown.h"
 
 #include "ffconf.h"
 #include "diskio.h"
 #include "ff.h"
+#include "prof.h"
+#include "trace.h"
+#include "mem_stat.h"
+#include "arena.h"
 
 #define MLH_LED
 #define MLH_7SEG_INT
 #define MLH_KEYPAD_INT
 #define MLH_LCD
 #define MLH_LCD_DYNAMIC_UPDATE
+#define MLH_UART
+#define MLH_LCD_SHOW_BEGIN() PROF_START()
+#define MLH_LCD_SHOW_END(start) PROF_STOP(PROF_LCD_SHOW, start)
+// Keys are posted to the key queue by the keypad interrupt
+void key_event(uint8_t key, uint8_t key_last);
+#define MLH_KEYPAD_EVENT(key, key_last) key_event(key, key_last)
 #include "myLib.h"
 
 // #include "wave_sample.h"
 #include "wav_lib.h"
 #include "wau8822.h"
+#include "dsp_biquad.h"
+#include "dsp_fft.h"
+#include "level_meter.h"
+#include "wav_seek.h"
+#include "event_queue.h"
+#include "clock_gov.h"
+#include "coop_sched.h"
 #include "DEBUG_PRINTF.h"
+#include "ui_screens.h"
+#include "i2s_play.h"
 
 
 /* -------------------- */
 // Macros
 /* -------------------- */
 #define WAV_HEADER_BUF_SIZE 64
-#define PCM_BUFF_SIZE 512
-#define SCROLL_BAR_WIDTH 5
+// Region shared by the modes, each carves its buffers when it starts, see carve_play_buffers()
+// Sized for the mode that needs the most, keep the needs in step with what the carve functions take
+#define PLAY_ARENA_NEED (ARENA_SIZE_OF(FIL, 1) + ARENA_SIZE_OF(unsigned char, WAV_HEADER_BUF_SIZE) + \
+                         ARENA_SIZE_OF(DWORD, SEEK_CLMT_LEN) + ARENA_SIZE_OF(dsp_q15_t, VIS_FFT_LEN * 2) + \
+                         ARENA_SIZE_OF(uint16_t, PLAY_PCM_BUFF_SIZE))
+#define PLAYBACK_ARENA_NEED ARENA_SIZE_OF(uint16_t, PLAYBACK_PCM_BUFF_SIZE)
+#define SDCARD_ARENA_NEED ARENA_SIZE_OF(BYTE, FF_MAX_SS)  // init_sdcard_stuff(), before any mode
+#define MODE_ARENA_MAX(a, b) (((a) > (b)) ? (a) : (b))
+#define MODE_ARENA_SIZE MODE_ARENA_MAX(PLAY_ARENA_NEED, MODE_ARENA_MAX(PLAYBACK_ARENA_NEED, SDCARD_ARENA_NEED))
 #define PLAYBACK_SAMPLE_RATE 8192
+// Software filter, for the processing that the codec can't do. 1 to enable, 0 to disable
+#define SW_FILTER_ENABLE 0
+#define SW_FILTER_STAGES 2
+#define SW_FILTER_HPF_FREQ 30      // Hz, stage 1, rumble and DC, 1st order (a 2nd order one can't be placed in Q15)
+#define SW_FILTER_PEAK_FREQ 3000   // Hz, stage 2, parametric EQ
+#define SW_FILTER_PEAK_GAIN 0.0f   // dB
+#define SW_FILTER_PEAK_Q 1.0f
+// Spectrum analyzer page, key 9 to toggle while playing
+#define VIS_FFT_LEN 128
+#define VIS_BAR_NUM 16
+#define VIS_BAR_WIDTH 6
+#define VIS_TAP_RATE 11025         // Hz, PCM is decimated to about this rate before the FFT
+#define VIS_FRAME_TICKS 10         // Timer 0 ticks (5ms) between frames, 20 fps at most
+#define VIS_PEAK_HOLD_FRAMES 10
+// Level meter, on the LEDs, and on the 7seg (key 7 to toggle between time and dB)
+#define METER_UPDATE_TICKS 10      // Timer 0 ticks (5ms) between updates
+#define SEG_PATTERN_MINUS 18       // Index in _mlh_SEG_BUF for the minus sign
+// UI statistics, renders per second and CPU time spent in rendering
+#define UI_STATS_TICKS 200         // Timer 0 ticks (5ms) between statistics, 1 second
+// Seeking while playing, keys 4 and 6 skip back and forward (hold to scan), keys 1 and 3 skip further
+#define SEEK_SHORT_SEC 5
+#define SEEK_LONG_SEC 30
+#define SEEK_SCAN_SEC 2            // Per scan step
+#define SEEK_SCAN_DELAY_TICKS 100  // Timer 0 ticks (5ms) of holding before scanning, 0.5 second
+#define SEEK_SCAN_TICKS 40         // Timer 0 ticks (5ms) between scan steps, 10x speed
+#define SEEK_CLMT_LEN 32           // DWORDs of the cluster link map for fast seek, files of up to 15 fragments
+// Power-down in the menus, after this many seconds without a key
+#define POWER_DOWN_IDLE_SEC 30
+// HCLK operating points, the governor picks the one while playing, see clock_gov.h
+#define HCLK_MENU_POINT CLOCK_GOV_12MHZ    // Menus only wait for keys
+#define HCLK_PLAY_POINT CLOCK_GOV_50MHZ    // Opening, seeking and the first window of a song
+// Event queues, one per interrupt handler, power of 2 sizes
+#define EVENT_KEY_QUEUE_SIZE 16
+#define EVENT_STOP_QUEUE_SIZE 4
+#define EVENT_I2S_QUEUE_SIZE 8
+#define EVENT_TIMER_QUEUE_SIZE 4
+// Event trace (trace.h), drained to UART0, or appended to TRACE_FILE_PATH on the SD card when set to 1
+#define TRACE_TO_FILE 0
+#define TRACE_FILE_PATH "0:trace.bin"
+#define TRACE_DRAIN_BYTES 64       // Per step of the trace task
 
 /* -------------------- */
 // Program state enumeration define and global variable
@@ -42,6 +109,19 @@ typedef enum Program_State {
     P_MODE_AUDIO_RECORDER,
 } Program_State;
 
+/* -------------------- */
+// Tasks of the play loop, highest priority first
+/* -------------------- */
+typedef enum Play_Task {
+    PLAY_TASK_REFILL,       // I2S events and the PCM buffer, has a deadline once the buffer is sent
+    PLAY_TASK_INPUT,        // Keys, INT1 and the timer events
+    PLAY_TASK_METER,        // Level meter ballistics, every METER_UPDATE_TICKS
+    PLAY_TASK_LCD_FLUSH,    // Sends the submitted LCD frame, a slice per step
+    PLAY_TASK_UI,           // Spectrum analyzer, now playing screen and playing time
+    PLAY_TASK_TRACE,        // Sends the event trace, when nothing else has work
+    PLAY_TASK_NUM,
+} Play_Task;
+
 struct Pgm_Mode {
     unsigned char name[17];
     Program_State mode;
@@ -58,8 +138,8 @@ struct Pgm_Mode pgm_mode_name_map[MODE_NUM] = {
 /* -------------------- */
 // SD card related global variable
 /* -------------------- */
-FIL fp;
-BYTE ff_buff[128];
+// The song, carved out of the mode arena by the player
+FIL *song_fp = NULL;
 // File system object for logical drive
 FATFS FatFs[FF_VOLUMES];
 // Path to mount
@@ -69,10 +149,16 @@ unsigned char mount_path[] = "0:";
 // Wav file related global variable
 /* -------------------- */
 wav_header_t wav_header;
-unsigned char wav_header_data[WAV_HEADER_BUF_SIZE];
-uint16_t pcm_buffer[PCM_BUFF_SIZE];
+// The buffers are carved out of the mode arena by the mode that uses them
+unsigned char *wav_header_data = NULL;
+uint16_t *pcm_buffer = NULL;
+uint32_t pcm_buffer_len = 0;    // Samples
 uint32_t pcm_buffer_idx = 0;
+// Only the play loop writes it, the I2S IRQ handler posts EV_REFILL
 bool pcm_buffer_needs_refill = true;
+// Where the samples are in the opened file, and its cluster link map, for seeking
+wav_seek_t wav_seek;
+DWORD *wav_clmt = NULL;
 // file name <= 8 characters, and extension <= 3 characters
 const char wav_file_path[][13] = {
     "stereo.wav",
@@ -89,34 +175,234 @@ const char wav_file_path[][13] = {
 uint32_t wav_file_count = sizeof(wav_file_path) / sizeof(wav_file_path[0]);
 
 /* -------------------- */
-// EINT1 related global variable
+// Codec related global variable
+/* -------------------- */
+// Tone shaping is done by the codec's EQ/3D/limiter blocks, key 6 cycles through the presets
+WAU8822_TonePreset_t tone_preset = WAU8822_TONE_FLAT;
+
+/* -------------------- */
+// Software filter related global variable
+/* -------------------- */
+dsp_q15_t sw_filter_coeffs[SW_FILTER_STAGES * 6];
+dsp_q15_t sw_filter_state[2][SW_FILTER_STAGES * 4];
+// One instance for each channel, index 0 is left (or mono), 1 is right
+dsp_biquad_casd_df1_inst_q15 sw_filter[2];
+
+/* -------------------- */
+// Spectrum analyzer related global variable
+/* -------------------- */
+bool vis_enabled = false;
+// The tap collects real samples into the FFT buffer directly (re, im interleaved)
+dsp_q15_t *vis_fft_buf = NULL;
+uint16_t vis_tap_idx = 0;
+uint16_t vis_decimation = 1;
+int32_t vis_decim_acc = 0;
+uint16_t vis_decim_cnt = 0;
+uint8_t vis_bar[VIS_BAR_NUM];
+uint8_t vis_peak[VIS_BAR_NUM];
+uint8_t vis_peak_hold[VIS_BAR_NUM];
+// Log spaced band edges, in FFT bins
+const uint8_t vis_band_edge[VIS_BAR_NUM + 1] = {1, 2, 3, 4, 5, 6, 7, 9, 11, 14, 17, 21, 26, 32, 39, 48, 64};
+const char *playing_file_name = "";
+
+/* -------------------- */
+// Level meter related global variable
 /* -------------------- */
-bool STOP_PLAYING = false;
+level_meter_t meter;
+bool meter_show_db = false;
+// LED bar thresholds of the peak, in dB below full scale, leftmost LED first
+const uint8_t meter_led_db[4] = {36, 24, 12, 3};
+
+/* -------------------- */
+// Playback clock related global variable
+/* -------------------- */
+// Frames sent to the I2S, only the I2S IRQ handler adds to it, so it stops when the refill stalls
+volatile uint64_t play_frames = 0;
+// Frames of the song and its sample rate, to turn frames into time
+uint64_t play_total_frames = 0;
+uint32_t play_sample_rate = 1;
+// Paused by key 5, the I2S sends zeros and the clock stops
+bool play_paused = false;
+
+/* -------------------- */
+// Event related global variable
+/* -------------------- */
+// Each queue has one producer (its interrupt handler) and one consumer (the main loop)
+event_t key_event_buf[EVENT_KEY_QUEUE_SIZE];
+event_t stop_event_buf[EVENT_STOP_QUEUE_SIZE];
+event_t i2s_event_buf[EVENT_I2S_QUEUE_SIZE];
+event_t timer_event_buf[EVENT_TIMER_QUEUE_SIZE];
+event_queue_t key_events, stop_events, i2s_events, timer_events;
+event_queue_t *const event_queues[] = {&key_events, &stop_events, &i2s_events, &timer_events};
+#define EVENT_QUEUE_NUM (sizeof(event_queues) / sizeof(event_queues[0]))
+
+/* -------------------- */
+// Play loop related global variable
+/* -------------------- */
+// The tasks are stackless, so the state of the play loop is kept here
+FIL *play_fp = NULL;
+bool play_quit = false;
+// Key held down, 0 if none, for scanning
+uint8_t play_key_held = 0;
+// Next scan step while 4 or 6 is held, and the time of the last seek key, to measure it
+uint32_t play_scan_tick = 0, play_seek_start = 0;
+bool play_seek_pending = false;
+// Now playing screen to draw, once the LCD frame in flight is sent
+bool play_now_playing_pending = false;
+// Playing time last shown on the 7seg and the LCD
+uint32_t play_seg_sec = 0, play_lcd_sec = 0;
+// Next level meter update
+uint32_t play_meter_tick = 0;
+// Timer 0 counts from the end of the PCM buffer until the FIFO runs empty, the deadline of the refill
+uint32_t play_refill_slack = 0;
+event_queue_t *const play_input_queues[] = {&key_events, &stop_events, &timer_events};
+#define PLAY_INPUT_QUEUE_NUM (sizeof(play_input_queues) / sizeof(play_input_queues[0]))
+sched_task_t play_tasks[PLAY_TASK_NUM];
+sched_t play_sched;
+// Set while start_play() runs the tasks, timer 0 leaves the level meter to them
+volatile bool play_tasks_running = false;
+#if (TRACE_TO_FILE == 1)
+FIL trace_fp;
+bool trace_fp_open = false;
+#endif
+
+/* -------------------- */
+// Power related global variable
+/* -------------------- */
+// Timer 0 counts the play loop spent in WFI, and the tick it started, for the awake duty cycle of a song
+uint64_t play_sleep_counts = 0;
+uint32_t play_duty_start_tick = 0;
+// Seconds in the menus without a key, see POWER_DOWN_IDLE_SEC
+uint16_t ui_idle_sec = 0;
+// Start of the window the HCLK governor measures, in play_sleep_counts and ticks
+uint64_t hclk_window_sleep = 0;
+uint32_t hclk_window_tick = 0;
+
+/* -------------------- */
+// UI related global variable
+/* -------------------- */
+// Totals, only written by the main loop, timer 0 takes the difference every second
+uint32_t ui_render_total = 0;
+uint32_t ui_render_time_total = 0; // In timer 0 counts
+uint32_t ui_render_start = 0;
+uint16_t ui_renders_per_sec = 0;
+uint16_t ui_busy_permille = 0;
 
 /* -------------------- */
 // Timer related global variable
 /* -------------------- */
 uint32_t cnt_5ms = 0;
+// Free running 5ms tick, for the UI and the spectrum analyzer frame rate
+volatile uint32_t sys_tick = 0;
 uint32_t seg_no = 3;
 bool seg_effect = true;
 bool start_count = false;
 
+/* -------------------- */
+// Memory related global variable
+/* -------------------- */
+// The buffers of the mode that runs, freed all at once when it leaves
+uint64_t mode_arena_buf[MODE_ARENA_SIZE / sizeof(uint64_t)];
+arena_t mode_arena;
+// The big buffers of the 16 KB RAM, by module, for the memory screen (key 9 in the mode menu)
+const mem_stat_entry_t mem_map[] = {
+    MEM_STAT_VAR("fatfs", FatFs),
+    MEM_STAT_SIZE("fatfs", "LfnBuf", (FF_MAX_LFN + 1) * sizeof(WCHAR)),
+    MEM_STAT_VAR("audio", wav_seek),
+    MEM_STAT_VAR("arena", mode_arena_buf),
+    MEM_STAT_VAR("lcd", mlh_lcd_buffer),
+    MEM_STAT_VAR("uart", mlh_tx_buf),
+    MEM_STAT_VAR("uart", mlh_rx_buf),
+    MEM_STAT_VAR("dsp", sw_filter_state),
+    MEM_STAT_VAR("dsp", sw_filter_coeffs),
+    MEM_STAT_VAR("dsp", meter),
+    MEM_STAT_VAR("events", key_event_buf),
+    MEM_STAT_VAR("events", stop_event_buf),
+    MEM_STAT_VAR("events", i2s_event_buf),
+    MEM_STAT_VAR("events", timer_event_buf),
+    MEM_STAT_VAR("sched", play_tasks),
+    MEM_STAT_SIZE("trace", "s_ring", TRACE_RING_SIZE * sizeof(trace_rec_t)),
+    MEM_STAT_SIZE("prof", "s_probe", PROF_PROBE_NUM * sizeof(prof_probe_t)),
+};
+#define MEM_MAP_NUM (sizeof(mem_map) / sizeof(mem_map[0]))
+// Same order as event_queues
+const char *const event_queue_names[EVENT_QUEUE_NUM] = {"key", "stop", "i2s", "timer"};
+#define MEM_MODULES_PER_PAGE 7
+
 /* -------------------- */
 // Function prototypes
 /* -------------------- */
-void init_audio_stuff(uint32_t sample_rate);
+void init_audio_stuff(uint32_t sample_rate, uint16_t num_of_channels, WAU8822_Power_t power);
 void init_sdcard_stuff(void);
 void open_wav_file(FIL *fp, const char *file_path, wav_header_t *header);
 void start_play(FIL *fp);
+void init_play_tasks(void);
+bool play_task_refill_ready(void);
+uint8_t play_task_refill(sched_task_t *t);
+bool play_task_input_ready(void);
+uint8_t play_task_input(sched_task_t *t);
+bool play_task_meter_ready(void);
+uint8_t play_task_meter(sched_task_t *t);
+bool play_task_lcd_flush_ready(void);
+uint8_t play_task_lcd_flush(sched_task_t *t);
+bool play_task_ui_ready(void);
+uint8_t play_task_ui(sched_task_t *t);
+bool play_task_trace_ready(void);
+uint8_t play_task_trace(sched_task_t *t);
+uint32_t trace_sink(const uint8_t *data, uint32_t len);
+bool trace_sink_ready(void);
+void print_play_task_stats(void);
 void close_wav_file(FIL *fp);
+void next_tone_preset(bool apply);
+void init_sw_filter(uint32_t sample_rate);
+void apply_sw_filter(uint16_t *samples, uint32_t sample_count, uint16_t num_of_channels);
+void init_visualizer(uint32_t sample_rate);
+void tap_visualizer(const uint16_t *samples, uint32_t sample_count, uint16_t num_of_channels);
+void step_visualizer(void);
+void show_now_playing(void);
+void show_meter(void);
+void play_clock_start(uint64_t total_frames, uint32_t sample_rate);
+uint64_t play_clock_frames(void);
+void play_clock_seek(uint64_t frame);
+uint32_t play_clock_elapsed_sec(void);
+uint32_t play_clock_remaining_sec(void);
+void seg_play_time(uint32_t sec);
+void show_play_status(void);
+void play_seek(FIL *fp, int32_t delta_sec);
+void play_pause(bool pause);
+uint32_t ui_timestamp(void);
+uint32_t ui_counts_to_us(uint32_t counts);
+void ui_render_begin(void);
+void ui_render_end(void);
+void ui_update_stats(void);
+void init_events(void);
+bool event_pending(void);
+bool ui_poll_queues(event_queue_t *const *qs, uint8_t n, event_t *e);
+bool ui_poll_event(event_t *e);
+void ui_wait_event(event_t *e);
+void play_duty_start(void);
+uint16_t play_duty_permille(void);
+void pgm_power_down(void);
+void hclk_set_point(clock_gov_point_t point);
+void hclk_window_start(void);
+void hclk_govern(void);
 
 void put_rc(FRESULT rc);
 unsigned long get_fattime(void);
 
+const char *mode_name(uint16_t idx);
+const char *song_name(uint16_t idx);
 void show_song_menu(uint16_t idx, uint16_t line);
 void show_mode_menu(uint16_t idx);
 void pgm_start(void);
 void pgm_mode_selection(void);
+uint8_t memory_page_num(void);
+void show_memory_page(uint8_t page);
+void print_memory_info(void);
+void pgm_memory_info(void);
+bool carve_play_buffers(void);
+bool carve_playback_buffers(void);
+void show_out_of_memory(void);
 void pgm_audio_play(void);
 void pgm_audio_playback(void);
 
@@ -131,8 +417,8 @@ void pgm_audio_playback(void);
 void EINT1_IRQHandler(void)
 {
     GPIO_CLR_INT_FLAG(PB, BIT15); // Clear GPIO interrupt flag
-    STOP_PLAYING = true;
-    DEBUG_PRINTF("int1\n");
+    event_queue_push(&stop_events, EV_STOP, 0, ui_timestamp());
+    TRACE(EINT1, 0, 0);
 }
 
 void Init_EXTINT(void)
@@ -152,16 +438,26 @@ void Init_EXTINT(void)
 /* -------------------- */
 /**
  * @brief IRQ handler for timer 0
- * @details Counting time, like how long the audio played, or the 7seg effect
+ * @details Counting time for the level meter, or the 7seg effect.
+ *          Also sends a slice of the submitted LCD frame every tick, unless the play loop sends it
+ * @note The playing time comes from the frames the I2S has sent, see play_clock_frames()
  */
 void TMR0_IRQHandler(void)
 {
     TIMER_ClearIntFlag(TIMER0); // Clear Timer0 time-out interrupt flag
+    sys_tick += 1;
+    if (!mlh_lcd_flush_polled) mlh_step_flush_lcd(MLH_LCD_FLUSH_BUDGET);
+    if (sys_tick % UI_STATS_TICKS == 0) {
+        ui_update_stats();
+        event_queue_push(&timer_events, EV_TICK, 0, ui_timestamp());
+    }
     if (start_count) {
         cnt_5ms += 1;
 
-        if (cnt_5ms % 200 == 0) {
-            mlh_number_to_seg_buf(cnt_5ms / 200, false);
+        // The play loop has a task for it
+        if (!play_tasks_running && cnt_5ms % METER_UPDATE_TICKS == 0) {
+            level_meter_update(&meter);
+            show_meter();
         }
     }
     else if (seg_effect) {
@@ -177,129 +473,16 @@ void TMR0_IRQHandler(void)
 void Init_Timer0(void)
 {
     TIMER_Open(TIMER0, TMR0_OPERATING_MODE, TMR0_OPERATING_FREQ);
+    // Keep TDR updated, for the sub-tick timestamps of ui_timestamp()
+    TIMER0->TCSR |= TIMER_TCSR_TDR_EN_Msk;
     TIMER_EnableInt(TIMER0);
     NVIC_EnableIRQ(TMR0_IRQn);
+    // Below the I2S, so the LCD slices never delay the audio
+    NVIC_SetPriority(TMR0_IRQn, 2);
     TIMER_Start(TIMER0);
 }
 
 
-/* -------------------- */
-// I2S IRQ handler, to send data to WAU8822
-/* -------------------- */
-/**
- * @brief IRQ handler for I2S
- * @details send and recieve data to or from I2S, in modes like audio player, playback .etc
- */
-void I2S_IRQHandler(void)
-{
-    uint32_t u32status;
-    uint32_t u32data;
-    // uint16_t u16data;
-    uint32_t i;
-    u32status = I2S_GET_INT_FLAG(I2S, I2S_STATUS_TXTHF_Msk | I2S_STATUS_RXTHF_Msk);
-
-    // I2S TX threshold interrupt
-    if (u32status & I2S_STATUS_TXTHF_Msk) {
-        // Mode audio play
-        if (pgm_state == P_MODE_AUDIO_PLAY) {
-            for (i = 0; i < 4; ++i) {
-                // Prepare data from 16 bit to 32 bit
-                if (wav_header.num_of_channels == 1) {
-                    u32data = (pcm_buffer[pcm_buffer_idx] << 16) | pcm_buffer[pcm_buffer_idx];
-                    pcm_buffer_idx += 1;
-                    wav_header.data_chunk_size -= 2;
-                } else if (wav_header.num_of_channels == 2) {
-                    // FIXME: I'm not sure if it's wrong
-                    if (wav_header.block_align == 4) {
-                        u32data = pcm_buffer[pcm_buffer_idx] << 16 | pcm_buffer[pcm_buffer_idx + 1];
-                        pcm_buffer_idx += 2;
-                        wav_header.data_chunk_size -= 4;
-                    }
-                }
-
-                // Send sound data
-                I2S_WRITE_TX_FIFO(I2S, u32data);
-
-                // Check end of the song
-                if (wav_header.data_chunk_size == 0) {
-                    I2S_DisableInt(I2S, I2S_IE_TXTHIE_Msk | I2S_IE_RXTHIE_Msk);
-                    return;
-                }
-            }
-
-            // Check if buffer needs refill sound data
-            if (pcm_buffer_idx >= PCM_BUFF_SIZE) {
-                pcm_buffer_needs_refill = true;
-                I2S_DisableInt(I2S, I2S_IE_TXTHIE_Msk | I2S_IE_RXTHIE_Msk);
-            }
-        }
-
-        // Mode playback
-        // From https://github.com/OpenNuvoton/NUC472_442BSP/blob/master/SampleCode/StdDriver/I2S_NAU8822/nuc472_442_isr.c
-        else if (pgm_state == P_MODE_PLAYBACK) {
-            uint32_t u32Len;
-            uint16_t *pBuffTx = &pcm_buffer[0];
-            // Read Tx FIFO free size
-            u32Len = 8 - I2S_GET_TX_FIFO_LEVEL(I2S);
-
-            if (pcm_buffer_idx >= 8) {
-                for (i = 0; i < u32Len; ++i) {
-                    u32data = (pBuffTx[i] << 16) | pBuffTx[i];
-                    I2S_WRITE_TX_FIFO(I2S, u32data);
-                    DEBUG_PRINTF("dt:%d\n", u32data);
-                }
-
-                for (i = 0; i < PCM_BUFF_SIZE - u32Len; ++i) {
-                    pBuffTx[i] = pBuffTx[i + u32Len];
-                }
-
-                pcm_buffer_idx -= u32Len;
-            DEBUG_PRINTF("\nT%8x\n", pcm_buffer_idx);
-            } else {
-                for (i = 0; i < u32Len; i++) {
-                    I2S_WRITE_TX_FIFO(I2S, 0x00000000);
-                }
-            // I2S_DisableInt(I2S, I2S_IE_TXTHIE_Msk);
-            }
-        }
-    }
-
-    // I2S RX threshold interrupt
-    if (u32status & I2S_STATUS_RXTHF_Msk) {
-        if (pgm_state == P_MODE_PLAYBACK) {
-            uint32_t u32Len;
-            uint16_t *pBuffRx = &pcm_buffer[pcm_buffer_idx];
-
-            if (pcm_buffer_idx < (PCM_BUFF_SIZE - 8)) {
-                /* Read Rx FIFO Level */
-                u32Len = I2S_GET_RX_FIFO_LEVEL(I2S);
-
-                for (i = 0; i < u32Len; i++) {
-                    pBuffRx[i] = I2S_READ_RX_FIFO(I2S) & 0x0000FFFF;
-                    DEBUG_PRINTF("R:%8x\n", pBuffRx[i]);
-                }
-
-                pcm_buffer_idx += u32Len;
-            DEBUG_PRINTF("\nR%d\n", pcm_buffer_idx);
-
-                if (pcm_buffer_idx >= PCM_BUFF_SIZE) {
-                    pcm_buffer_idx = 0;
-                    DEBUG_PRINTF("x\n");
-                }
-            } else {
-            // I2S_DisableInt(I2S, I2S_IE_RXTHIE_Msk);
-            }
-        }
-    }
-
-    // Quit song
-    if (STOP_PLAYING) {
-        I2S_DisableInt(I2S, I2S_IE_TXTHIE_Msk | I2S_IE_RXTHIE_Msk);
-        return;
-    }
-}
-
-
 /* -------------------- */
 // Main function
 /* -------------------- */
@@ -307,13 +490,24 @@ int main(void)
 {
     int16_t i = 0;
 
+    // First, the stack used from here on is measured
+    mem_stat_init(MEM_STAT_STACK_BASE, MEM_STAT_STACK_SIZE);
     SYS_Init();
+    clock_gov_init();
+    prof_init();
+    // Before the interrupts that post to the queues
+    init_events();
+    // Timer 0 counts at HXT, see ui_timestamp()
+    trace_init(ui_timestamp, __HXT);
+    arena_init(&mode_arena, mode_arena_buf, sizeof(mode_arena_buf));
 
     // Init perhepherial hardwares
     mlh_init_GPIO_for_led();
     mlh_init_7seg();
     mlh_init_keypad_INT();
     mlh_init_lcd();
+    // For the profiler dump
+    mlh_init_uart();
 
     Init_EXTINT();
     Init_Timer0();
@@ -324,6 +518,7 @@ int main(void)
 
     // 7seg effect
     mlh_regist_new_pattern_to_SEG_BUF(17, mlh_pattern_to_7seg_pattern(0xFD));
+    mlh_regist_new_pattern_to_SEG_BUF(SEG_PATTERN_MINUS, SEG_NEGATIVE);
     seg_effect = true;
 
     // State machine
@@ -350,10 +545,13 @@ int main(void)
 
             case P_MODE_AUDIO_PLAY:
                 pgm_audio_play();
+                // Leaving the mode frees its buffers
+                arena_reset(&mode_arena);
                 break;
 
             case P_MODE_PLAYBACK:
                 pgm_audio_playback();
+                arena_reset(&mode_arena);
                 break;
 
             case P_MODE_AUDIO_RECORDER:
@@ -376,12 +574,15 @@ int main(void)
 /**
  * @brief Initialize I2C, WAU8822, I2S
  * @param sample_rate Sample rate of the audio, to config WAU8822
+ * @param num_of_channels 1 to run the I2S in mono, each FIFO word then carries two samples
+ * @param power Codec blocks to power up for the mode
  */
-void init_audio_stuff(uint32_t sample_rate)
+void init_audio_stuff(uint32_t sample_rate, uint16_t num_of_channels, WAU8822_Power_t power)
 {
-    uint32_t real_sample_rate;
+    uint32_t real_sample_rate, start;
     // Prevent compiler warning
     (void)real_sample_rate;
+    (void)start;
 
     // I2S FS(LRCLK) and BCLK
     GPIO_SetMode(PC, (BIT0 | BIT1), GPIO_MODE_QUASI);
@@ -391,23 +592,45 @@ void init_audio_stuff(uint32_t sample_rate)
     // Init I2C0 to access WAU8822
     Init_I2C();
 
-    // Initialize WAU8822 codec
-    WAU8822_Setup();
+    // Reset and configure the codec only the first time, after that it keeps its registers in standby
+    if (!WAU8822_IsSetUp()) {
+        start = ui_timestamp();
+        WAU8822_Setup();
+        DEBUG_PRINTF("Codec setup: %d us\n", ui_counts_to_us(ui_timestamp() - start));
+    }
+
+    // Config sample rate to match the wav file, the PLL and dividers are solved for the rate
+    real_sample_rate = WAU8822_ConfigSampleRate(sample_rate);
+    DEBUG_PRINTF("Real codec sample rate: %d\n", real_sample_rate);
+    if (real_sample_rate == 0) {
+        // No clock for this rate, the song ends at once like a format that can't be played
+        DEBUG_PRINTF("[WARN] The codec can't run at %d Hz\n", sample_rate);
+        i2s_tx_handler = i2s_tx_play_unsupported;
+        real_sample_rate = PLAYBACK_SAMPLE_RATE;
+    }
 
-    // Config sample rate to match the wav file
-    WAU8822_ConfigSampleRate(sample_rate);
+    // Tone shaping on the codec, costs no CPU time per sample
+    WAU8822_ApplyTonePreset(tone_preset);
+    // Mono comes in one channel slot of the I2S, the DAC cross mix set by WAU8822_Setup() sends it to both outputs
+    // Software filter for the rest, designed for the rate the codec actually runs at
+    init_sw_filter(real_sample_rate);
+    init_visualizer(real_sample_rate);
 
     // select source from HXT(12MHz)
     CLK_SetModuleClock(I2S_MODULE, CLK_CLKSEL2_I2S_S_HXT, 0);
     CLK_EnableModuleClock(I2S_MODULE);
 
     // Sample rate config in I2S doesn't matter, because I2S is in slave mode
-    real_sample_rate = I2S_Open(I2S, I2S_MODE_SLAVE, 8000, I2S_DATABIT_16, I2S_STEREO, I2S_FORMAT_I2S);
+    real_sample_rate = I2S_Open(I2S, I2S_MODE_SLAVE, 8000, I2S_DATABIT_16, (num_of_channels == 1) ? I2S_MONO : I2S_STEREO, I2S_FORMAT_I2S);
     DEBUG_PRINTF("Real I2S sample rate: %d\n", real_sample_rate);
 
     // Set MCLK and enable MCLK
     I2S_EnableMCLK(I2S, 12000000);
 
+    // Power up the blocks of the mode, with MCLK running so the PLL of the codec locks
+    start = ui_timestamp();
+    WAU8822_SetPowerProfile(power);
+    DEBUG_PRINTF("Codec power up: %d us\n", ui_counts_to_us(ui_timestamp() - start));
 
     NVIC_EnableIRQ(I2S_IRQn);
     NVIC_SetPriority(I2S_IRQn, 1);
@@ -422,6 +645,9 @@ void init_audio_stuff(uint32_t sample_rate)
 void init_sdcard_stuff(void)
 {
     WORD rc;
+    // A whole sector, only while the card starts
+    uint32_t mark = arena_mark(&mode_arena);
+    BYTE *sector = ARENA_NEW(&mode_arena, BYTE, FF_MAX_SS);
 
     rc = (WORD)disk_initialize(0);
 
@@ -429,7 +655,8 @@ void init_sdcard_stuff(void)
     (void)rc;
 
     DEBUG_PRINTF("rc=%d\n", rc);
-    disk_read(0, ff_buff, 2, 1);
+    if (sector != NULL) disk_read(0, sector, 2, 1);
+    arena_release(&mode_arena, mark);
     f_mount(&FatFs[0], (TCHAR*)mount_path, 1);
 }
 
@@ -506,6 +733,13 @@ void open_wav_file(FIL *fp, const char *file_path, wav_header_t *header)
         DEBUG_PRINTF("bits_per_sample: %d\n", wav_header.bits_per_sample);
         DEBUG_PRINTF("data_chunk_id: %x\n", wav_header.data_chunk_id);
         DEBUG_PRINTF("Data Chunk Found (data size): Size %u bytes\n", wav_header.data_chunk_size);
+
+        res = wav_seek_open(&wav_seek, fp, tmp_ptr - wav_header_data, wav_header.data_chunk_size, wav_header.block_align, wav_clmt, SEEK_CLMT_LEN);
+        DEBUG_PRINTF("Fast seek: %s (%d fragments)\n", wav_seek.fast_seek ? "on" : "off", (wav_clmt[0] - 2) / 2);
+        (void)res;
+
+        // The sample path for this format, bound once here instead of checked for every sample
+        i2s_bind_play(wav_header.num_of_channels, wav_header.bits_per_sample);
     }
     DEBUG_PRINTF("[INFO] Wav header successfully parsed\n");
 }
@@ -521,38 +755,1005 @@ void close_wav_file(FIL *fp)
 
 /**
  * @brief Start to play the song after opening the file and config the WAU8822
+ * @details The play loop is a set of cooperative tasks, see init_play_tasks(). It sleeps when none has work to do
  * @param fp File pointer, to the wav file
  */
 void start_play(FIL *fp)
 {
+    uint32_t sleep_start, permille;
+    // Prevent compiler warning, only printed
+    (void)permille;
     // Move to start of the sound data
-    f_lseek(fp, 44);
+    wav_seek_to_frame(&wav_seek, fp, 0);
+    i2s_frames_left = wav_seek.total_frames;
+    // Left over from the last song
+    event_queue_clear(&i2s_events);
+    I2S_CLR_INT_FLAG(I2S, I2S_STATUS_TXUDF_Msk);
     pcm_buffer_needs_refill = true;
+
+    play_fp = fp;
+    play_quit = false;
+    play_key_held = 0;
+    play_seek_pending = false;
+    play_now_playing_pending = false;
+    play_seg_sec = 0;
+    play_lcd_sec = 0;
+    play_meter_tick = sys_tick + METER_UPDATE_TICKS;
+    // After the last words of the buffer, the FIFO holds its threshold and the words just written
+    play_refill_slack = 2 * I2S_TX_WORDS_PER_INT * ((wav_header.num_of_channels == 1) ? 2 : 1) *
+                        TMR0_OPERATING_FREQ * TIMER0->TCMPR / play_sample_rate;
+    init_play_tasks();
+#if (TRACE_TO_FILE == 1)
+    trace_fp_open = (f_open(&trace_fp, TRACE_FILE_PATH, FA_WRITE | FA_OPEN_APPEND) == FR_OK);
+#endif
+    // The LCD flush is a task now, timer 0 leaves it alone
+    mlh_lcd_flush_polled = true;
+    play_tasks_running = true;
+    play_duty_start();
+    hclk_window_start();
     // I2S_ENABLE_TX(I2S);
 
     // Start I2S play iteration
-    while (1) {
-        // Check if needs refill sound data
-        if (pcm_buffer_needs_refill) {
-            f_read(fp, pcm_buffer, PCM_BUFF_SIZE * sizeof(pcm_buffer[0]), &pcm_buffer_idx);
-            pcm_buffer_idx = 0;
-            pcm_buffer_needs_refill = false;
-            I2S_EnableInt(I2S, I2S_IE_TXTHIE_Msk | I2S_IE_RXTHIE_Msk);
+    while (!play_quit) {
+        if (sched_dispatch(&play_sched)) continue;
+
+        // Nothing to do until the next I2S, key or timer interrupt
+        // With PRIMASK set, an interrupt that comes after the check still wakes the WFI
+        // Power-down would stop the HXT, and with it the MCLK of the codec, so only sleep here
+        __disable_irq();
+        if (!sched_ready(&play_sched)) {
+            sleep_start = ui_timestamp();
+            __WFI();
+            // Before the interrupt that woke it up runs, so the time of the handler counts as awake
+            play_sleep_counts += ui_timestamp() - sleep_start;
         }
+        __enable_irq();
+    }
+
+    // Quit when the song ends, or by INT1
+    I2S_DisableInt(I2S, I2S_IE_TXTHIE_Msk | I2S_IE_RXTHIE_Msk);
+    play_tasks_running = false;
+    mlh_lcd_flush_polled = false;
+    permille = play_duty_permille();
+    DEBUG_PRINTF("[INFO] %d Hz, %d ch, %d bits: awake %d.%d%% of %d s, ended at %d MHz\n", wav_header.sample_rate,
+                 wav_header.num_of_channels, wav_header.bits_per_sample, permille / 10, permille % 10,
+                 (sys_tick - play_duty_start_tick) / TMR0_OPERATING_FREQ, clock_gov_hclk() / 1000000);
+    print_play_task_stats();
+#if (TRACE_TO_FILE == 1)
+    // What is left of the song, the records after this wait for the next song
+    while (trace_drain(trace_sink, TRACE_DRAIN_BYTES) > 0);
+    if (trace_fp_open) f_close(&trace_fp);
+    trace_fp_open = false;
+#endif
+    // I2S_DISABLE_TX(I2S);
+    if (play_paused) play_pause(false);
+}
+
+/**
+ * @brief Set up the tasks of the play loop, highest priority first, see Play_Task
+ * @details The refill goes first, and with the deadline i2s_tx_play_done() gives it, before anything else.
+ *          The others do a bounded amount of work per step, so the refill waits at most one step
+ */
+void init_play_tasks(void)
+{
+    play_tasks[PLAY_TASK_REFILL].name = "refill";
+    play_tasks[PLAY_TASK_REFILL].run = play_task_refill;
+    play_tasks[PLAY_TASK_REFILL].ready = play_task_refill_ready;
+    play_tasks[PLAY_TASK_INPUT].name = "input";
+    play_tasks[PLAY_TASK_INPUT].run = play_task_input;
+    play_tasks[PLAY_TASK_INPUT].ready = play_task_input_ready;
+    play_tasks[PLAY_TASK_METER].name = "meter";
+    play_tasks[PLAY_TASK_METER].run = play_task_meter;
+    play_tasks[PLAY_TASK_METER].ready = play_task_meter_ready;
+    play_tasks[PLAY_TASK_LCD_FLUSH].name = "lcd";
+    play_tasks[PLAY_TASK_LCD_FLUSH].run = play_task_lcd_flush;
+    play_tasks[PLAY_TASK_LCD_FLUSH].ready = play_task_lcd_flush_ready;
+    play_tasks[PLAY_TASK_UI].name = "ui";
+    play_tasks[PLAY_TASK_UI].run = play_task_ui;
+    play_tasks[PLAY_TASK_UI].ready = play_task_ui_ready;
+    play_tasks[PLAY_TASK_TRACE].name = "trace";
+    play_tasks[PLAY_TASK_TRACE].run = play_task_trace;
+    play_tasks[PLAY_TASK_TRACE].ready = play_task_trace_ready;
+    sched_init(&play_sched, play_tasks, PLAY_TASK_NUM, ui_timestamp);
+}
+
+bool play_task_refill_ready(void)
+{
+    return pcm_buffer_needs_refill || event_queue_count(&i2s_events) > 0;
+}
 
-        // Break loop when song ends
-        if (wav_header.data_chunk_size == 0) {
-            I2S_DisableInt(I2S, I2S_IE_TXTHIE_Msk | I2S_IE_RXTHIE_Msk);
-            // I2S_DISABLE_TX(I2S);
+/**
+ * @brief Gives the refill task its deadline, called by the I2S IRQ handler when it posts EV_REFILL
+ * @details The refill has until the FIFO runs empty
+ */
+void play_refill_requested(void)
+{
+    if (play_tasks_running) sched_set_deadline(&play_tasks[PLAY_TASK_REFILL], ui_timestamp() + play_refill_slack);
+}
+
+/**
+ * @brief Task of the I2S events and the PCM buffer
+ */
+uint8_t play_task_refill(sched_task_t *t)
+{
+    event_t e;
+    uint32_t prof_start, read_start;
+
+    SCHED_BEGIN(t);
+    // A refill asked for in between is still done in this step
+    while (event_queue_pop(&i2s_events, &e)) {
+        switch (e.type) {
+        case EV_REFILL:
+            pcm_buffer_needs_refill = true;
             break;
+        case EV_UNDERRUN:
+            DEBUG_PRINTF("[WARN] I2S underrun at %d MHz\n", clock_gov_hclk() / 1000000);
+            // Measured again from the top
+            hclk_set_point(HCLK_PLAY_POINT);
+            hclk_window_start();
+            break;
+        case EV_SONG_END:
+            play_quit = true;
+            break;
+        }
+    }
+
+    // Check if needs refill sound data
+    if (pcm_buffer_needs_refill && !play_quit) {
+        prof_start = PROF_START();
+        read_start = ui_timestamp();
+        f_read(play_fp, pcm_buffer, pcm_buffer_len * sizeof(pcm_buffer[0]), &pcm_buffer_idx);
+        PROF_STOP(PROF_REFILL_READ, prof_start);
+        TRACE(REFILL_DONE, pcm_buffer_idx, ui_timestamp() - read_start);
+        apply_sw_filter(pcm_buffer, pcm_buffer_idx / sizeof(pcm_buffer[0]), wav_header.num_of_channels);
+        if (vis_enabled) {
+            tap_visualizer(pcm_buffer, pcm_buffer_idx / sizeof(pcm_buffer[0]), wav_header.num_of_channels);
+        }
+        pcm_buffer_idx = 0;
+        pcm_buffer_needs_refill = false;
+        if (play_seek_pending) {
+            // The FIFO ran empty during the seek on purpose, not an underrun
+            I2S_CLR_INT_FLAG(I2S, I2S_STATUS_TXUDF_Msk);
+        }
+        // When paused, the buffer waits for the resume
+        if (!play_paused) I2S_EnableInt(I2S, I2S_IE_TXTHIE_Msk | I2S_IE_RXTHIE_Msk);
+        if (play_seek_pending) {
+            // From the key to the samples of the new position in the I2S
+            DEBUG_PRINTF("seek: %d us\n", ui_counts_to_us(ui_timestamp() - play_seek_start));
+            play_seek_pending = false;
         }
+    }
+    SCHED_END(t);
+}
+
+bool play_task_input_ready(void)
+{
+    uint8_t i;
 
-        if (STOP_PLAYING) {
-            I2S_DisableInt(I2S, I2S_IE_TXTHIE_Msk | I2S_IE_RXTHIE_Msk);
-            // I2S_DISABLE_TX(I2S);
+    for (i = 0; i < PLAY_INPUT_QUEUE_NUM; ++i) {
+        if (event_queue_count(play_input_queues[i]) > 0) return true;
+    }
+    // Scan while the key is held
+    return (play_key_held == 4 || play_key_held == 6) && (int32_t)(sys_tick - play_scan_tick) >= 0;
+}
+
+/**
+ * @brief Task of the keys, INT1 and the timer events, yields after each event so a refill can go in between
+ */
+uint8_t play_task_input(sched_task_t *t)
+{
+    event_t e;
+    bool resume;
+
+    SCHED_BEGIN(t);
+    while (ui_poll_queues(play_input_queues, PLAY_INPUT_QUEUE_NUM, &e)) {
+        switch (e.type) {
+        case EV_TICK:
+            hclk_govern();
+            break;
+        case EV_STOP:
+            play_quit = true;
+            break;
+        case EV_KEY_UP:
+            play_key_held = 0;
             break;
+        case EV_KEY_DOWN:
+            play_key_held = e.arg;
+            // Seek, resume and the visualizer all take more cycles, so the governor starts from the top again
+            hclk_set_point(HCLK_PLAY_POINT);
+            hclk_window_start();
+            if (e.arg == 4 || e.arg == 6 || e.arg == 1 || e.arg == 3) {
+                // Measured from the key interrupt
+                play_seek_start = e.time;
+                play_seek_pending = true;
+                if (e.arg == 4) play_seek(play_fp, -SEEK_SHORT_SEC);
+                else if (e.arg == 6) play_seek(play_fp, SEEK_SHORT_SEC);
+                else if (e.arg == 1) play_seek(play_fp, -SEEK_LONG_SEC);
+                else play_seek(play_fp, SEEK_LONG_SEC);
+                play_scan_tick = sys_tick + SEEK_SCAN_DELAY_TICKS;
+            } else if (e.arg == 5) {
+                play_pause(!play_paused);
+                // Redraw the state on the LCD
+                play_lcd_sec = UINT32_MAX;
+            } else if (e.arg == 8) {
+                // Change tone while playing, only the changed codec registers are written
+                next_tone_preset(true);
+            } else if (e.arg == 9) {
+                vis_enabled = !vis_enabled;
+                play_now_playing_pending = !vis_enabled;
+            } else if (e.arg == 7) {
+                // Toggle the 7seg between playing time and dB readout
+                meter_show_db = !meter_show_db;
+                if (!meter_show_db) seg_play_time(play_seg_sec);
+            } else if (e.arg == 2) {
+                // Profiler dump over UART, the UART waits for every byte, so the song is paused meanwhile
+                resume = !play_paused;
+                if (resume) play_pause(true);
+                prof_dump(mlh_write_format_text_uart);
+                prof_reset();
+                if (resume) play_pause(false);
+            }
+            break;
+        }
+        if (play_quit) break;
+        SCHED_YIELD(t);
+    }
+
+    // Scan while the key is held
+    if ((play_key_held == 4 || play_key_held == 6) && (int32_t)(sys_tick - play_scan_tick) >= 0 && !play_quit) {
+        play_seek(play_fp, (play_key_held == 4) ? -SEEK_SCAN_SEC : SEEK_SCAN_SEC);
+        play_scan_tick = sys_tick + SEEK_SCAN_TICKS;
+    }
+    SCHED_END(t);
+}
+
+bool play_task_meter_ready(void)
+{
+    return (int32_t)(sys_tick - play_meter_tick) >= 0;
+}
+
+/**
+ * @brief Task of the level meter, in the main loop so timer 0 stays short while playing
+ */
+uint8_t play_task_meter(sched_task_t *t)
+{
+    SCHED_BEGIN(t);
+    play_meter_tick += METER_UPDATE_TICKS;
+    // Behind after a long step, like opening the now playing screen, skip the missed updates
+    if ((int32_t)(sys_tick - play_meter_tick) >= 0) play_meter_tick = sys_tick + METER_UPDATE_TICKS;
+    level_meter_update(&meter);
+    show_meter();
+    SCHED_END(t);
+}
+
+bool play_task_lcd_flush_ready(void)
+{
+    return !mlh_lcd_frame_done;
+}
+
+/**
+ * @brief Task of the LCD flush, sends MLH_LCD_FLUSH_BUDGET bytes of the submitted frame per step
+ */
+uint8_t play_task_lcd_flush(sched_task_t *t)
+{
+    SCHED_BEGIN(t);
+    while (!mlh_lcd_frame_done) {
+        mlh_step_flush_lcd(MLH_LCD_FLUSH_BUDGET);
+        SCHED_YIELD(t);
+    }
+    SCHED_END(t);
+}
+
+bool play_task_ui_ready(void)
+{
+    uint32_t sec;
+
+    if (vis_enabled && vis_tap_idx >= VIS_FFT_LEN) return true;
+    if (play_now_playing_pending && mlh_lcd_frame_done) return true;
+    sec = play_clock_elapsed_sec();
+    if (sec != play_seg_sec) return true;
+    return sec != play_lcd_sec && !vis_enabled && !play_now_playing_pending && mlh_lcd_frame_done;
+}
+
+/**
+ * @brief Task of the screens, yields between the spectrum analyzer and the rest
+ */
+uint8_t play_task_ui(sched_task_t *t)
+{
+    uint32_t sec;
+
+    SCHED_BEGIN(t);
+    // Spectrum analyzer, only when the refill is done, so the audio always wins
+    if (vis_enabled && !pcm_buffer_needs_refill) {
+        step_visualizer();
+        SCHED_YIELD(t);
+    }
+    // Never wait for the LCD here, a frame takes longer than the PCM buffer lasts
+    if (play_now_playing_pending && mlh_lcd_frame_done) {
+        show_now_playing();
+        play_now_playing_pending = false;
+        play_lcd_sec = play_clock_elapsed_sec();
+    }
+
+    // Playing time, redrawn when the second changes
+    sec = play_clock_elapsed_sec();
+    if (sec != play_seg_sec) {
+        play_seg_sec = sec;
+        if (!meter_show_db) seg_play_time(sec);
+    }
+    if (sec != play_lcd_sec && !vis_enabled && !play_now_playing_pending && mlh_lcd_frame_done) {
+        play_lcd_sec = sec;
+        show_play_status();
+    }
+    SCHED_END(t);
+}
+
+bool play_task_trace_ready(void)
+{
+    return trace_pending() && trace_sink_ready();
+}
+
+/**
+ * @brief Task of the event trace, sends TRACE_DRAIN_BYTES of it per step, what the sink takes without waiting
+ */
+uint8_t play_task_trace(sched_task_t *t)
+{
+    SCHED_BEGIN(t);
+    trace_drain(trace_sink, TRACE_DRAIN_BYTES);
+    SCHED_END(t);
+}
+
+/**
+ * @brief Checks if the sink of the event trace can take a byte now
+ */
+bool trace_sink_ready(void)
+{
+#if (TRACE_TO_FILE == 1)
+    return trace_fp_open;
+#else
+    return !UART_IS_TX_FULL(UART0);
+#endif
+}
+
+/**
+ * @brief Sink of the event trace, never waits
+ * @details To UART0, as many bytes as its TX FIFO has room for, the same UART as the profiler dump,
+ *          the decoder skips the text. Or to the trace file, only while a song plays, see start_play()
+ * @param data Bytes of the trace
+ * @param len Number of bytes
+ * @return Bytes taken, 0 when it can't take any now
+ */
+uint32_t trace_sink(const uint8_t *data, uint32_t len)
+{
+    uint32_t n = 0;
+
+#if (TRACE_TO_FILE == 1)
+    UINT bw;
+
+    if (!trace_fp_open) return 0;
+    if (f_write(&trace_fp, data, len, &bw) != FR_OK) return 0;
+    n = bw;
+#else
+    while (n < len && !UART_IS_TX_FULL(UART0)) {
+        UART_WRITE(UART0, data[n]);
+        n += 1;
+    }
+#endif
+    return n;
+}
+
+/**
+ * @brief Prints the run time of each task of the play loop, and the deadlines missed
+ */
+void print_play_task_stats(void)
+{
+    uint8_t i;
+    sched_task_t *t;
+    // Timer 0 counts of the song, the same clock as the tasks
+    uint64_t total = (uint64_t)(sys_tick - play_duty_start_tick) * TIMER0->TCMPR;
+    uint32_t permille;
+    // Prevent compiler warning, only printed
+    (void)permille;
+
+    if (total == 0) return;
+    for (i = 0; i < PLAY_TASK_NUM; ++i) {
+        t = &play_tasks[i];
+        permille = t->time * 1000 / total;
+        DEBUG_PRINTF("task %s: %d runs, %d.%d%% cpu, max %d us, %d deadlines missed\n", t->name, t->runs,
+                     permille / 10, permille % 10, ui_counts_to_us(t->max_time), t->misses);
+    }
+}
+
+/**
+ * @brief Switch to the next tone preset, the preset number is shown on the leftmost 7seg
+ * @param apply Also program the codec, only when the codec is powered up
+ */
+void next_tone_preset(bool apply)
+{
+    tone_preset = (WAU8822_TonePreset_t)((tone_preset + 1) % WAU8822_TONE_PRESET_NUM);
+    mlh_set_7seg_buf(3, tone_preset);
+    if (apply) {
+        WAU8822_ApplyTonePreset(tone_preset);
+    }
+}
+
+/**
+ * @brief Design the software filter for the sample rate
+ * @param sample_rate The sample rate
+ */
+void init_sw_filter(uint32_t sample_rate)
+{
+#if (SW_FILTER_ENABLE == 1)
+    uint8_t status;
+    status  = dsp_biquad_design_q15(DSP_BIQUAD_HIGHPASS_1ST, sample_rate, SW_FILTER_HPF_FREQ, 0.707f, 0.0f, 1, &sw_filter_coeffs[0]);
+    status |= dsp_biquad_design_q15(DSP_BIQUAD_PEAKING, sample_rate, SW_FILTER_PEAK_FREQ, SW_FILTER_PEAK_Q, SW_FILTER_PEAK_GAIN, 1, &sw_filter_coeffs[6]);
+    if (status != 0) {
+        DEBUG_PRINTF("[WARN] Software filter coefficients out of range\n");
+    }
+    dsp_biquad_cascade_df1_init_q15(&sw_filter[0], SW_FILTER_STAGES, sw_filter_coeffs, sw_filter_state[0], 1);
+    dsp_biquad_cascade_df1_init_q15(&sw_filter[1], SW_FILTER_STAGES, sw_filter_coeffs, sw_filter_state[1], 1);
+#else
+    (void)sample_rate;
+#endif // (SW_FILTER_ENABLE == 1)
+}
+
+/**
+ * @brief Run the software filter on a block of samples, in place
+ * @param samples The samples, interleaved if stereo
+ * @param sample_count Number of samples of all channels
+ * @param num_of_channels 1 or 2
+ */
+void apply_sw_filter(uint16_t *samples, uint32_t sample_count, uint16_t num_of_channels)
+{
+#if (SW_FILTER_ENABLE == 1)
+    uint32_t prof_start = PROF_START();
+
+    if (num_of_channels == 2) {
+        dsp_biquad_cascade_df1_q15(&sw_filter[0], (dsp_q15_t*)samples,     (dsp_q15_t*)samples,     sample_count / 2, 2);
+        dsp_biquad_cascade_df1_q15(&sw_filter[1], (dsp_q15_t*)samples + 1, (dsp_q15_t*)samples + 1, sample_count / 2, 2);
+    } else {
+        dsp_biquad_cascade_df1_q15(&sw_filter[0], (dsp_q15_t*)samples, (dsp_q15_t*)samples, sample_count, 1);
+    }
+    PROF_STOP(PROF_SW_FILTER, prof_start);
+#else
+    (void)samples;
+    (void)sample_count;
+    (void)num_of_channels;
+#endif // (SW_FILTER_ENABLE == 1)
+}
+
+/**
+ * @brief Reset the spectrum analyzer, and set the decimation for the sample rate
+ * @param sample_rate The sample rate
+ */
+void init_visualizer(uint32_t sample_rate)
+{
+    vis_decimation = (sample_rate + VIS_TAP_RATE / 2) / VIS_TAP_RATE;
+    if (vis_decimation == 0) vis_decimation = 1;
+    vis_tap_idx = 0;
+    vis_decim_acc = 0;
+    vis_decim_cnt = 0;
+    memset(vis_bar, 0, sizeof(vis_bar));
+    memset(vis_peak, 0, sizeof(vis_peak));
+    memset(vis_peak_hold, 0, sizeof(vis_peak_hold));
+}
+
+/**
+ * @brief Take the decimated PCM into the FFT buffer, until it's full
+ * @param samples The samples, interleaved if stereo
+ * @param sample_count Number of samples of all channels
+ * @param num_of_channels 1 or 2
+ * @details Stereo is mixed to mono, and every vis_decimation frames are averaged (a cheap anti-alias filter)
+ */
+void tap_visualizer(const uint16_t *samples, uint32_t sample_count, uint16_t num_of_channels)
+{
+    uint32_t i;
+
+    for (i = 0; i + num_of_channels <= sample_count && vis_tap_idx < VIS_FFT_LEN; i += num_of_channels) {
+        vis_decim_acc += (int16_t)samples[i];
+        if (num_of_channels == 2) vis_decim_acc += (int16_t)samples[i + 1];
+        vis_decim_cnt += num_of_channels;
+        if (vis_decim_cnt >= vis_decimation * num_of_channels) {
+            vis_fft_buf[2 * vis_tap_idx]     = (dsp_q15_t)(vis_decim_acc / vis_decim_cnt);
+            vis_fft_buf[2 * vis_tap_idx + 1] = 0;
+            vis_tap_idx += 1;
+            vis_decim_acc = 0;
+            vis_decim_cnt = 0;
+        }
+    }
+}
+
+/**
+ * @brief Run one frame of the spectrum analyzer, if the tap is full and the frame is due
+ * @details FFT, log spaced bars with peak-hold, rendered into mlh_lcd_buffer
+ */
+void step_visualizer(void)
+{
+    static uint32_t last_tick = 0;
+    uint16_t b, k, level, height;
+    int16_t mag, max_mag;
+    dsp_q15_t *mags = vis_fft_buf;
+    uint32_t prof_start;
+
+    if (vis_tap_idx < VIS_FFT_LEN || (sys_tick - last_tick) < VIS_FRAME_TICKS) return;
+    last_tick = sys_tick;
+
+    prof_start = PROF_START();
+    dsp_cfft_radix2_q15(vis_fft_buf, VIS_FFT_LEN);
+    // Magnitudes overwrite the front of the same buffer
+    dsp_cmplx_mag_approx_q15(vis_fft_buf, mags, VIS_FFT_LEN / 2);
+    PROF_STOP(PROF_VIS_FFT, prof_start);
+
+    for (b = 0; b < VIS_BAR_NUM; ++b) {
+        max_mag = 0;
+        for (k = vis_band_edge[b]; k < vis_band_edge[b + 1]; ++k) {
+            if (mags[k] > max_mag) max_mag = mags[k];
+        }
+        // Log scale, 4 levels per octave: position of the highest bit and the 2 bits after it
+        level = 0;
+        mag = max_mag;
+        while (mag >= 8) {
+            mag >>= 1;
+            level += 4;
+        }
+        level += mag;
+        height = (level > 8) ? (level - 8) * LCD_Ymax / 48 : 0;
+        if (height > LCD_Ymax) height = LCD_Ymax;
+        vis_bar[b] = height;
+
+        // Peak-hold, then fall 2 pixels per frame
+        if (height >= vis_peak[b]) {
+            vis_peak[b] = height;
+            vis_peak_hold[b] = VIS_PEAK_HOLD_FRAMES;
+        } else if (vis_peak_hold[b] > 0) {
+            vis_peak_hold[b] -= 1;
+        } else {
+            vis_peak[b] = (vis_peak[b] > 2) ? vis_peak[b] - 2 : 0;
+        }
+    }
+
+    // Start collecting the next frame
+    vis_tap_idx = 0;
+
+    // Give the refill a chance before the slow part, and drop the frame if the last one is still being sent
+    if (pcm_buffer_needs_refill || event_queue_count(&i2s_events) > 0 || !mlh_lcd_frame_done) return;
+
+    ui_render_begin();
+    mlh_clear_lcd_buf();
+    for (b = 0; b < VIS_BAR_NUM; ++b) {
+        if (vis_bar[b] > 0) {
+            mlh_draw_rectangle_lcd_buf(b * (LCD_Xmax / VIS_BAR_NUM), LCD_Ymax - vis_bar[b], b * (LCD_Xmax / VIS_BAR_NUM) + VIS_BAR_WIDTH - 1, LCD_Ymax - 1, FG_COLOR, true);
+        }
+        if (vis_peak[b] > 0) {
+            mlh_draw_line_lcd_buf(b * (LCD_Xmax / VIS_BAR_NUM), LCD_Ymax - vis_peak[b], b * (LCD_Xmax / VIS_BAR_NUM) + VIS_BAR_WIDTH - 1, LCD_Ymax - vis_peak[b], FG_COLOR);
+        }
+    }
+    mlh_submit_lcd();
+    ui_render_end();
+}
+
+/**
+ * @brief Shows the level meter, peak on the LED bar, and dB on the 7seg if enabled
+ * @note Called from the timer 0 IRQ handler
+ */
+void show_meter(void)
+{
+    uint8_t i, db;
+
+    db = level_meter_to_db(meter.peak);
+    for (i = 0; i < 4; ++i) {
+        mlh_set_single_led(i, db <= meter_led_db[i]);
+    }
+
+    if (meter_show_db) {
+        if (db == 0) {
+            mlh_set_7seg_buf(2, 16);
+        } else {
+            mlh_set_7seg_buf(2, SEG_PATTERN_MINUS);
         }
+        mlh_set_7seg_buf(1, (db >= 10) ? db / 10 : 16);
+        mlh_set_7seg_buf(0, db % 10);
+    }
+}
+
+/**
+ * @brief Shows the playing song on the LCD
+ * @note Waits for the LCD frame in flight, check mlh_lcd_frame_done first while playing
+ */
+void show_now_playing(void)
+{
+    mlh_wait_flush_lcd();
+    ui_render_begin();
+    mlh_clear_lcd_buf();
+    ui_draw_now_playing(playing_file_name, play_paused, play_clock_elapsed_sec(), play_clock_remaining_sec());
+    mlh_submit_lcd();
+    ui_render_end();
+}
+
+/**
+ * @brief Redraws the state and the time on the now playing screen, only the changed characters are sent
+ * @note Doesn't wait for the LCD, check mlh_lcd_frame_done first
+ */
+void show_play_status(void)
+{
+    ui_render_begin();
+    ui_draw_play_status(play_paused, play_clock_elapsed_sec(), play_clock_remaining_sec());
+    mlh_submit_lcd();
+    ui_render_end();
+}
+
+/**
+ * @brief Jumps in the playing song, the PCM buffer is refilled from the new position by the play loop
+ * @details The I2S keeps running, only its interrupt is held until the refill, like a normal refill.
+ *          The new position snaps back to a sector boundary of the file, at most a sector of audio
+ * @param fp File pointer, to the wav file
+ * @param delta_sec Seconds to jump, negative to jump back
+ */
+void play_seek(FIL *fp, int32_t delta_sec)
+{
+    uint32_t frame;
+
+    I2S_DisableInt(I2S, I2S_IE_TXTHIE_Msk | I2S_IE_RXTHIE_Msk);
+    // A refill or the end of the song posted before, they were for the old position
+    event_queue_clear(&i2s_events);
+    frame = wav_seek_snap(&wav_seek, (int64_t)play_clock_frames() + (int64_t)delta_sec * play_sample_rate);
+    wav_seek_to_frame(&wav_seek, fp, frame);
+    // The I2S IRQ handler counts it down to find the end of the song
+    i2s_frames_left = wav_seek.total_frames - frame;
+    play_clock_seek(frame);
+    pcm_buffer_needs_refill = true;
+    TRACE(SEEK, frame, delta_sec);
+}
+
+/**
+ * @brief Pauses or resumes the song, without touching the codec, the buffer or the file
+ * @details Paused, the I2S keeps its clocks and sends zeros (TX mute), and its interrupt is held,
+ *          so nothing is read from the buffer and the playback clock stops.
+ *          Resuming unmutes and releases the interrupt, the threshold interrupt comes within a FIFO period.
+ *          If the buffer ran out before the pause, the play loop refills it first
+ * @param pause true to pause, false to resume
+ */
+void play_pause(bool pause)
+{
+    play_paused = pause;
+    TRACE(PAUSE, pause, 0);
+    if (pause) {
+        I2S_DisableInt(I2S, I2S_IE_TXTHIE_Msk | I2S_IE_RXTHIE_Msk);
+        I2S_ENABLE_TX_MUTE(I2S);
+    } else {
+        I2S_DISABLE_TX_MUTE(I2S);
+        // The FIFO may have run empty while muted, not an underrun
+        I2S_CLR_INT_FLAG(I2S, I2S_STATUS_TXUDF_Msk);
+        if (!pcm_buffer_needs_refill) I2S_EnableInt(I2S, I2S_IE_TXTHIE_Msk | I2S_IE_RXTHIE_Msk);
+    }
+}
+
+/**
+ * @brief Shows the playing time on the 7seg, as mmss
+ * @param sec Playing time in seconds
+ */
+void seg_play_time(uint32_t sec)
+{
+    mlh_number_to_seg_buf(sec / 60 % 100 * 100 + sec % 60, false);
+}
+
+/**
+ * @brief Starts the playback clock of a song
+ * @param total_frames Frames of the song, 0 if not known
+ * @param sample_rate Frames per second
+ */
+void play_clock_start(uint64_t total_frames, uint32_t sample_rate)
+{
+    play_total_frames = total_frames;
+    play_sample_rate = (sample_rate > 0) ? sample_rate : 1;
+    play_clock_seek(0);
+}
+
+/**
+ * @brief Frames the output has sent since the start of the song, or the last seek
+ * @return Position in frames
+ */
+uint64_t play_clock_frames(void)
+{
+    uint64_t frames;
+    // 64-bit is two loads on the Cortex-M0, the I2S IRQ must not come in between
+    __disable_irq();
+    frames = play_frames;
+    __enable_irq();
+    return frames;
+}
+
+/**
+ * @brief Moves the playback clock, when the song is seeked
+ * @param frame New position in frames, the caller moves the file to the same frame
+ */
+void play_clock_seek(uint64_t frame)
+{
+    __disable_irq();
+    play_frames = frame;
+    __enable_irq();
+}
+
+/**
+ * @brief Elapsed playing time
+ * @return Seconds
+ */
+uint32_t play_clock_elapsed_sec(void)
+{
+    return (uint32_t)(play_clock_frames() / play_sample_rate);
+}
+
+/**
+ * @brief Remaining playing time of the song
+ * @return Seconds, 0 if the length is not known
+ */
+uint32_t play_clock_remaining_sec(void)
+{
+    uint64_t frames = play_clock_frames();
+    if (frames >= play_total_frames) return 0;
+    // Rounded up, so it reaches 0 when the song ends
+    return (uint32_t)((play_total_frames - frames + play_sample_rate - 1) / play_sample_rate);
+}
+
+/**
+ * @brief Timestamp for measuring the UI, in timer 0 counts
+ * @details Timer 0 ticks times the compare value, plus the counter of the current tick.
+ *          Wraps around, only the difference of two timestamps is meaningful
+ * @note Also right with interrupts masked, or in a handler above timer 0, where the tick may be pending
+ */
+uint32_t ui_timestamp(void)
+{
+    uint32_t tick, count, pending;
+    // Read again if the tick changed in between
+    do {
+        tick = sys_tick;
+        // The counter before the flag, so a restart between the two reads is seen by the flag
+        count = TIMER0->TDR;
+        pending = TIMER_GetIntFlag(TIMER0);
+        // The count read may be from before the restart
+        if (pending) count = TIMER0->TDR;
+    } while (tick != sys_tick);
+    // The counter restarted, but the handler hasn't counted the tick yet
+    if (pending) tick += 1;
+    return tick * TIMER0->TCMPR + count;
+}
+
+/**
+ * @brief Converts timer 0 counts, like the difference of two ui_timestamp(), to microseconds
+ * @param counts Timer 0 counts
+ * @return Microseconds
+ * @note 64-bit, the product of the counts and the microseconds of a tick overflows 32 bits past about 71 ms
+ */
+uint32_t ui_counts_to_us(uint32_t counts)
+{
+    return (uint32_t)((uint64_t)counts * (1000000 / TMR0_OPERATING_FREQ) / TIMER0->TCMPR);
+}
+
+/**
+ * @brief Marks the start of a render, pair with ui_render_end()
+ */
+void ui_render_begin(void)
+{
+    ui_render_start = ui_timestamp();
+}
+
+/**
+ * @brief Marks the end of a render, and adds it to the statistics
+ */
+void ui_render_end(void)
+{
+    ui_render_time_total += ui_timestamp() - ui_render_start;
+    ui_render_total += 1;
+}
+
+/**
+ * @brief Renders per second and per mille CPU time in the UI, over the last UI_STATS_TICKS
+ * @note Called from the timer 0 IRQ handler
+ */
+void ui_update_stats(void)
+{
+    static uint32_t last_render_total = 0, last_render_time_total = 0;
+    uint32_t render_time = ui_render_time_total - last_render_time_total;
+
+    ui_renders_per_sec = (ui_render_total - last_render_total) * (TMR0_OPERATING_FREQ / UI_STATS_TICKS);
+    ui_busy_permille = render_time * (1000 / UI_STATS_TICKS) / TIMER0->TCMPR;
+    last_render_total = ui_render_total;
+    last_render_time_total = ui_render_time_total;
+}
+
+/**
+ * @brief Set up the event queues, before the interrupts are enabled
+ */
+void init_events(void)
+{
+    event_queue_init(&key_events, key_event_buf, EVENT_KEY_QUEUE_SIZE);
+    event_queue_init(&stop_events, stop_event_buf, EVENT_STOP_QUEUE_SIZE);
+    event_queue_init(&i2s_events, i2s_event_buf, EVENT_I2S_QUEUE_SIZE);
+    event_queue_init(&timer_events, timer_event_buf, EVENT_TIMER_QUEUE_SIZE);
+}
+
+/**
+ * @brief Posts a key change to the key queue
+ * @param key Key pressed, 0 when released
+ * @param key_last Key before the change
+ * @note Called from the keypad IRQ handler, see MLH_KEYPAD_EVENT
+ */
+void key_event(uint8_t key, uint8_t key_last)
+{
+    if (key != 0) {
+        event_queue_push(&key_events, EV_KEY_DOWN, key, ui_timestamp());
+        TRACE(KEY, key, 1);
+    } else {
+        event_queue_push(&key_events, EV_KEY_UP, key_last, ui_timestamp());
+        TRACE(KEY, key_last, 0);
+    }
+}
+
+/**
+ * @brief Checks if any event is waiting, call it with interrupts masked before sleeping
+ */
+bool event_pending(void)
+{
+    uint8_t i;
+    for (i = 0; i < EVENT_QUEUE_NUM; ++i) {
+        if (event_queue_count(event_queues[i]) > 0) return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Takes the oldest event of some of the queues, and prints the statistics on EV_TICK
+ * @param qs The queues
+ * @param n Number of queues
+ * @param e[out] The event
+ * @return false if there is no event
+ */
+bool ui_poll_queues(event_queue_t *const *qs, uint8_t n, event_t *e)
+{
+    if (!event_queue_pop_oldest(qs, n, e)) return false;
+    if (e->type == EV_TICK) {
+        DEBUG_PRINTF("ui: %d renders/s, %d.%d%% cpu, %d MHz\n", ui_renders_per_sec, ui_busy_permille / 10, ui_busy_permille % 10,
+                     clock_gov_hclk() / 1000000);
+        if (key_events.dropped > 0) DEBUG_PRINTF("[WARN] %d key events dropped\n", key_events.dropped);
+    }
+    return true;
+}
+
+/**
+ * @brief Takes the oldest event of all the queues, and prints the statistics on EV_TICK
+ * @param e[out] The event
+ * @return false if there is no event
+ */
+bool ui_poll_event(event_t *e)
+{
+    return ui_poll_queues(event_queues, EVENT_QUEUE_NUM, e);
+}
+
+/**
+ * @brief Sleeps until an event comes, and takes it
+ * @details Menus call this instead of spinning, so they only wake up on events
+ * @param e[out] The event
+ */
+void ui_wait_event(event_t *e)
+{
+    hclk_set_point(HCLK_MENU_POINT);
+    // With PRIMASK set, an interrupt that comes after the check still wakes the WFI
+    __disable_irq();
+    while (!event_pending()) {
+        if (trace_pending() && trace_sink_ready()) {
+            __enable_irq();
+            trace_drain(trace_sink, TRACE_DRAIN_BYTES);
+            __disable_irq();
+            continue;
+        }
+        __WFI();
+        __enable_irq();
+        __disable_irq();
+    }
+    __enable_irq();
+    ui_poll_event(e);
+
+    // Power down when the menu is left alone
+    if (e->type == EV_KEY_DOWN || e->type == EV_KEY_UP) {
+        ui_idle_sec = 0;
+    } else if (e->type == EV_TICK && ++ui_idle_sec >= POWER_DOWN_IDLE_SEC) {
+        ui_idle_sec = 0;
+        pgm_power_down();
+    }
+}
+
+/**
+ * @brief Powers down until a key or INT1, for the menus
+ * @details Only the LIRC keeps running, the keypad and EINT1 interrupts wake the chip up (their debounce runs on the LIRC).
+ *          The timers stop, so the LCD frame in flight is sent first, and the 7seg is turned off, or the digit
+ *          timer 3 was showing would stay lit. The key that wakes it up is dropped.
+ *          Not used while playing, the I2S MCLK of the codec comes from the HXT
+ */
+void pgm_power_down(void)
+{
+    mlh_wait_flush_lcd();
+    NVIC_DisableIRQ(TMR3_IRQn);
+    mlh_close_7seg();
+    DEBUG_PRINTF("Power down\n");
+
+    // With PRIMASK set, an interrupt that comes after the check still wakes it up
+    __disable_irq();
+    while (event_queue_count(&key_events) == 0 && event_queue_count(&stop_events) == 0) {
+        Enter_PowerDown();
+        Leave_PowerDown();
+        // CLK_PowerDown() leaves SLEEPDEEP set, the WFI of the loops should only sleep
+        SCB->SCR &= ~SCB_SCR_SLEEPDEEP_Msk;
+        __enable_irq();
+        __disable_irq();
+    }
+    __enable_irq();
+
+    event_queue_clear(&key_events);
+    NVIC_EnableIRQ(TMR3_IRQn);
+    DEBUG_PRINTF("Wake up\n");
+}
+
+/**
+ * @brief Starts measuring the awake duty cycle of the play loop
+ */
+void play_duty_start(void)
+{
+    play_sleep_counts = 0;
+    play_duty_start_tick = sys_tick;
+}
+
+/**
+ * @brief Time the CPU was awake since play_duty_start(), handlers included
+ * @return Per mille
+ */
+uint16_t play_duty_permille(void)
+{
+    uint64_t total = (uint64_t)(sys_tick - play_duty_start_tick) * TIMER0->TCMPR;
+    if (total == 0 || play_sleep_counts >= total) return 0;
+    return (uint16_t)(1000 - play_sleep_counts * 1000 / total);
+}
+
+/**
+ * @brief Switches HCLK, see clock_gov_set_point()
+ * @details Timer 0 sends the LCD frame in the background, it waits until the SPI3 clock is derived again
+ */
+void hclk_set_point(clock_gov_point_t point)
+{
+    if (point == clock_gov_point()) return;
+    NVIC_DisableIRQ(TMR0_IRQn);
+    clock_gov_set_point(point);
+    NVIC_EnableIRQ(TMR0_IRQn);
+}
+
+/**
+ * @brief Starts a new window for the HCLK governor
+ */
+void hclk_window_start(void)
+{
+    hclk_window_sleep = play_sleep_counts;
+    hclk_window_tick = sys_tick;
+}
+
+/**
+ * @brief Lets the HCLK governor pick the operating point for the awake time of the play loop since the last call
+ * @note Called on EV_TICK while playing
+ */
+void hclk_govern(void)
+{
+    uint64_t total = (uint64_t)(sys_tick - hclk_window_tick) * TIMER0->TCMPR;
+    uint64_t sleep = play_sleep_counts - hclk_window_sleep;
+    uint16_t awake;
+    clock_gov_point_t point = clock_gov_point();
+
+    if (total == 0) return;
+    awake = (sleep >= total) ? 0 : (uint16_t)(1000 - sleep * 1000 / total);
+    NVIC_DisableIRQ(TMR0_IRQn);
+    clock_gov_update(awake);
+    NVIC_EnableIRQ(TMR0_IRQn);
+    if (clock_gov_point() != point) {
+        TRACE(HCLK, clock_gov_hclk() / 1000000, awake);
     }
+    hclk_window_start();
 }
 
 /*---------------------------------------------------------*/
@@ -575,43 +1776,52 @@ unsigned long get_fattime(void)
 /* -------------------- */
 // Functions related to the program utility
 /* -------------------- */
+/**
+ * @brief Name of a mode, for the mode menu
+ * @param idx index of the mode array
+ */
+const char *mode_name(uint16_t idx)
+{
+    return (const char *)pgm_mode_name_map[idx].name;
+}
+
+/**
+ * @brief File name of a song, for the song menu
+ * @param idx index in the songs array
+ */
+const char *song_name(uint16_t idx)
+{
+    return wav_file_path[idx];
+}
+
 /**
  * @brief Shows the songs to the LCD for selection
  * @param idx index in the songs array
  * @param line line on the lcd
+ * @note Drawn over the last menu without clearing, so only what changed is sent to the LCD.
+ *       Clear the lcd buf before the first call
  */
 void show_song_menu(uint16_t idx, uint16_t line)
-{ // TODO: top line shows "Song selection", only when 0 <= idx <= 2 ,(only shows 3 lines of option)
-    uint16_t i;
-    mlh_clear_lcd_buf();
-    // Add scroll bar visualliztion effect
-    mlh_draw_rectangle_lcd_buf(LCD_Xmax-SCROLL_BAR_WIDTH, idx * LCD_Ymax/wav_file_count, LCD_Xmax-1, (idx+1) * LCD_Ymax/wav_file_count, FG_COLOR, true);
-    idx -= line;
-    for (i = 0; i < 4; ++i) {
-        if (idx + i < wav_file_count) {
-            if (i == line) mlh_print_line_lcd_buf(0, i * 16, 8, "> ");
-            mlh_print_line_lcd_buf(2 * 8, i * 16, 8, "%s", wav_file_path[idx + i]);
-        }
-    }
-    mlh_show_lcd();
+{
+    mlh_wait_flush_lcd();
+    ui_render_begin();
+    ui_draw_song_menu(idx, line, wav_file_count, song_name);
+    mlh_submit_lcd();
+    ui_render_end();
 }
 
 /**
  * @brief Shows modes for selection on LCD
  * @param idx index of the mode array
+ * @note Drawn over the last menu without clearing, clear the lcd buf before the first call
  */
 void show_mode_menu(uint16_t idx)
 {
-    uint16_t i, offset = 8;
-    mlh_clear_lcd_buf();
-    // Add scroll bar visualliztion effect
-    mlh_draw_rectangle_lcd_buf(LCD_Xmax-SCROLL_BAR_WIDTH, idx * LCD_Ymax/MODE_NUM, LCD_Xmax-1, (idx+1) * LCD_Ymax/MODE_NUM, FG_COLOR, true);
-    mlh_print_line_lcd_buf(0, 0, 5, "Mode selection");
-    for (i = 0; i < 3; ++i) {
-        if (i == idx) mlh_print_line_lcd_buf(0, i * 16 + offset, 8, "> ");
-        mlh_print_line_lcd_buf(2 * 8, i * 16 + offset, 8, "%s", pgm_mode_name_map[i].name);
-    }
-    mlh_show_lcd();
+    mlh_wait_flush_lcd();
+    ui_render_begin();
+    ui_draw_mode_menu(idx, MODE_NUM, mode_name);
+    mlh_submit_lcd();
+    ui_render_end();
 }
 
 /**
@@ -620,45 +1830,124 @@ void show_mode_menu(uint16_t idx)
  */
 void pgm_start(void)
 {// Show info
+    event_t e;
     // Show program name
-    mlh_print_line_lcd_buf(0, 0 * 16, 8, "   WAV PLAYER   ");
-    mlh_print_line_lcd_buf(0, 1 * 16, 8, "Author          ");
-    mlh_print_line_lcd_buf(0, 2 * 16, 8, "    Jorden Huang");
-    mlh_print_line_lcd_buf(0, 3*16+8, 5, "Press any key to continue...");
+    ui_draw_start(0);
     mlh_show_lcd();
-    while (1) {
-        bool start = false;
-        switch (mlh_get_key_state()) {
-        case K_DOWN:
-            start = true;
-            break;
-        }
-        if (start) break;
-    }
+    do {
+        ui_wait_event(&e);
+    } while (e.type != EV_KEY_DOWN);
     mlh_clear_lcd_buf();
 
     // Show usage
-    mlh_print_line_lcd_buf(0, 0 * 16, 8, "     2 to UP    ");
-    mlh_print_line_lcd_buf(0, 0 * 16, 5, "Usage");
-    mlh_print_line_lcd_buf(0, 1 * 16, 8, "     5 to select");
-    mlh_print_line_lcd_buf(0, 2 * 16, 8, "     8 to DOWN  ");
-    mlh_print_line_lcd_buf(0, 3*16,   5, "Use INT1 to quit song ");
-    mlh_print_line_lcd_buf(0, 3*16+8, 5, "Press any key to start");
+    ui_draw_start(1);
     mlh_show_lcd();
-    while (1) {
-        bool start = false;
-        switch (mlh_get_key_state()) {
-        case K_DOWN:
-            start = true;
-            break;
-        }
-        if (start) break;
-    }
+    do {
+        ui_wait_event(&e);
+    } while (e.type != EV_KEY_DOWN);
 
     // tranform to next state
     pgm_state = P_MODE_SELECT;
 }
 
+/**
+ * @brief Number of pages of the memory screen, the totals, the modules and the queues
+ */
+uint8_t memory_page_num(void)
+{
+    const char *modules[MEM_STAT_MODULE_MAX];
+    uint32_t totals[MEM_STAT_MODULE_MAX];
+    uint8_t n = mem_stat_modules(mem_map, MEM_MAP_NUM, modules, totals);
+
+    return 2 + (n + MEM_MODULES_PER_PAGE - 1) / MEM_MODULES_PER_PAGE;
+}
+
+/**
+ * @brief Shows a page of the memory screen on LCD
+ * @param page 0 for the totals, then the modules of the map, the last for the peaks of the queues
+ */
+void show_memory_page(uint8_t page)
+{
+    const char *modules[MEM_STAT_MODULE_MAX];
+    uint32_t totals[MEM_STAT_MODULE_MAX];
+    uint8_t i, n, num = memory_page_num();
+    mem_stat_t s;
+    event_queue_t *q;
+
+    mlh_wait_flush_lcd();
+    ui_render_begin();
+    mlh_clear_lcd_buf();
+    if (page == 0) {
+        mem_stat_get(&s);
+        mlh_print_line_lcd_buf(0, 0, 5, "Memory %d/%d", page + 1, num);
+        mlh_print_line_lcd_buf(0, 8, 8, "RAM %5d/%d", s.linked_size, s.ram_size);
+        mlh_print_line_lcd_buf(0, 8 + 16, 8, "Free %d", s.ram_size - s.linked_size);
+        mlh_print_line_lcd_buf(0, 8 + 32, 8, "Stack %4d/%d", s.stack_peak, s.stack_size);
+        mlh_print_line_lcd_buf(0, 7 * 8, 5, "4/6 page, 2 UART, 5 back");
+    } else if (page < num - 1) {
+        n = mem_stat_modules(mem_map, MEM_MAP_NUM, modules, totals);
+        mlh_print_line_lcd_buf(0, 0, 5, "Buffers, bytes %d/%d", page + 1, num);
+        for (i = 0; i < MEM_MODULES_PER_PAGE && (page - 1) * MEM_MODULES_PER_PAGE + i < n; ++i) {
+            mlh_print_line_lcd_buf(0, (i + 1) * 8, 5, "%-10s %5d", modules[(page - 1) * MEM_MODULES_PER_PAGE + i],
+                                   totals[(page - 1) * MEM_MODULES_PER_PAGE + i]);
+        }
+    } else {
+        mlh_print_line_lcd_buf(0, 0, 5, "Queues, peak %d/%d", page + 1, num);
+        for (i = 0; i < EVENT_QUEUE_NUM; ++i) {
+            q = event_queues[i];
+            mlh_print_line_lcd_buf(0, (i + 1) * 8, 5, "%-6s %3d/%-3d %d lost", event_queue_names[i], q->peak, q->mask + 1,
+                                   q->dropped);
+        }
+        mlh_print_line_lcd_buf(0, (i + 1) * 8, 5, "%-6s %3d/%-3d", "trace", trace_peak(), TRACE_RING_SIZE);
+        mlh_print_line_lcd_buf(0, (i + 2) * 8, 5, "%-6s %d/%d", "arena", mode_arena.peak, mode_arena.size);
+    }
+    mlh_submit_lcd();
+    ui_render_end();
+}
+
+/**
+ * @brief Prints the map of the RAM and the peaks of the queues over UART0
+ */
+void print_memory_info(void)
+{
+    uint8_t i;
+
+    mem_stat_dump(mem_map, MEM_MAP_NUM, mlh_write_format_text_uart);
+    for (i = 0; i < EVENT_QUEUE_NUM; ++i) {
+        mlh_write_format_text_uart("queue %s: peak %d of %d, %d lost\n", event_queue_names[i], event_queues[i]->peak,
+                                   event_queues[i]->mask + 1, event_queues[i]->dropped);
+    }
+    mlh_write_format_text_uart("trace: peak %d of %d\n", trace_peak(), TRACE_RING_SIZE);
+    mlh_write_format_text_uart("arena: peak %d of %d, %d failed\n", mode_arena.peak, mode_arena.size, mode_arena.failed);
+}
+
+/**
+ * @brief The memory screen, the RAM the linker placed, the high-water mark of the stack, the big buffers
+ *        by module and the peaks of the queues, for sizing the buffers
+ * @note Key 9 in the mode menu, key 5 goes back
+ */
+void pgm_memory_info(void)
+{
+    uint8_t page = 0, num = memory_page_num();
+    event_t e;
+
+    show_memory_page(page);
+    while (1) {
+        ui_wait_event(&e);
+        if (e.type != EV_KEY_DOWN) continue;
+        if (e.arg == 5) break;
+        if (e.arg == 4 || e.arg == 6) {
+            page = (e.arg == 6) ? (page + 1) % num : (page + num - 1) % num;
+            show_memory_page(page);
+        } else if (e.arg == 2) {
+            print_memory_info();
+        } else {
+            // Read again, the stack and the queues move
+            show_memory_page(page);
+        }
+    }
+}
+
 /**
  * @brief Hanlder the mode selection
  */
@@ -666,30 +1955,41 @@ void pgm_mode_selection(void)
 {
     int16_t idx = 0;
     bool selected = false;
+    bool redraw = true;
+    event_t e;
+    mlh_clear_lcd_buf();
     while (1) {
-        // Show mode menu
-        show_mode_menu(idx);
+        // Show mode menu, only when the selection changed
+        if (redraw) {
+            show_mode_menu(idx);
+            redraw = false;
+        }
 
-        switch (mlh_get_key_state()) {
-        case K_DOWN:
-            if (KEY_FLAG == 1 || KEY_FLAG == 2) {
+        ui_wait_event(&e);
+        switch (e.type) {
+        case EV_KEY_DOWN:
+            if (e.arg == 1 || e.arg == 2) {
                 // Up
                 if (idx > 0) {
                     idx -= 1;
+                    redraw = true;
                 }
-            } else if (KEY_FLAG == 7 || KEY_FLAG == 8) {
+            } else if (e.arg == 7 || e.arg == 8) {
                 // Down
                 if (idx < MODE_NUM-1) {
                     idx += 1;
+                    redraw = true;
                 }
-            } else if (KEY_FLAG == 5) {
+            } else if (e.arg == 5) {
                 pgm_state = pgm_mode_name_map[idx].mode;
                 selected = true;
+            } else if (e.arg == 9) {
+                pgm_memory_info();
+                mlh_clear_lcd_buf();
+                redraw = true;
             }
             break;
-        case K_UP:
-        case K_PRESSING:
-        case K_NO_PRESSING:
+        default:
             break;
         }
 
@@ -697,6 +1997,53 @@ void pgm_mode_selection(void)
     }
 }
 
+/**
+ * @brief Carves the buffers of the player out of the mode arena, they live until it leaves
+ * @details The song, its header, its cluster link map, the FFT of the spectrum analyzer and a large PCM buffer,
+ *          fewer and longer refills, each a multi-sector read straight into the buffer
+ * @return false if they don't fit in MODE_ARENA_SIZE
+ */
+bool carve_play_buffers(void)
+{
+    song_fp = ARENA_NEW(&mode_arena, FIL, 1);
+    wav_header_data = ARENA_NEW(&mode_arena, unsigned char, WAV_HEADER_BUF_SIZE);
+    wav_clmt = ARENA_NEW(&mode_arena, DWORD, SEEK_CLMT_LEN);
+    vis_fft_buf = ARENA_NEW(&mode_arena, dsp_q15_t, VIS_FFT_LEN * 2);
+    pcm_buffer = ARENA_NEW(&mode_arena, uint16_t, PLAY_PCM_BUFF_SIZE);
+    pcm_buffer_len = PLAY_PCM_BUFF_SIZE;
+    return song_fp != NULL && wav_header_data != NULL && wav_clmt != NULL && vis_fft_buf != NULL && pcm_buffer != NULL;
+}
+
+/**
+ * @brief Carves the buffers of the playback mode out of the mode arena
+ * @details Only a PCM buffer, the TX handler shifts all of it for each FIFO transfer, so it stays small
+ * @return false if it doesn't fit in MODE_ARENA_SIZE
+ */
+bool carve_playback_buffers(void)
+{
+    pcm_buffer = ARENA_NEW(&mode_arena, uint16_t, PLAYBACK_PCM_BUFF_SIZE);
+    pcm_buffer_len = PLAYBACK_PCM_BUFF_SIZE;
+    return pcm_buffer != NULL;
+}
+
+/**
+ * @brief Tells the buffers of the mode don't fit, until a key is pressed
+ */
+void show_out_of_memory(void)
+{
+    event_t e;
+
+    DEBUG_PRINTF("[ERROR] Mode buffers don't fit, %d of %d bytes free\n", arena_free(&mode_arena), mode_arena.size);
+    mlh_clear_lcd_buf();
+    mlh_print_line_lcd_buf(0, 0 * 16, 8, "Out of memory");
+    mlh_print_line_lcd_buf(0, 3*16+8, 5, "Press any key to go back");
+    mlh_show_lcd();
+    do {
+        ui_wait_event(&e);
+    } while (e.type != EV_KEY_DOWN);
+    mlh_clear_lcd_buf();
+}
+
 /**
  * @brief State handler for audio player mode
  * @details Let the user select the song, and play it
@@ -705,68 +2052,91 @@ void pgm_audio_play(void)
 {
     int16_t idx = 0, line = 0;
     bool user_selected = false;
+    bool redraw = true;
+    event_t e;
+
+    if (!carve_play_buffers()) {
+        show_out_of_memory();
+        pgm_state = P_MODE_SELECT;
+        return;
+    }
     mlh_set_7seg_buf(0, 0);
+    mlh_clear_lcd_buf();
 
     while (1) {
-        show_song_menu(idx, line);
+        // Show song menu, only when the selection changed
+        if (redraw) {
+            show_song_menu(idx, line);
+            redraw = false;
+        }
 
-        switch (mlh_get_key_state()) {
-        case K_DOWN:
-            if (KEY_FLAG == 1 || KEY_FLAG == 2) {
+        ui_wait_event(&e);
+        switch (e.type) {
+        case EV_KEY_DOWN:
+            if (e.arg == 1 || e.arg == 2) {
                 // Up
                 if (idx > 0) {
                     idx -= 1;
                     if (line != 0) line -= 1;
+                    redraw = true;
                 }
-            } else if (KEY_FLAG == 7 || KEY_FLAG == 8) {
+            } else if (e.arg == 7 || e.arg == 8) {
                 // Down
                 if (idx < (wav_file_count - 1)) {
                     idx += 1;
                     if (line != 3) line += 1;
+                    redraw = true;
                 }
-            } else if (KEY_FLAG == 5) {
+            } else if (e.arg == 5) {
                 user_selected = true;
-                // Invert the region
+                // Invert the region, after the menu frame is sent
+                mlh_wait_flush_lcd();
                 mlh_invert_region_lcd_buf(2 * 8, line * 16 + 1, 8 * strlen(wav_file_path[idx]), 15);
                 mlh_show_lcd();
+            } else if (e.arg == 6) {
+                next_tone_preset(false);
             }
             break;
-        case K_UP:
-            if (KEY_FLAG_LAST == 4) {
+        case EV_KEY_UP:
+            if (e.arg == 4) {
                 DEBUG_PRINTF("KEY 4 UP\n");
             }
             break;
-        case K_PRESSING:
-            if (KEY_FLAG == 4) { }
-            break;
-        case K_NO_PRESSING:
+        default:
             break;
         }
 
         if (user_selected) {
+            hclk_set_point(HCLK_PLAY_POINT);
             DEBUG_PRINTF("\nOpen wav file\n");
             // Then read the file
-            open_wav_file(&fp, wav_file_path[idx], &wav_header);
+            open_wav_file(song_fp, wav_file_path[idx], &wav_header);
+            playing_file_name = wav_file_path[idx];
 
             DEBUG_PRINTF("\nInit audio stuff\n");
             // After reading the file, init audio stuff
             // (Must be after reading the file, because it needs to be configured using the sample rate)
-            init_audio_stuff(wav_header.sample_rate);
+            init_audio_stuff(wav_header.sample_rate, wav_header.num_of_channels, WAU8822_POWER_PLAYBACK);
 
+            level_meter_reset(&meter);
+            play_clock_start(wav_seek.total_frames, wav_header.sample_rate);
+            seg_play_time(0);
             start_count = true;
             {
                 DEBUG_PRINTF("\nStart play\n");
-                start_play(&fp);
-                if (STOP_PLAYING) STOP_PLAYING = false;
+                start_play(song_fp);
             }
             start_count = false;
+            mlh_turn_off_all_led();
 
             DEBUG_PRINTF("\nClose wav file\n");
-            close_wav_file(&fp);
+            close_wav_file(song_fp);
 
             cnt_5ms = 0;
             user_selected = false;
 
+            // Muted and powered down while MCLK still runs, the menus leave the codec in standby
+            WAU8822_SetPowerProfile(WAU8822_POWER_STANDBY);
             I2C_Close(I2C0);
             I2S_Close(I2S);
             CLK_DisableModuleClock(I2S_MODULE);
@@ -775,6 +2145,8 @@ void pgm_audio_play(void)
 
             mlh_reset_7seg_buf(false);
             mlh_set_7seg_buf(0, 0);
+            mlh_clear_lcd_buf();
+            redraw = true;
         }
     }
 }
@@ -785,24 +2157,42 @@ void pgm_audio_play(void)
  */
 void pgm_audio_playback(void)
 {
-    bool start_flag = true;
+    bool start_flag = true, quit = false;
+    uint32_t sec, seg_sec = 0;
+    event_t e;
     pcm_buffer_idx = 0;
 
+    if (!carve_playback_buffers()) {
+        show_out_of_memory();
+        pgm_state = P_MODE_SELECT;
+        return;
+    }
     mlh_clear_lcd_buf();
     mlh_print_line_lcd_buf(0, 0 * 16, 8, "Playback mode");
     mlh_print_line_lcd_buf(0, 2 * 16, 8, "COMING SOON");
     mlh_show_lcd();
 
+    // Not governed, the loop doesn't measure its awake time
+    hclk_set_point(HCLK_PLAY_POINT);
     DEBUG_PRINTF("\nInit audio stuff\n");
-    init_audio_stuff(PLAYBACK_SAMPLE_RATE);
+    init_audio_stuff(PLAYBACK_SAMPLE_RATE, 2, WAU8822_POWER_DUPLEX);
+    i2s_bind_playback();
 
     // Enable RX
     I2S_EnableInt(I2S, I2S_IE_RXTHIE_Msk);
     // I2S_ENABLE_RX(I2S);
     // I2S_SET_MONO_RX_CHANNEL(I2S, I2S_MONO_LEFT);
 
+    play_clock_start(0, PLAYBACK_SAMPLE_RATE);
     start_count = true;
     while (1) {
+        sec = play_clock_elapsed_sec();
+        if (sec != seg_sec) {
+            seg_sec = sec;
+            seg_play_time(sec);
+        }
+        // The handlers trace each FIFO transfer
+        trace_drain(trace_sink, TRACE_DRAIN_BYTES);
         // if (pcm_buffer_idx < 8) {
         //     I2S_DisableInt(I2S, I2S_IE_TXTHIE_Msk);
         //     I2S_DISABLE_TX(I2S);
@@ -810,7 +2200,7 @@ void pgm_audio_playback(void)
         //         I2S_ENABLE_RX(I2S);
 
         // }
-        // else if (pcm_buffer_idx >= PCM_BUFF_SIZE-8) {
+        // else if (pcm_buffer_idx >= pcm_buffer_len-8) {
         //     I2S_DisableInt(I2S, I2S_IE_RXTHIE_Msk);
         //     I2S_DISABLE_RX(I2S);
         //         I2S_EnableInt(I2S, I2S_IE_TXTHIE_Msk);
@@ -818,7 +2208,7 @@ void pgm_audio_playback(void)
         // }
         if (start_flag) {
             /* Enable I2S Tx function to send data when data in the buffer is more than half of buffer size */
-            if (pcm_buffer_idx >= PCM_BUFF_SIZE / 2) {
+            if (pcm_buffer_idx >= pcm_buffer_len / 2) {
                 I2S_EnableInt(I2S, I2S_IE_TXTHIE_Msk);
                 I2S_ENABLE_TX(I2S);
                 start_flag = false;
@@ -826,11 +2216,15 @@ void pgm_audio_playback(void)
             }
         }
 
-        if (STOP_PLAYING) {
+        while (ui_poll_event(&e)) {
+            if (e.type == EV_STOP) quit = true;
+        }
+        if (quit) {
             break;
         }
     }
     start_count = false;
+    WAU8822_SetPowerProfile(WAU8822_POWER_STANDBY);
 
     cnt_5ms = 0;
     mlh_reset_7seg_buf(false);
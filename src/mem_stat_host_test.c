@@ -0,0 +1,165 @@
+/**
+ * @brief Test of the RAM statistics (utils/mem_stat.c), on a PC
+ * @details
+ *   A region is painted and written part way, the untouched part must end where the writes start.
+ *   Then a thread runs on a stack given to mem_stat_init() and recurses to a known depth, with a buffer in
+ *   each frame, the high-water mark must cover the buffers, stay in the stack, and grow with the depth.
+ *   Last the map of main.c is dumped through a print function like mlh_write_format_text_uart(), the totals
+ *   per module must add up, and every line must fit in its 64 bytes buffer (MLH_UART0_BUF_SIZE).
+ * @usage gcc -O2 -Wall -pthread -DMEM_STAT_HOST -Iutils mem_stat_host_test.c utils/mem_stat.c -o mem_stat_host_test && ./mem_stat_host_test
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "mem_stat.h"
+
+#define UART_BUF_SIZE 64
+#define THREAD_STACK_SIZE (256 * 1024)
+#define FRAME_BUF_SIZE 512
+
+static int errors = 0;
+// Stays registered with mem_stat_init() after the test, the dump reads it
+static uint8_t thread_stack[THREAD_STACK_SIZE] __attribute__((aligned(4096)));
+
+// Same as mlh_write_format_text_uart(), but checks the length
+static void print_uart(const char *format, ...)
+{
+    char buf[256];
+    int len;
+    va_list args;
+
+    va_start(args, format);
+    len = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    if (len >= UART_BUF_SIZE) {
+        printf("  line of %d bytes overflows the UART buffer\n", len);
+        errors += 1;
+    }
+    fputs(buf, stdout);
+}
+
+static void test_paint(void)
+{
+    uint32_t region[64];
+    int before = errors;
+
+    mem_stat_paint(region, sizeof(region));
+    if (mem_stat_untouched(region, sizeof(region)) != sizeof(region)) errors += 1;
+    // Like a stack, written from the top down to word 40
+    memset(&region[40], 0, sizeof(region) - 40 * 4);
+    if (mem_stat_untouched(region, sizeof(region)) != 40 * 4) {
+        printf("  untouched %u, 160 expected\n", mem_stat_untouched(region, sizeof(region)));
+        errors += 1;
+    }
+    region[0] = 0;
+    if (mem_stat_untouched(region, sizeof(region)) != 0) errors += 1;
+    printf("Paint: %s\n", (errors == before) ? "ok" : "failed");
+}
+
+static uint32_t recurse(uint32_t depth)
+{
+    volatile uint8_t buf[FRAME_BUF_SIZE];
+    uint32_t i, sum = 0;
+
+    for (i = 0; i < FRAME_BUF_SIZE; ++i) buf[i] = (uint8_t)(i + depth);
+    if (depth > 1) sum = recurse(depth - 1);
+    for (i = 0; i < FRAME_BUF_SIZE; i += 64) sum += buf[i];
+    return sum;
+}
+
+static void *stack_user(void *arg)
+{
+    recurse((uint32_t)(uintptr_t)arg);
+    return NULL;
+}
+
+// High-water mark after a thread recursed to depth
+static uint32_t stack_peak(void *stack, uint32_t depth)
+{
+    pthread_attr_t attr;
+    pthread_t t;
+    mem_stat_t s;
+
+    mem_stat_init(stack, THREAD_STACK_SIZE);
+    pthread_attr_init(&attr);
+    pthread_attr_setstack(&attr, stack, THREAD_STACK_SIZE);
+    pthread_create(&t, &attr, stack_user, (void *)(uintptr_t)depth);
+    pthread_join(t, NULL);
+    pthread_attr_destroy(&attr);
+    mem_stat_get(&s);
+    return s.stack_peak;
+}
+
+static void test_stack(void)
+{
+    const uint32_t depths[] = {4, 16, 64};
+    uint32_t i, peak, last = 0;
+    int before = errors;
+
+    for (i = 0; i < sizeof(depths) / sizeof(depths[0]); ++i) {
+        peak = stack_peak(thread_stack, depths[i]);
+        printf("  depth %2u: %6u bytes of stack\n", depths[i], peak);
+        if (peak < depths[i] * FRAME_BUF_SIZE || peak >= THREAD_STACK_SIZE || peak <= last) errors += 1;
+        last = peak;
+    }
+    printf("Stack: %s\n", (errors == before) ? "ok" : "failed");
+}
+
+// The map of main.c, with the sizes of the target
+static void test_map(void)
+{
+    static const mem_stat_entry_t map[] = {
+        MEM_STAT_SIZE("fatfs", "FatFs", 564),
+        MEM_STAT_SIZE("fatfs", "LfnBuf", 256),
+        MEM_STAT_SIZE("audio", "wav_seek", 12),
+        MEM_STAT_SIZE("arena", "mode_arena_buf", 5360),
+        MEM_STAT_SIZE("lcd", "mlh_lcd_buffer", 1024),
+        MEM_STAT_SIZE("uart", "mlh_tx_buf", 64),
+        MEM_STAT_SIZE("uart", "mlh_rx_buf", 64),
+        MEM_STAT_SIZE("dsp", "sw_filter_state", 32),
+        MEM_STAT_SIZE("dsp", "sw_filter_coeffs", 24),
+        MEM_STAT_SIZE("dsp", "meter", 16),
+        MEM_STAT_SIZE("events", "key_event_buf", 128),
+        MEM_STAT_SIZE("events", "stop_event_buf", 32),
+        MEM_STAT_SIZE("events", "i2s_event_buf", 64),
+        MEM_STAT_SIZE("events", "timer_event_buf", 32),
+        MEM_STAT_SIZE("sched", "play_tasks", 288),
+        MEM_STAT_SIZE("trace", "s_ring", 1024),
+        MEM_STAT_SIZE("prof", "s_probe", 616),
+    };
+    static const char *const names[] = {"fatfs", "audio", "arena", "lcd", "uart", "dsp", "events", "sched", "trace", "prof"};
+    static const uint32_t sizes[] = {564 + 256, 12, 5360, 1024, 64 + 64, 32 + 24 + 16, 128 + 32 + 64 + 32, 288, 1024, 616};
+    const char *modules[MEM_STAT_MODULE_MAX];
+    uint32_t totals[MEM_STAT_MODULE_MAX];
+    uint8_t i, n, num = sizeof(map) / sizeof(map[0]);
+    int before = errors;
+
+    n = mem_stat_modules(map, num, modules, totals);
+    if (n != sizeof(names) / sizeof(names[0])) {
+        printf("  %u modules\n", n);
+        errors += 1;
+    } else {
+        for (i = 0; i < n; ++i) {
+            if (strcmp(modules[i], names[i]) != 0 || totals[i] != sizes[i]) {
+                printf("  module %u: %s %u\n", i, modules[i], totals[i]);
+                errors += 1;
+            }
+        }
+    }
+    printf("\nDump:\n");
+    mem_stat_dump(map, num, print_uart);
+    printf("Map: %s\n", (errors == before) ? "ok" : "failed");
+}
+
+int main(void)
+{
+    test_paint();
+    test_stack();
+    test_map();
+    printf("\nErrors: %d\n", errors);
+    return (errors == 0) ? 0 : 1;
+}
@@ -0,0 +1,199 @@
+/**
+ * @brief Mock of the peripherals used by myLib.h, to build the LCD section on a PC
+ * @details The SPI3 macros are replaced by a mock that counts the transfers,
+ *          and decodes them into an emulated LCD, so what the driver sends can be checked.
+ *          The bus time is estimated from the clock, 9 clocks a word plus the suspend
+ *          interval between the words sent back to back in FIFO mode.
+ *          A page buffer (same layout as mlh_lcd_buffer) can be saved to and compared with a PBM image
+ * @usage
+ *   #define MLH_HOST
+ *   #define MLH_LCD
+ *   #define MLH_LCD_DYNAMIC_UPDATE
+ *   #include "myLib.h"
+ *   gcc -I. -I../Library/Nu-LB-NUC140/Include xxx.c
+ */
+
+#ifndef _MLH_HOST_H_
+#define _MLH_HOST_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Columns and pages of the LCD controller, the panel shows CA 2 to 129
+#define MLH_HOST_LCD_CA_NUM 132
+#define MLH_HOST_LCD_PA_NUM 8
+
+// Bits of SPI CNTRL used by the driver, same as the NUC100 series
+#define SPI_CNTRL_SP_CYCLE_Pos 12
+#define SPI_CNTRL_SP_CYCLE_Msk (0xFul << SPI_CNTRL_SP_CYCLE_Pos)
+#define SPI_CNTRL_FIFO_Msk (1ul << 21)
+#define SPI_CNTRL_TX_EMPTY_Msk (1ul << 26)
+#define SPI_CNTRL_TX_FULL_Msk (1ul << 27)
+
+typedef struct {
+    uint32_t CNTRL; // TX FIFO is always empty, the words are shifted out at once
+    uint32_t clock_hz;
+    uint16_t tx0;
+    bool ss_low;
+    uint32_t frame_words; // Words since the chip select went low
+    // Counters, clear them to measure a frame
+    uint32_t ss_count;   // Chip select assertions
+    uint32_t cmd_count;  // 9-bit words with D/C = 0
+    uint32_t data_count; // 9-bit words with D/C = 1
+    uint64_t bus_ps;     // Estimated time on the bus, in ps
+    // Emulated LCD controller
+    uint8_t page;
+    uint8_t column;
+    uint8_t gdram[MLH_HOST_LCD_PA_NUM][MLH_HOST_LCD_CA_NUM];
+} mlh_host_spi_t;
+
+mlh_host_spi_t mlh_host_spi3 = {
+    .CNTRL = (3ul << SPI_CNTRL_SP_CYCLE_Pos) | SPI_CNTRL_TX_EMPTY_Msk, // Reset value of SP_CYCLE
+    .clock_hz = 1000000,
+};
+
+/**
+ * @brief Decode one 9-bit word, like the LCD controller does
+ * @param spi The mock
+ */
+static void mlh_host_spi_transfer(mlh_host_spi_t *spi)
+{
+    uint8_t byte = spi->tx0 & 0xFF;
+    uint64_t clock_ps = 1000000000000ull / spi->clock_hz;
+    spi->bus_ps += 9 * clock_ps;
+    if ((spi->CNTRL & SPI_CNTRL_FIFO_Msk) && spi->frame_words > 0) {
+        // Suspend interval is SP_CYCLE + 0.5 clocks
+        spi->bus_ps += ((spi->CNTRL & SPI_CNTRL_SP_CYCLE_Msk) >> SPI_CNTRL_SP_CYCLE_Pos) * clock_ps + clock_ps / 2;
+    }
+    spi->frame_words += 1;
+    if (spi->tx0 & 0x100) {
+        spi->data_count += 1;
+        if (spi->page < MLH_HOST_LCD_PA_NUM && spi->column < MLH_HOST_LCD_CA_NUM) {
+            spi->gdram[spi->page][spi->column] = byte;
+        }
+        // Column address increases after each data byte, and wraps to the next page
+        spi->column += 1;
+        if (spi->column == MLH_HOST_LCD_CA_NUM) {
+            spi->column = 0;
+            spi->page += 1;
+        }
+    } else {
+        spi->cmd_count += 1;
+        if ((byte & 0xF0) == 0xB0) {
+            spi->page = byte & 0x0F;
+        } else if ((byte & 0xF0) == 0x10) {
+            spi->column = (spi->column & 0x0F) | ((byte & 0x0F) << 4);
+        } else if ((byte & 0xF0) == 0x00) {
+            spi->column = (spi->column & 0xF0) | (byte & 0x0F);
+        }
+    }
+}
+
+/**
+ * @brief Clear the counters of the mock
+ */
+static void mlh_host_spi_reset_count(void)
+{
+    mlh_host_spi3.ss_count = 0;
+    mlh_host_spi3.cmd_count = 0;
+    mlh_host_spi3.data_count = 0;
+    mlh_host_spi3.bus_ps = 0;
+}
+
+// Interrupts are not emulated, the flush steps are called directly
+#define __disable_irq()
+#define __enable_irq()
+#define __WFI()
+
+/**
+ * @brief Copy what the emulated LCD shows into a page buffer
+ * @param buf 128 x 8 pages, same layout as mlh_lcd_buffer
+ * @note Buffer column x is on CA (129 - x)
+ */
+static void mlh_host_panel_to_buf(uint8_t *buf)
+{
+    uint16_t x, y;
+    for (y = 0; y < MLH_HOST_LCD_PA_NUM; ++y) {
+        for (x = 0; x < 128; ++x) {
+            buf[y * 128 + x] = mlh_host_spi3.gdram[y][129 - x];
+        }
+    }
+}
+
+/**
+ * @brief Save a page buffer as a 128x64 binary PBM image (P4), 1 is a black pixel
+ * @param path File to write
+ * @param buf 128 x 8 pages, same layout as mlh_lcd_buffer
+ * @return 0 on success, -1 if the file can't be written
+ */
+static int mlh_host_write_pbm(const char *path, const uint8_t *buf)
+{
+    uint16_t x, y;
+    uint8_t row[128 / 8];
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL) return -1;
+
+    fprintf(fp, "P4\n128 64\n");
+    for (y = 0; y < 64; ++y) {
+        for (x = 0; x < 128 / 8; ++x) row[x] = 0;
+        for (x = 0; x < 128; ++x) {
+            if ((buf[(y / 8) * 128 + x] >> (y % 8)) & 1) row[x / 8] |= 0x80 >> (x % 8);
+        }
+        fwrite(row, 1, sizeof(row), fp);
+    }
+    fclose(fp);
+    return 0;
+}
+
+/**
+ * @brief Compare a page buffer with a PBM image saved by mlh_host_write_pbm()
+ * @param path File to read
+ * @param buf 128 x 8 pages, same layout as mlh_lcd_buffer
+ * @return Number of different pixels, -1 if the file can't be read
+ */
+static int32_t mlh_host_diff_pbm(const char *path, const uint8_t *buf)
+{
+    uint16_t x, y;
+    uint8_t row[128 / 8];
+    int32_t diff = 0;
+    int width, height;
+    bool pixel;
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) return -1;
+
+    if (fscanf(fp, "P4 %d %d", &width, &height) != 2 || width != 128 || height != 64 || fgetc(fp) != '\n') {
+        fclose(fp);
+        return -1;
+    }
+    for (y = 0; y < 64; ++y) {
+        if (fread(row, 1, sizeof(row), fp) != sizeof(row)) {
+            fclose(fp);
+            return -1;
+        }
+        for (x = 0; x < 128; ++x) {
+            pixel = (buf[(y / 8) * 128 + x] >> (y % 8)) & 1;
+            if (pixel != ((row[x / 8] & (0x80 >> (x % 8))) != 0)) diff += 1;
+        }
+    }
+    fclose(fp);
+    return diff;
+}
+
+#define SPI3 (&mlh_host_spi3)
+#define SPI_MASTER 0
+#define SPI_MODE_0 0
+#define SPI_Open(spi, master, mode, width, clk) ((spi)->clock_hz = (clk))
+#define SPI_DisableAutoSS(spi) ((void)(spi))
+#define SPI_SET_SUSPEND_CYCLE(spi, cycle) \
+    ((spi)->CNTRL = ((spi)->CNTRL & ~SPI_CNTRL_SP_CYCLE_Msk) | ((cycle) << SPI_CNTRL_SP_CYCLE_Pos))
+#define SPI_EnableFIFO(spi, tx_threshold, rx_threshold) ((spi)->CNTRL |= SPI_CNTRL_FIFO_Msk)
+#define SPI_SET_SS0_LOW(spi) ((spi)->ss_low = true, (spi)->ss_count += 1, (spi)->frame_words = 0)
+#define SPI_SET_SS0_HIGH(spi) ((spi)->ss_low = false)
+// In FIFO mode writing TX0 starts the transfer
+#define SPI_WRITE_TX0(spi, data) \
+    ((spi)->tx0 = (data), ((spi)->CNTRL & SPI_CNTRL_FIFO_Msk) ? mlh_host_spi_transfer(spi) : (void)0)
+#define SPI_TRIGGER(spi) mlh_host_spi_transfer(spi)
+#define SPI_IS_BUSY(spi) 0
+
+#endif // _MLH_HOST_H_
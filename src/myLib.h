@@ -16,9 +16,12 @@
  *     MLH_7SEG_INT
  *     MLH_LCD
  *     MLH_LCD_DYNAMIC_UPDATE (need MLH_LCD declared)
+ *     MLH_HOST (build the LCD section on a PC, the SPI3 is replaced by the mock in mlh_host.h)
  *     MLH_PWM_BUZZER
  *     MLH_ADC_VR
  *     MLH_UART
+ *     MLH_PROTOTYPES_ONLY (only the prototypes, and the LCD size and colors with MLH_LCD, for the other source files
+ *                          of a program, the functions are compiled in the one source file that includes it without)
  * 
  *   Example:
  *     #define MLH_7SEG // or #define MLH_7SEG_INT to use timer interrupt to update 7seg
@@ -108,10 +111,24 @@
 #include <stdbool.h>
 #include <string.h>
 
+#ifdef MLH_LCD
+#define LCD_Xmax 128
+#define LCD_Ymax 64
+// Do not change the color definition (the code will break), FG_COLOR and BG_COLOR should be complement
+#define FG_COLOR 0xFFFF
+#define BG_COLOR 0x0000
+#endif // MLH_LCD
+
+#ifndef MLH_PROTOTYPES_ONLY
+#ifdef MLH_HOST
+#include "mlh_host.h"
+#else
 #include "NUC100Series.h"
 #include "GPIO.h"
 #include "SYS.h"
 #include "SPI.h"
+#endif // MLH_HOST
+#endif // MLH_PROTOTYPES_ONLY
 
 /***********************/
 // Function prototypes {
@@ -144,11 +161,16 @@ void mlh_init_SPI3(void);
 void mlh_lcdWriteCommand(unsigned char temp);
 void mlh_lcdWriteData(uint8_t temp);
 void mlh_lcdSetAddr(uint8_t PageAddr, uint8_t ColumnAddr);
+void mlh_lcdWriteSpan(uint8_t PageAddr, uint8_t x0, uint8_t x1);
 void mlh_init_lcd(void);
 void mlh_clear_lcd_only(void);
 void mlh_clear_lcd_buf(void);
 void mlh_show_lcd(void);
 void mlh_show_lcd_16_round(bool *done_flag);
+void mlh_submit_lcd(void);
+void mlh_step_flush_lcd(uint16_t budget);
+void mlh_wait_flush_lcd(void);
+void mlh_mark_dirty_lcd_buf(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1);
 
 void mlh_invert_region_lcd_buf(uint16_t x, uint16_t y, uint16_t width_px, uint16_t height_px);
 
@@ -187,6 +209,7 @@ void mlh_write_format_text_uart(const char *format, ...);
 // End Function prototypes }
 /***********************/
 
+#ifndef MLH_PROTOTYPES_ONLY
 /***********************/
 // FUNCTION IMPLEMENTATIONS
 /***********************/
@@ -348,9 +371,14 @@ enum Key_state {
     K_NO_PRESSING
 };
 
-bool KEY_CHANGED = false;
-uint8_t KEY_FLAG = 0;
+volatile bool KEY_CHANGED = false;
+volatile uint8_t KEY_FLAG = 0;
 uint8_t KEY_FLAG_LAST = 0;
+// Called by the interrupt after every key change, key is 0 when released and key_last is the key before.
+// Define it before including this library, to post the keys to a queue instead of polling mlh_get_key_state()
+#ifndef MLH_KEYPAD_EVENT
+#define MLH_KEYPAD_EVENT(key, key_last)
+#endif
 
 /**
  * @brief Interrupt service routine for keypad
@@ -389,6 +417,7 @@ void GPAB_IRQHandler(void)
     }
     // Update KEY_CHANGED flag after the mlh_get_key_state call
     KEY_CHANGED = true;
+    MLH_KEYPAD_EVENT(KEY_FLAG, KEY_FLAG_LAST);
 
     PA0 = 1; PA1 = 1; PA2 = 1; PA3 = 0; PA4 = 0; PA5 = 0;
     PA->ISRC = PA->ISRC; // clear all GPA pins
@@ -676,17 +705,144 @@ uint16_t mlh_seg_buf_to_number(void)
 #include "Font5x7.h"
 #include "Font8x16.h"
 
-#define LCD_Xmax 128
-#define LCD_Ymax 64
-// Do not change the color definition (the code will break), FG_COLOR and BG_COLOR should be complement
-#define FG_COLOR 0xFFFF
-#define BG_COLOR 0x0000
+// SPI3 bus clock of the LCD, define it before including this library to change it
+#ifndef MLH_LCD_SPI_CLOCK
+#define MLH_LCD_SPI_CLOCK 4000000 // Hz
+#endif
+// Bytes sent by one mlh_step_flush_lcd() call from the timer, define it before including this library to change it
+#ifndef MLH_LCD_FLUSH_BUDGET
+#define MLH_LCD_FLUSH_BUDGET 128
+#endif
+// Called around the frame of mlh_show_lcd(), the value of begin is passed to end. Define them before including this library to time it
+#ifndef MLH_LCD_SHOW_BEGIN
+#define MLH_LCD_SHOW_BEGIN() 0
+#define MLH_LCD_SHOW_END(start) ((void)(start))
+#endif
+
+/**
+ * @brief [Internal macro] Push a 9-bit word to the SPI3 TX FIFO, waits only when the FIFO is full
+ */
+#define _MLH_LCD_PUSH(word) \
+    do { \
+        while (SPI3->CNTRL & SPI_CNTRL_TX_FULL_Msk) \
+            ; \
+        SPI_WRITE_TX0(SPI3, (word)); \
+    } while (0)
+/**
+ * @brief [Internal macro] Wait until all the words in the SPI3 TX FIFO are shifted out
+ */
+#define _MLH_LCD_DRAIN() \
+    while (!(SPI3->CNTRL & SPI_CNTRL_TX_EMPTY_Msk) || SPI_IS_BUSY(SPI3)) \
+        ;
 
 #if defined(MLH_LCD_DYNAMIC_UPDATE)
 /**
- * @brief [Internal variable] Store the current data that display on the LCD
+ * @brief [Internal macro] Number of dirty spans of each page
+ * @note Two edits far apart on a page, like a menu cursor and the scroll bar, are sent as two spans
+ *       instead of everything between them
+ */
+#define _MLH_LCD_DIRTY_SPANS 2
+/**
+ * @brief [Internal macro] Largest gap of clean columns that is sent to join two spans
+ * @note Each span costs 3 address words, so sending up to 3 clean columns is not more
+ */
+#define _MLH_LCD_SPAN_GAP 3
+/**
+ * @brief [Internal variable] Dirty column spans of each page, x in lcd buf, from x0 to x1 (inclusive)
+ * @note A span is empty when x0 > x1, the spans of a page never overlap. Only the dirty spans are sent by mlh_show_lcd()
+ *       They start empty when mlh_init_lcd() runs, draw into the lcd buf only after it
+ */
+uint8_t _mlh_dirty_x0[LCD_Ymax / 8][_MLH_LCD_DIRTY_SPANS];
+uint8_t _mlh_dirty_x1[LCD_Ymax / 8][_MLH_LCD_DIRTY_SPANS];
+/**
+ * @brief [Internal variable] Column span of each page that was drawn since the last clear
+ * @note Clearing the lcd buf only needs to send these columns again, everything else is already 0
+ */
+uint8_t _mlh_ink_x0[LCD_Ymax / 8] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+uint8_t _mlh_ink_x1[LCD_Ymax / 8] = {0, 0, 0, 0, 0, 0, 0, 0};
+
+/**
+ * @brief [Internal function] Number of clean columns between two spans, -1 if they touch or overlap
+ */
+static int16_t _mlh_span_gap(uint8_t a_x0, uint8_t a_x1, uint8_t b_x0, uint8_t b_x1)
+{
+    if (a_x0 > b_x1) return a_x0 - b_x1 - 1;
+    if (b_x0 > a_x1) return b_x0 - a_x1 - 1;
+    return -1;
+}
+
+/**
+ * @brief [Internal function] Add columns x0 to x1 of page to the dirty spans and the ink span
+ * @note Columns close to a span grow it. Far from all of them, they take an empty span, or if there is none,
+ *       the two closest spans are joined when that sends fewer clean columns than growing the closest one
  */
-uint8_t _mlh_current_data_in_lcd[128 * 8];
+void _mlh_mark_dirty_span(uint16_t page, uint8_t x0, uint8_t x1)
+{
+    uint8_t *span_x0 = _mlh_dirty_x0[page], *span_x1 = _mlh_dirty_x1[page];
+    uint8_t s, t, best = 0, empty = _MLH_LCD_DIRTY_SPANS, join_s = 0, join_t = 0;
+    int16_t gap, best_gap = LCD_Xmax, join_gap = LCD_Xmax;
+
+    if (x0 < _mlh_ink_x0[page]) _mlh_ink_x0[page] = x0;
+    if (x1 > _mlh_ink_x1[page]) _mlh_ink_x1[page] = x1;
+
+    for (s = 0; s < _MLH_LCD_DIRTY_SPANS; ++s) {
+        if (span_x0[s] > span_x1[s]) {
+            empty = s;
+            continue;
+        }
+        if (x0 >= span_x0[s] && x1 <= span_x1[s]) return; // Already dirty
+        gap = _mlh_span_gap(x0, x1, span_x0[s], span_x1[s]);
+        if (gap < best_gap) {
+            best_gap = gap;
+            best = s;
+        }
+    }
+
+    if (best_gap > _MLH_LCD_SPAN_GAP) {
+        if (empty < _MLH_LCD_DIRTY_SPANS) {
+            span_x0[empty] = x0;
+            span_x1[empty] = x1;
+            return;
+        }
+        for (s = 0; s < _MLH_LCD_DIRTY_SPANS; ++s) {
+            for (t = s + 1; t < _MLH_LCD_DIRTY_SPANS; ++t) {
+                gap = _mlh_span_gap(span_x0[s], span_x1[s], span_x0[t], span_x1[t]);
+                if (gap < join_gap) {
+                    join_gap = gap;
+                    join_s = s;
+                    join_t = t;
+                }
+            }
+        }
+        if (join_gap < best_gap) {
+            if (span_x0[join_t] < span_x0[join_s]) span_x0[join_s] = span_x0[join_t];
+            if (span_x1[join_t] > span_x1[join_s]) span_x1[join_s] = span_x1[join_t];
+            span_x0[join_t] = x0;
+            span_x1[join_t] = x1;
+            return;
+        }
+    }
+
+    // Grow the closest span, it may reach another one now
+    if (x0 < span_x0[best]) span_x0[best] = x0;
+    if (x1 > span_x1[best]) span_x1[best] = x1;
+    for (s = 0; s < _MLH_LCD_DIRTY_SPANS; ++s) {
+        if (s == best || span_x0[s] > span_x1[s]) continue;
+        if (_mlh_span_gap(span_x0[best], span_x1[best], span_x0[s], span_x1[s]) <= _MLH_LCD_SPAN_GAP) {
+            if (span_x0[s] < span_x0[best]) span_x0[best] = span_x0[s];
+            if (span_x1[s] > span_x1[best]) span_x1[best] = span_x1[s];
+            span_x0[s] = 0xFF;
+            span_x1[s] = 0;
+        }
+    }
+}
+
+/**
+ * @brief [Internal macro] Add column x of page to the dirty spans and the ink span
+ */
+#define _MLH_MARK_DIRTY(page, x) _mlh_mark_dirty_span((page), (x), (x))
+#else
+#define _MLH_MARK_DIRTY(page, x)
 #endif // defined(MLH_LCD_DYNAMIC_UPDATE)
 
 /**
@@ -696,13 +852,17 @@ uint8_t mlh_lcd_buffer[128 * 8];
 
 /**
  * @brief Initialize the SPI portocol, LCD uses this protocol to communicate with.
+ * @note FIFO mode, so a run of words is sent back to back under one chip select
  */
 void mlh_init_SPI3(void)
 {
     /* Configure as a master, clock idle low, 9-bit transaction, drive output on falling clock edge and latch input on rising edge. */
-    /* Set IP clock divider. SPI clock rate = 1MHz */
-    SPI_Open(SPI3, SPI_MASTER, SPI_MODE_0, 9, 1000000);
+    /* Set IP clock divider. SPI clock rate = MLH_LCD_SPI_CLOCK */
+    SPI_Open(SPI3, SPI_MASTER, SPI_MODE_0, 9, MLH_LCD_SPI_CLOCK);
     SPI_DisableAutoSS(SPI3);
+    // Shortest suspend interval between the words (0.5 clock), then FIFO mode, the transfer starts when a word is written
+    SPI_SET_SUSPEND_CYCLE(SPI3, 0);
+    SPI_EnableFIFO(SPI3, 4, 4);
 }
 
 /**
@@ -712,10 +872,8 @@ void mlh_init_SPI3(void)
 void mlh_lcdWriteCommand(unsigned char temp)
 {
     SPI_SET_SS0_LOW(SPI3);
-    SPI_WRITE_TX0(SPI3, temp); // Write Data
-    SPI_TRIGGER(SPI3);         // Trigger SPI data transfer
-    while (SPI_IS_BUSY(SPI3))
-        ; // Check SPI3 busy status
+    _MLH_LCD_PUSH(temp);
+    _MLH_LCD_DRAIN();
     SPI_SET_SS0_HIGH(SPI3);
 }
 
@@ -726,10 +884,8 @@ void mlh_lcdWriteCommand(unsigned char temp)
 void mlh_lcdWriteData(uint8_t temp)
 {
     SPI_SET_SS0_LOW(SPI3);
-    SPI_WRITE_TX0(SPI3, 0x100 + temp); // Write Data
-    SPI_TRIGGER(SPI3);                 // Trigger SPI data transfer
-    while (SPI_IS_BUSY(SPI3))
-        ; // Check SPI3 busy status
+    _MLH_LCD_PUSH(0x100 + temp);
+    _MLH_LCD_DRAIN();
     SPI_SET_SS0_HIGH(SPI3);
 }
 
@@ -740,26 +896,38 @@ void mlh_lcdWriteData(uint8_t temp)
  */
 void mlh_lcdSetAddr(uint8_t PageAddr, uint8_t ColumnAddr)
 {
-    // Set PA (Set page address, 1011____, _ means data bits)
     SPI_SET_SS0_LOW(SPI3);
-    SPI_WRITE_TX0(SPI3, 0xB0 | PageAddr); // Write Data
-    SPI_TRIGGER(SPI3);                    // Trigger SPI data transfer
-    while (SPI_IS_BUSY(SPI3))
-        ; // Check SPI3 busy status
-    SPI_SET_SS0_HIGH(SPI3);
+    // Set PA (Set page address, 1011____, _ means data bits)
+    _MLH_LCD_PUSH(0xB0 | PageAddr);
     // Set CA MSB (Set column address MSB, 0001____)
-    SPI_SET_SS0_LOW(SPI3);
-    SPI_WRITE_TX0(SPI3, 0x10 | (ColumnAddr >> 4) & 0xF); // Write Data
-    SPI_TRIGGER(SPI3);                                   // Trigger SPI data transfer
-    while (SPI_IS_BUSY(SPI3))
-        ; // Check SPI3 busy status
-    SPI_SET_SS0_HIGH(SPI3);
+    _MLH_LCD_PUSH(0x10 | ((ColumnAddr >> 4) & 0xF));
     // Set CA LSB // (Set column address LSB, 0000____)
+    _MLH_LCD_PUSH(0x00 | (ColumnAddr & 0xF));
+    _MLH_LCD_DRAIN();
+    SPI_SET_SS0_HIGH(SPI3);
+}
+
+/**
+ * @brief Send columns x0 to x1 of a page of lcd buf to the LCD, with the address, under one chip select
+ * @param PageAddr Page address, 0 to 7
+ * @param x0 Column in lcd buf, 0 to 127
+ * @param x1 Column in lcd buf, x0 to 127
+ * @note Buffer column x is on CA (129 - x), so the span is sent from x1 down to x0
+ */
+void mlh_lcdWriteSpan(uint8_t PageAddr, uint8_t x0, uint8_t x1)
+{
+    const uint8_t *p = &mlh_lcd_buffer[PageAddr * LCD_Xmax + x1];
+    const uint8_t *end = &mlh_lcd_buffer[PageAddr * LCD_Xmax + x0] - 1;
+    uint8_t ColumnAddr = (LCD_Xmax + 1) - x1;
+
     SPI_SET_SS0_LOW(SPI3);
-    SPI_WRITE_TX0(SPI3, 0x00 | (ColumnAddr & 0xF)); // Write Data
-    SPI_TRIGGER(SPI3);                              // Trigger SPI data transfer
-    while (SPI_IS_BUSY(SPI3))
-        ; // Check SPI3 busy status
+    _MLH_LCD_PUSH(0xB0 | PageAddr);
+    _MLH_LCD_PUSH(0x10 | ((ColumnAddr >> 4) & 0xF));
+    _MLH_LCD_PUSH(0x00 | (ColumnAddr & 0xF));
+    for (; p != end; --p) {
+        _MLH_LCD_PUSH(0x100 | *p);
+    }
+    _MLH_LCD_DRAIN();
     SPI_SET_SS0_HIGH(SPI3);
 }
 
@@ -777,6 +945,11 @@ void mlh_init_lcd(void)
     mlh_lcdWriteCommand(0xC0); // Set LCD Mapping Control
     mlh_lcdWriteCommand(0xAF); // Set Display Enable
 
+#if defined(MLH_LCD_DYNAMIC_UPDATE)
+    // No dirty spans yet, the clears below mark what they need
+    memset(_mlh_dirty_x0, 0xFF, sizeof(_mlh_dirty_x0));
+    memset(_mlh_dirty_x1, 0, sizeof(_mlh_dirty_x1));
+#endif // defined(MLH_LCD_DYNAMIC_UPDATE)
     mlh_clear_lcd_only();
     mlh_clear_lcd_buf();
 }
@@ -789,22 +962,67 @@ void mlh_clear_lcd_only(void)
     uint16_t i;
     // column address and page address will automatically increment
     mlh_lcdSetAddr(0x00, 0x00);
+    SPI_SET_SS0_LOW(SPI3);
     for (i = 0; i < 132 * 8; i++) {
-        mlh_lcdWriteData(0x00);
+        _MLH_LCD_PUSH(0x100);
     }
+    _MLH_LCD_DRAIN();
+    SPI_SET_SS0_HIGH(SPI3);
 
 #if defined(MLH_LCD_DYNAMIC_UPDATE)
-    // Clear buffer for current lcd content
-    memset(_mlh_current_data_in_lcd, 0, sizeof(_mlh_current_data_in_lcd));
+    // Everything that was drawn is not on the LCD anymore
+    for (i = 0; i < (LCD_Ymax / 8); ++i) {
+        if (_mlh_ink_x0[i] <= _mlh_ink_x1[i]) {
+            _mlh_mark_dirty_span(i, _mlh_ink_x0[i], _mlh_ink_x1[i]);
+        }
+    }
 #endif // defined(MLH_LCD_DYNAMIC_UPDATE)
 }
 
 /**
  * @brief Clear the LCD buffer
+ * @note With MLH_LCD_DYNAMIC_UPDATE, everything drawn since the last clear is sent again by mlh_show_lcd(),
+ *       to update a part of the screen, draw over it instead.
+ *       Waits for the frame submitted to the background flush, so it's not torn
  */
 void mlh_clear_lcd_buf(void)
 {
+#if defined(MLH_LCD_DYNAMIC_UPDATE)
+    uint8_t page;
+    mlh_wait_flush_lcd();
+    // Only the drawn columns become dirty, and start the ink span over
+    for (page = 0; page < (LCD_Ymax / 8); ++page) {
+        if (_mlh_ink_x0[page] <= _mlh_ink_x1[page]) {
+            _mlh_mark_dirty_span(page, _mlh_ink_x0[page], _mlh_ink_x1[page]);
+            memset(&mlh_lcd_buffer[page * LCD_Xmax + _mlh_ink_x0[page]], 0, _mlh_ink_x1[page] - _mlh_ink_x0[page] + 1);
+        }
+        _mlh_ink_x0[page] = 0xFF;
+        _mlh_ink_x1[page] = 0;
+    }
+#else
+    mlh_wait_flush_lcd();
     memset(mlh_lcd_buffer, 0, sizeof(mlh_lcd_buffer));
+#endif // defined(MLH_LCD_DYNAMIC_UPDATE)
+}
+
+/**
+ * @brief Mark a region of the lcd buf as changed, for code that writes mlh_lcd_buffer directly
+ * @param x0 The x0, valid value: 0 to 127
+ * @param y0 The y0, valid value: 0 to 63
+ * @param x1 The x1, valid value: x0 to 127
+ * @param y1 The y1, valid value: y0 to 63
+ * @note The draw functions mark what they write already
+ */
+void mlh_mark_dirty_lcd_buf(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1)
+{
+#if defined(MLH_LCD_DYNAMIC_UPDATE)
+    uint16_t page;
+    for (page = y0 / 8; page <= y1 / 8; ++page) {
+        _mlh_mark_dirty_span(page, x0, x1);
+    }
+#else
+    (void)x0; (void)y0; (void)x1; (void)y1;
+#endif // defined(MLH_LCD_DYNAMIC_UPDATE)
 }
 
 /**
@@ -819,30 +1037,29 @@ void mlh_clear_lcd_buf(void)
  */
 void mlh_show_lcd(void)
 {
-    uint16_t x, y, idx_in_buf;
-    bool flag;
-    for (y = 0; y < (LCD_Ymax / 8); ++y) {
-        mlh_lcdSetAddr(y, 0x02); // Write from the right of the lcd
-        flag = false;
-        for (x = 0; x < LCD_Xmax; ++x) {
-            idx_in_buf = y * LCD_Xmax + ((LCD_Xmax - 1) - x);
-
+    uint16_t y;
 #if defined(MLH_LCD_DYNAMIC_UPDATE)
-            if (mlh_lcd_buffer[idx_in_buf] != _mlh_current_data_in_lcd[idx_in_buf]) {
-                if (flag == true) {
-                    mlh_lcdSetAddr(y, x + 2);
-                    flag = false;
-                }
-                mlh_lcdWriteData(mlh_lcd_buffer[idx_in_buf]);
-                _mlh_current_data_in_lcd[idx_in_buf] = mlh_lcd_buffer[idx_in_buf];
-            } else {
-                flag = true;
-            }
-#else
-            mlh_lcdWriteData(mlh_lcd_buffer[idx_in_buf]);
+    uint8_t s;
 #endif // defined(MLH_LCD_DYNAMIC_UPDATE)
+    uint32_t show_start;
+    // A frame submitted to the background flush is sent first, they share SPI3
+    mlh_wait_flush_lcd();
+    show_start = MLH_LCD_SHOW_BEGIN();
+#if defined(MLH_LCD_DYNAMIC_UPDATE)
+    for (y = 0; y < (LCD_Ymax / 8); ++y) {
+        for (s = 0; s < _MLH_LCD_DIRTY_SPANS; ++s) {
+            if (_mlh_dirty_x0[y][s] > _mlh_dirty_x1[y][s]) continue;
+            mlh_lcdWriteSpan(y, _mlh_dirty_x0[y][s], _mlh_dirty_x1[y][s]);
+            _mlh_dirty_x0[y][s] = 0xFF;
+            _mlh_dirty_x1[y][s] = 0;
         }
     }
+#else
+    for (y = 0; y < (LCD_Ymax / 8); ++y) {
+        mlh_lcdWriteSpan(y, 0, LCD_Xmax - 1); // Write from the right of the lcd
+    }
+#endif // defined(MLH_LCD_DYNAMIC_UPDATE)
+    MLH_LCD_SHOW_END(show_start);
 }
 
 /**
@@ -854,21 +1071,33 @@ void mlh_show_lcd_16_round(bool *done_flag)
 {
     static uint8_t round = 0;
     uint16_t x, x_end, y;
+#if defined(MLH_LCD_DYNAMIC_UPDATE)
+    // The spans are latched at the first round, drawing during the rounds goes to the next frame
+    static uint8_t span_x0[LCD_Ymax / 8][_MLH_LCD_DIRTY_SPANS], span_x1[LCD_Ymax / 8][_MLH_LCD_DIRTY_SPANS];
+    uint8_t s;
+    if (round == 0) {
+        memcpy(span_x0, _mlh_dirty_x0, sizeof(span_x0));
+        memcpy(span_x1, _mlh_dirty_x1, sizeof(span_x1));
+        memset(_mlh_dirty_x0, 0xFF, sizeof(_mlh_dirty_x0));
+        memset(_mlh_dirty_x1, 0, sizeof(_mlh_dirty_x1));
+    }
+#endif // defined(MLH_LCD_DYNAMIC_UPDATE)
     for (y = 0; y < (LCD_Ymax / 8); ++y) {
-        x = round * 8;
-        x_end = x + 8;
-        for (; x < x_end; ++x) {
 #if defined(MLH_LCD_DYNAMIC_UPDATE)
-            if (mlh_lcd_buffer[y * LCD_Xmax + x] != _mlh_current_data_in_lcd[y * LCD_Xmax + x]) {
-                mlh_lcdSetAddr(y, (LCD_Xmax + 1 - x));
-                mlh_lcdWriteData(mlh_lcd_buffer[y * LCD_Xmax + x]);
-                _mlh_current_data_in_lcd[y * LCD_Xmax + x] = mlh_lcd_buffer[y * LCD_Xmax + x];
+        for (s = 0; s < _MLH_LCD_DIRTY_SPANS; ++s) {
+            x = round * 8;
+            x_end = x + 8;
+            if (x < span_x0[y][s]) x = span_x0[y][s];
+            if (x_end > span_x1[y][s] + 1) x_end = span_x1[y][s] + 1;
+            if (x < x_end) {
+                mlh_lcdWriteSpan(y, x, x_end - 1);
             }
+        }
 #else
-            mlh_lcdSetAddr(y, (LCD_Xmax + 1 - x));
-            mlh_lcdWriteData(mlh_lcd_buffer[y * LCD_Xmax + x]);
+        x = round * 8;
+        x_end = x + 8;
+        mlh_lcdWriteSpan(y, x, x_end - 1);
 #endif // defined(MLH_LCD_DYNAMIC_UPDATE)
-        }
     }
     round += 1;
     if (round == 16) {
@@ -877,6 +1106,177 @@ void mlh_show_lcd_16_round(bool *done_flag)
     }
 }
 
+/**
+ * @brief [Internal variable] Column spans of the frame being sent by mlh_step_flush_lcd(), x in lcd buf
+ * @note Volatile, written by the main loop and read by the timer interrupt
+ */
+#if defined(MLH_LCD_DYNAMIC_UPDATE)
+volatile uint8_t _mlh_flush_x0[LCD_Ymax / 8][_MLH_LCD_DIRTY_SPANS];
+volatile uint8_t _mlh_flush_x1[LCD_Ymax / 8][_MLH_LCD_DIRTY_SPANS];
+#else
+volatile uint8_t _mlh_flush_x0[LCD_Ymax / 8][1];
+volatile uint8_t _mlh_flush_x1[LCD_Ymax / 8][1];
+#endif // defined(MLH_LCD_DYNAMIC_UPDATE)
+volatile uint8_t _mlh_flush_page = LCD_Ymax / 8; // The page being sent
+
+/**
+ * @brief Set when the background flush has sent the whole frame, the lcd buf can be drawn again
+ */
+volatile bool mlh_lcd_frame_done = true;
+/**
+ * @brief Set while the main loop calls mlh_step_flush_lcd() itself, instead of the timer interrupt
+ * @note The timer interrupt checks it before stepping, and mlh_wait_flush_lcd() steps the frame out instead of sleeping
+ */
+volatile bool mlh_lcd_flush_polled = false;
+
+/**
+ * @brief Hand the lcd buf over to the background flush, like a buffer swap
+ * @details The LCD is the front buffer and the lcd buf is the back buffer. The changed spans are latched here,
+ *          then mlh_step_flush_lcd() sends them a few bytes at a time, until mlh_lcd_frame_done is set.
+ *          Call it only when mlh_lcd_frame_done is set, and do not draw until it's set again, so no frame tears
+ */
+void mlh_submit_lcd(void)
+{
+    uint16_t y;
+#if defined(MLH_LCD_DYNAMIC_UPDATE)
+    uint8_t s;
+#endif // defined(MLH_LCD_DYNAMIC_UPDATE)
+    for (y = 0; y < (LCD_Ymax / 8); ++y) {
+#if defined(MLH_LCD_DYNAMIC_UPDATE)
+        for (s = 0; s < _MLH_LCD_DIRTY_SPANS; ++s) {
+            _mlh_flush_x0[y][s] = _mlh_dirty_x0[y][s];
+            _mlh_flush_x1[y][s] = _mlh_dirty_x1[y][s];
+            _mlh_dirty_x0[y][s] = 0xFF;
+            _mlh_dirty_x1[y][s] = 0;
+        }
+#else
+        _mlh_flush_x0[y][0] = 0;
+        _mlh_flush_x1[y][0] = LCD_Xmax - 1;
+#endif // defined(MLH_LCD_DYNAMIC_UPDATE)
+    }
+    _mlh_flush_page = 0;
+    mlh_lcd_frame_done = false;
+}
+
+/**
+ * @brief Send at most budget bytes of the submitted frame, for the timer interrupt or an idle slot
+ * @param budget Number of data bytes to send, each piece of a span costs 3 more address words
+ * @note Only one context may call it, and the other LCD functions must not be used while a frame is sent
+ */
+void mlh_step_flush_lcd(uint16_t budget)
+{
+    const uint8_t spans = sizeof(_mlh_flush_x0[0]);
+    uint8_t y, s, x0, x1;
+    if (mlh_lcd_frame_done) return;
+
+    while (_mlh_flush_page < (LCD_Ymax / 8)) {
+        y = _mlh_flush_page;
+        for (s = 0; s < spans && _mlh_flush_x0[y][s] > _mlh_flush_x1[y][s]; ++s)
+            ;
+        if (s == spans) {
+            _mlh_flush_page += 1;
+            continue;
+        }
+        if (budget == 0) break;
+        x0 = _mlh_flush_x0[y][s];
+        x1 = _mlh_flush_x1[y][s];
+        // Send from the right end of the span, the rest waits for the next step
+        if (x1 - x0 + 1 > budget) x0 = x1 + 1 - budget;
+        mlh_lcdWriteSpan(y, x0, x1);
+        budget -= x1 - x0 + 1;
+        if (x0 == _mlh_flush_x0[y][s]) {
+            _mlh_flush_x0[y][s] = 0xFF;
+            _mlh_flush_x1[y][s] = 0;
+        } else {
+            _mlh_flush_x1[y][s] = x0 - 1;
+        }
+    }
+    if (_mlh_flush_page == (LCD_Ymax / 8)) mlh_lcd_frame_done = true;
+}
+
+/**
+ * @brief Sleep until the background flush has sent the submitted frame, or send the rest here with mlh_lcd_flush_polled
+ */
+void mlh_wait_flush_lcd(void)
+{
+    // Nobody else sends it
+    if (mlh_lcd_flush_polled) {
+        while (!mlh_lcd_frame_done) mlh_step_flush_lcd(MLH_LCD_FLUSH_BUDGET);
+        return;
+    }
+    // With PRIMASK set, an interrupt that comes after the check still wakes the WFI
+    __disable_irq();
+    while (!mlh_lcd_frame_done) {
+        __WFI();
+        __enable_irq();
+        __disable_irq();
+    }
+    __enable_irq();
+}
+
+/**
+ * @brief [Internal function] Set and clear bits of one byte in lcd buf, and mark it dirty if it changed
+ * @param page The page, valid value: 0 to 7
+ * @param x The x position, valid value: 0 to 127
+ * @param set_bits The bits to set
+ * @param clear_bits The bits to clear
+ */
+void _mlh_merge_byte_lcd_buf(uint16_t page, uint16_t x, uint8_t set_bits, uint8_t clear_bits)
+{
+    uint8_t *p = &mlh_lcd_buffer[page * LCD_Xmax + x];
+    uint8_t old = *p;
+    *p = (old | set_bits) & ~clear_bits;
+    if (*p != old) {
+        _MLH_MARK_DIRTY(page, x);
+    }
+}
+
+// Operations of _mlh_fill_region_lcd_buf()
+#define _MLH_FILL_SET    0
+#define _MLH_FILL_CLEAR  1
+#define _MLH_FILL_INVERT 2
+
+/**
+ * @brief [Internal function] Set, clear or invert the pixels from (x0, y0) to (x1, y1), a byte (8 rows) at a time
+ * @param x0 The x0
+ * @param y0 The y0
+ * @param x1 The x1, x1 >= x0
+ * @param y1 The y1, y1 >= y0
+ * @param op _MLH_FILL_SET, _MLH_FILL_CLEAR or _MLH_FILL_INVERT
+ * @note The region is clipped to the LCD
+ */
+void _mlh_fill_region_lcd_buf(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint8_t op)
+{
+    int16_t x, page, row_start, row_end;
+    uint8_t mask, set_bits, clear_bits, invert_bits, old;
+    uint8_t *p;
+
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 > LCD_Xmax - 1) x1 = LCD_Xmax - 1;
+    if (y1 > LCD_Ymax - 1) y1 = LCD_Ymax - 1;
+    if (x0 > x1 || y0 > y1) return;
+
+    for (page = y0 / 8; page <= y1 / 8; ++page) {
+        // Rows of this page inside the region
+        row_start = (y0 > page * 8) ? (y0 % 8) : 0;
+        row_end = (y1 < page * 8 + 7) ? (y1 % 8) : 7;
+        mask = (uint8_t)((0xFF << row_start) & (0xFF >> (7 - row_end)));
+        set_bits = (op == _MLH_FILL_SET) ? mask : 0;
+        clear_bits = (op == _MLH_FILL_CLEAR) ? mask : 0;
+        invert_bits = (op == _MLH_FILL_INVERT) ? mask : 0;
+
+        p = &mlh_lcd_buffer[page * LCD_Xmax + x0];
+        for (x = x0; x <= x1; ++x, ++p) {
+            old = *p;
+            *p = ((old | set_bits) & ~clear_bits) ^ invert_bits;
+            if (*p != old) {
+                _MLH_MARK_DIRTY(page, x);
+            }
+        }
+    }
+}
+
 /**
  * @brief Invert the bits within the region
  * @param x Starting position x, valid value: 0 to 127
@@ -886,15 +1286,10 @@ void mlh_show_lcd_16_round(bool *done_flag)
  */
 void mlh_invert_region_lcd_buf(uint16_t x, uint16_t y, uint16_t width_px, uint16_t height_px)
 {
-    uint16_t i, j;
     // Boundary check
     if (x > (LCD_Xmax - width_px) || y > (LCD_Ymax - height_px)) return;
     // Invert bits in the region
-    for (i = x; i < x + width_px; ++i) {
-        for (j = y; j < y + height_px; ++j) {
-            mlh_lcd_buffer[(j / 8) * LCD_Xmax + i] ^= (0x01 << (j % 8));
-        }
-    }
+    _mlh_fill_region_lcd_buf(x, y, x + width_px - 1, y + height_px - 1, _MLH_FILL_INVERT);
 }
 
 /*
@@ -910,10 +1305,19 @@ void mlh_invert_region_lcd_buf(uint16_t x, uint16_t y, uint16_t width_px, uint16
  */
 void mlh_draw_pixel_lcd_buf(uint16_t x, uint16_t y, uint16_t color)
 {
+#if defined(MLH_LCD_DYNAMIC_UPDATE)
+    uint8_t old = mlh_lcd_buffer[(y / 8) * LCD_Xmax + x];
+#endif // defined(MLH_LCD_DYNAMIC_UPDATE)
     if (color == FG_COLOR)
         mlh_lcd_buffer[(y / 8) * LCD_Xmax + x] |= (0x01 << (y % 8));
     else
         mlh_lcd_buffer[(y / 8) * LCD_Xmax + x] &= (~(0x01 << (y % 8)));
+#if defined(MLH_LCD_DYNAMIC_UPDATE)
+    // Only a real change is dirty, so drawing the same thing again sends nothing
+    if (mlh_lcd_buffer[(y / 8) * LCD_Xmax + x] != old) {
+        _MLH_MARK_DIRTY(y / 8, x);
+    }
+#endif // defined(MLH_LCD_DYNAMIC_UPDATE)
 }
 
 /**
@@ -926,50 +1330,46 @@ void mlh_draw_pixel_lcd_buf(uint16_t x, uint16_t y, uint16_t color)
  */
 void mlh_draw_byte_lcd_buf(const uint8_t pattern, uint16_t x, uint16_t y, uint16_t color)
 {
-    uint16_t k;
-    // Boundary check
-    if (x > (LCD_Xmax) || y > (LCD_Ymax - 8)) return;
-    for (k = 0; k < 8; ++k) {
-        if (pattern & (0x01 << k)) {
-            mlh_draw_pixel_lcd_buf(x, y + k, color);
-        }
-    }
+    // A bitmap of 1 column
+    mlh_draw_bitmap_lcd_buf(&pattern, x, y, 1, 8, color, false);
 }
 
 /**
  * @brief Draws the bitmap to lcd buf
- * @param bitmap The bitmap to draw
+ * @param bitmap The bitmap to draw, in the same layout as lcd buf (a byte is 8 rows of a column)
  * @param x Starting x position, valid value: 0 to (127 - width_px)
  * @param y Starting y position, valid value: 0 to ( 63 - height_px)
  * @param width_px The width of the bitmap
  * @param height_px The height of the bitmap
  * @param color What color the 1s should be, options: FG_COLOR or BG_COLOR
  * @param force_draw Draws the full bitmap to lcd buffer, rather than ignore the 0s
+ * @details Each byte of the bitmap is shifted down by (y % 8) and merged into at most 2 bytes of lcd buf
  */
 void mlh_draw_bitmap_lcd_buf(const uint8_t *bitmap, uint16_t x, uint16_t y, uint16_t width_px, uint16_t height_px, uint16_t color, bool force_draw)
 {
-    uint16_t i, j;
-    uint8_t pattern;
+    uint16_t i, row, page, shift;
+    uint16_t bits, valid, set_bits, clear_bits;
     // Boundary check
     if (x > (LCD_Xmax - width_px) || y > (LCD_Ymax - height_px)) return;
-    for (i = 0; i < width_px; i += 1) {
-        for (j = 0; j < height_px; j += 1) {
-            pattern = bitmap[(j / 8) * width_px + i];
-            // Draws 1s
-            if (pattern & (0x01 << (j % 8))) {
-                // @note This only draws the bits that are 1
-                mlh_draw_pixel_lcd_buf(x + i, y + j, color);
+    shift = y % 8;
+    for (row = 0; row < height_px; row += 8) {
+        page = y / 8 + row / 8;
+        // Rows of this byte that are inside the bitmap
+        valid = (height_px - row >= 8) ? 0xFF : (0xFF >> (8 - (height_px - row)));
+        valid <<= shift;
+        for (i = 0; i < width_px; ++i) {
+            bits = (uint16_t)bitmap[(row / 8) * width_px + i] << shift;
+            // The 1s are drawn in color, and the 0s in the other color if force_draw
+            if (color == FG_COLOR) {
+                set_bits = bits & valid;
+                clear_bits = force_draw ? (~bits & valid) : 0;
+            } else {
+                clear_bits = bits & valid;
+                set_bits = force_draw ? (~bits & valid) : 0;
             }
-            // @note This draws the full bitmap to lcd buffer
-            // Draws 0s if force_draw is enabled
-            else if (force_draw == true) {
-                // if (color == FG_COLOR) {
-                //     mlh_draw_pixel_lcd_buf(x + i, y + j, BG_COLOR);
-                // } else {
-                //     mlh_draw_pixel_lcd_buf(x + i, y + j, FG_COLOR);
-                // }
-                // Or even simpler
-                mlh_draw_pixel_lcd_buf(x + i, y + j, ~(color));
+            _mlh_merge_byte_lcd_buf(page, x + i, set_bits & 0xFF, clear_bits & 0xFF);
+            if (valid >> 8) {
+                _mlh_merge_byte_lcd_buf(page + 1, x + i, set_bits >> 8, clear_bits >> 8);
             }
         }
     }
@@ -1068,20 +1468,17 @@ void mlh_draw_line_lcd_buf(int16_t x1, int16_t y1, int16_t x2, int16_t y2, int16
  */
 void mlh_draw_rectangle_lcd_buf(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color, bool fill)
 {
-    int16_t x, y, tmp;
+    int16_t tmp;
+    uint8_t op = (color == FG_COLOR) ? _MLH_FILL_SET : _MLH_FILL_CLEAR;
     if (x0 > x1) { tmp = x1; x1 = x0; x0 = tmp; }
     if (y0 > y1) { tmp = y1; y1 = y0; y0 = tmp; }
     if (fill) {
-        for (x = x0; x <= x1; x++) {
-            for (y = y0; y <= y1; y++) {
-                mlh_draw_pixel_lcd_buf(x, y, color);
-            }
-        }
+        _mlh_fill_region_lcd_buf(x0, y0, x1, y1, op);
     } else {
-        for (x = x0; x <= x1; x++) mlh_draw_pixel_lcd_buf(x, y0, color);
-        for (y = y0; y <= y1; y++) mlh_draw_pixel_lcd_buf(x0, y, color);
-        for (x = x0; x <= x1; x++) mlh_draw_pixel_lcd_buf(x, y1, color);
-        for (y = y0; y <= y1; y++) mlh_draw_pixel_lcd_buf(x1, y, color);
+        _mlh_fill_region_lcd_buf(x0, y0, x1, y0, op);
+        _mlh_fill_region_lcd_buf(x0, y0, x0, y1, op);
+        _mlh_fill_region_lcd_buf(x0, y1, x1, y1, op);
+        _mlh_fill_region_lcd_buf(x1, y0, x1, y1, op);
     }
 }
 
@@ -1161,32 +1558,26 @@ void mlh_draw_triangle_lcd_buf(int16_t x0, int16_t y0, int16_t x1, int16_t y1, i
  * @param y The y position, valid value: 0 to (64 - 8)
  * @param font_size The font size, valid options: 8 or 5
  * @param ascii_code The ascii code for the character
+ * @note The fonts are in the same layout as lcd buf, so the glyph is drawn from the font table directly
  */
 void mlh_print_char_lcd_buf(uint16_t x, uint16_t y, uint8_t font_size, unsigned char ascii_code)
 {
-    uint16_t i, j, base_idx;
-    uint8_t font_bitmap[8];
+    uint16_t j, base_idx;
     // Check font size and boundary
     if (font_size == 8 && (x <= (LCD_Xmax - 8) && y <= (LCD_Ymax - 8))) {
         base_idx = (ascii_code - 0x20) * 16;
         // Upper half and bottom half
         for (j = 0; j < 2; ++j) {
-            for (i = 0; i < 8; ++i) {
-                font_bitmap[i] = Font8x16[base_idx + j * 8 + i];
-            }
-            mlh_draw_bitmap_lcd_buf(font_bitmap, x, y + j * 8, 8, 8, FG_COLOR, true);
+            mlh_draw_bitmap_lcd_buf(&Font8x16[base_idx + j * 8], x, y + j * 8, 8, 8, FG_COLOR, true);
         }
     } else if (font_size == 5 && (x <= (LCD_Xmax - 5) && y <= (LCD_Ymax - 7))) {
         if (ascii_code < 0x20) ascii_code = 0x20;
         base_idx = (ascii_code - 0x20) * 5;
-        for (i = 0; i < 5; ++i) {
-            font_bitmap[i] = Font5x7[base_idx + i];
-        }
-        mlh_draw_bitmap_lcd_buf(font_bitmap, x, y, 5, 8, FG_COLOR, true);
+        mlh_draw_bitmap_lcd_buf(&Font5x7[base_idx], x, y, 5, 8, FG_COLOR, true);
         // TODO: If I don't need the last line of the font (the bottom line),
         // maybe I can just use below
         // Because the start position (x, y) can be specified by caller
-        // mlh_draw_bitmap_lcd_buf(font_bitmap, x, y, 5, 7, FG_COLOR, true);
+        // mlh_draw_bitmap_lcd_buf(&Font5x7[base_idx], x, y, 5, 7, FG_COLOR, true);
     }
 }
 
@@ -1533,6 +1924,8 @@ void mlh_write_format_text_uart(const char *format, ...)
 
 // TODO: Add I2C EEPROM
 
+#endif // MLH_PROTOTYPES_ONLY
+
 #endif // _MY_LIB_H_
 
 /**
@@ -0,0 +1,123 @@
+/**
+ * @brief Test of the profiler (utils/prof.c), on a PC
+ * @details
+ *   Known times are recorded straight into a probe, the count, min, max, average and the histogram bins must
+ *   match. Then the probes are timed around a busy loop with PROF_START() and PROF_STOP(), like main.c does,
+ *   and the cost of an empty probe is measured, best of RUNS.
+ *   The dump goes through a print function like mlh_write_format_text_uart(), every line must fit in its
+ *   64 bytes buffer (MLH_UART0_BUF_SIZE).
+ * @usage gcc -O2 -Wall -DPROF_HOST -Iutils prof_host_test.c utils/prof.c -o prof_host_test && ./prof_host_test
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "prof.h"
+
+#define UART_BUF_SIZE 64
+#define RUNS 5
+#define EMPTY_PROBES 100000
+
+static int errors = 0;
+static int lines = 0;
+
+// Same as mlh_write_format_text_uart(), but checks the length
+static void print_uart(const char *format, ...)
+{
+    char buf[256];
+    int len;
+    va_list args;
+
+    va_start(args, format);
+    len = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    if (len >= UART_BUF_SIZE) {
+        printf("  line of %d bytes overflows the UART buffer\n", len);
+        errors += 1;
+    }
+    lines += 1;
+    fputs(buf, stdout);
+}
+
+static void test_record(void)
+{
+    // Bins: < 8, < 16, < 32, ... ticks
+    const uint32_t times[] = {3, 7, 8, 15, 16, 100, 100, 5000, 0xFFFFFF};
+    const uint8_t bins[] = {0, 0, 1, 1, 2, 4, 4, 10, PROF_HIST_BINS - 1};
+    uint32_t expected_hist[PROF_HIST_BINS] = {0};
+    uint64_t sum = 0;
+    prof_probe_t p;
+    uint8_t i;
+    int before = errors;
+
+    prof_reset();
+    for (i = 0; i < sizeof(times) / sizeof(times[0]); ++i) {
+        prof_record(PROF_CODEC_WRITE, times[i]);
+        expected_hist[bins[i]] += 1;
+        sum += times[i];
+    }
+    prof_get(PROF_CODEC_WRITE, &p);
+    if (p.count != sizeof(times) / sizeof(times[0]) || p.min != 3 || p.max != 0xFFFFFF || p.sum != sum) {
+        printf("  count %u min %u max %u sum %llu\n", p.count, p.min, p.max, (unsigned long long)p.sum);
+        errors += 1;
+    }
+    for (i = 0; i < PROF_HIST_BINS; ++i) {
+        if (p.hist[i] != expected_hist[i]) {
+            printf("  bin %u has %u, %u expected\n", i, p.hist[i], expected_hist[i]);
+            errors += 1;
+        }
+    }
+    prof_get(PROF_I2S_ISR, &p);
+    if (p.count != 0) errors += 1;
+    printf("Record: %s\n", (errors == before) ? "ok" : "failed");
+}
+
+static void test_probes(void)
+{
+    volatile uint32_t sink = 0;
+    uint32_t start, i, j, best = UINT32_MAX;
+    uint8_t r;
+    prof_probe_t p;
+
+    prof_reset();
+    for (i = 0; i < 1000; ++i) {
+        start = PROF_START();
+        for (j = 0; j < 1000 + (i % 7) * 1000; ++j) sink += j;
+        PROF_STOP(PROF_REFILL_READ, start);
+    }
+    prof_get(PROF_REFILL_READ, &p);
+    if (p.count != 1000 || p.min == 0 || p.max < p.min || p.sum / p.count < p.min || p.sum / p.count > p.max) {
+        printf("  busy loop: count %u min %u max %u\n", p.count, p.min, p.max);
+        errors += 1;
+    }
+
+    // Cost of an empty probe, the clock read twice and the record
+    for (r = 0; r < RUNS; ++r) {
+        uint32_t t0 = prof_host_clock();
+        for (i = 0; i < EMPTY_PROBES; ++i) {
+            start = PROF_START();
+            PROF_STOP(PROF_I2S_ISR, start);
+        }
+        t0 = prof_host_clock() - t0;
+        if (t0 < best) best = t0;
+    }
+    printf("Empty probe: %u ns, best of %d\n", best / EMPTY_PROBES, RUNS);
+
+    printf("\nDump:\n");
+    prof_dump(print_uart);
+    if (lines < 4) {
+        printf("  %d lines dumped\n", lines);
+        errors += 1;
+    }
+}
+
+int main(void)
+{
+    prof_init();
+    test_record();
+    test_probes();
+    printf("\nErrors: %d\n", errors);
+    return (errors == 0) ? 0 : 1;
+}
@@ -0,0 +1,306 @@
+/**
+ * @brief Simulation of seeking in a wav file on the SD card, on a PC
+ * @details
+ *   The real FatFs (FatFs/ff.c) mounts a FAT16 image of a 1 GB SD card, 32 KB clusters, that holds
+ *   a 5 minutes 44.1 kHz stereo wav file. The image is made up when it's read: the boot sector, FAT and
+ *   root directory are built in RAM, and a sector of the file is filled with its frame numbers
+ *   (left = frame & 0xFFFF, right = frame >> 16), so where a read lands can be checked.
+ *
+ *   Each seek does what play_seek() and the refill in main.c do: snap, f_lseek(), then f_read() of the PCM
+ *   buffer. The sectors read are counted, and turned into time with a model of the SD card on SPI1
+ *   (5 MHz, SD_ACCESS_US before each block, SD_BYTE_US per byte including the driver).
+ *   The file is placed in one piece, and in pieces of one cluster (worst case), with and without fast seek.
+ * @usage gcc -O2 -I. -IFatFs -Iutils seek_host_test.c utils/wav_seek.c FatFs/ff.c FatFs/ffunicode.c -o seek_host_test && ./seek_host_test
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "ff.h"
+#include "diskio.h"
+#include "wav_seek.h"
+#include "i2s_play.h"
+
+#define SEEK_CLMT_LEN 32           // Same as main.c
+#define SAMPLE_RATE 44100
+#define SONG_SEC 300
+#define SONG_FRAMES (SAMPLE_RATE * SONG_SEC)
+#define WAV_HEADER_SIZE 44
+
+// Image, 1 GB FAT16
+#define SECTOR_SIZE 512
+#define CLUSTER_SECTORS 64         // 32 KB
+#define TOTAL_SECTORS (2 * 1024 * 1024)
+#define RESERVED_SECTORS 1
+#define FAT_SECTORS 128            // 32768 entries
+#define ROOT_ENTRIES 512
+#define ROOT_SECTORS (ROOT_ENTRIES * 32 / SECTOR_SIZE)
+#define FAT_START RESERVED_SECTORS
+#define ROOT_START (FAT_START + 2 * FAT_SECTORS)
+#define DATA_START (ROOT_START + ROOT_SECTORS)
+#define META_SECTORS DATA_START
+#define CLUSTER_NUM ((TOTAL_SECTORS - DATA_START) / CLUSTER_SECTORS)
+#define FILE_SIZE (WAV_HEADER_SIZE + SONG_FRAMES * 4)
+#define FILE_CLUSTERS ((FILE_SIZE + CLUSTER_SECTORS * SECTOR_SIZE - 1) / (CLUSTER_SECTORS * SECTOR_SIZE))
+
+// SD card model
+#define SD_ACCESS_US 500.0         // Command, and waiting for the data token
+#define SD_BYTE_US 2.0             // 1.6 us on the bus at 5 MHz, plus the driver loop
+
+uint8_t meta[META_SECTORS][SECTOR_SIZE];
+// Cluster of the volume to cluster of the file, -1 if not in the file
+int32_t cluster_to_file[CLUSTER_NUM + 2];
+uint8_t wav_header_bytes[WAV_HEADER_SIZE];
+uint32_t read_calls = 0, read_sectors = 0;
+
+/* -------------------- */
+// The image
+/* -------------------- */
+void put16(uint8_t *p, uint16_t v) { p[0] = v; p[1] = v >> 8; }
+void put32(uint8_t *p, uint32_t v) { put16(p, v); put16(p + 2, v >> 16); }
+
+/**
+ * @brief Build the boot sector, FATs and root directory
+ * @param fragmented Place the clusters of the file on every other cluster, else in one piece
+ */
+void make_image(bool fragmented)
+{
+    uint8_t *bs = meta[0], *dir = meta[ROOT_START];
+    uint32_t i, cl, next;
+
+    memset(meta, 0, sizeof(meta));
+    bs[0] = 0xEB; bs[1] = 0x3C; bs[2] = 0x90;
+    memcpy(bs + 3, "MSDOS5.0", 8);
+    put16(bs + 11, SECTOR_SIZE);
+    bs[13] = CLUSTER_SECTORS;
+    put16(bs + 14, RESERVED_SECTORS);
+    bs[16] = 2;
+    put16(bs + 17, ROOT_ENTRIES);
+    put16(bs + 19, 0);
+    bs[21] = 0xF8;
+    put16(bs + 22, FAT_SECTORS);
+    put16(bs + 24, 63);
+    put16(bs + 26, 255);
+    put32(bs + 32, TOTAL_SECTORS);
+    bs[36] = 0x80; bs[38] = 0x29;
+    memcpy(bs + 43, "NO NAME    ", 11);
+    memcpy(bs + 54, "FAT16   ", 8);
+    bs[510] = 0x55; bs[511] = 0xAA;
+
+    for (i = 0; i < CLUSTER_NUM + 2; ++i) cluster_to_file[i] = -1;
+    put16(meta[FAT_START], 0xFFF8);
+    put16(meta[FAT_START] + 2, 0xFFFF);
+    for (i = 0; i < FILE_CLUSTERS; ++i) {
+        cl = fragmented ? 2 + 2 * i : 2 + i;
+        next = (i == FILE_CLUSTERS - 1) ? 0xFFFF : (fragmented ? cl + 2 : cl + 1);
+        put16(meta[FAT_START + cl / 256] + (cl % 256) * 2, next);
+        cluster_to_file[cl] = i;
+    }
+    memcpy(meta[FAT_START + FAT_SECTORS], meta[FAT_START], FAT_SECTORS * SECTOR_SIZE);
+
+    memcpy(dir, "SONG    WAV", 11);
+    dir[11] = 0x20;
+    put16(dir + 26, 2);
+    put32(dir + 28, FILE_SIZE);
+
+    memcpy(wav_header_bytes, "RIFF", 4);
+    put32(wav_header_bytes + 4, FILE_SIZE - 8);
+    memcpy(wav_header_bytes + 8, "WAVEfmt ", 8);
+    put32(wav_header_bytes + 16, 16);
+    put16(wav_header_bytes + 20, 1);
+    put16(wav_header_bytes + 22, 2);
+    put32(wav_header_bytes + 24, SAMPLE_RATE);
+    put32(wav_header_bytes + 28, SAMPLE_RATE * 4);
+    put16(wav_header_bytes + 32, 4);
+    put16(wav_header_bytes + 34, 16);
+    memcpy(wav_header_bytes + 36, "data", 4);
+    put32(wav_header_bytes + 40, SONG_FRAMES * 4);
+}
+
+/**
+ * @brief Byte of the wav file at an offset
+ */
+uint8_t file_byte(uint32_t offset)
+{
+    uint32_t frame, k;
+    if (offset < WAV_HEADER_SIZE) return wav_header_bytes[offset];
+    if (offset >= FILE_SIZE) return 0;
+    frame = (offset - WAV_HEADER_SIZE) / 4;
+    k = (offset - WAV_HEADER_SIZE) % 4;
+    return (k < 2) ? (frame >> (8 * k)) & 0xFF : (frame >> (16 + 8 * (k - 2))) & 0xFF;
+}
+
+/* -------------------- */
+// FatFs glue, the image as the drive
+/* -------------------- */
+DSTATUS disk_initialize(BYTE pdrv) { return (pdrv == 0) ? 0 : STA_NOINIT; }
+DSTATUS disk_status(BYTE pdrv) { return (pdrv == 0) ? 0 : STA_NOINIT; }
+
+DRESULT disk_read(BYTE pdrv, BYTE *buff, DWORD sector, UINT count)
+{
+    uint32_t i, k, cl;
+    int32_t file_cl;
+
+    // Same check as FatFs/diskio.c
+    if (pdrv || count == 0) return RES_PARERR;
+    read_calls += 1;
+    read_sectors += count;
+    for (i = 0; i < count; ++i, ++sector, buff += SECTOR_SIZE) {
+        if (sector < META_SECTORS) {
+            memcpy(buff, meta[sector], SECTOR_SIZE);
+            continue;
+        }
+        cl = (sector - DATA_START) / CLUSTER_SECTORS + 2;
+        file_cl = cluster_to_file[cl];
+        for (k = 0; k < SECTOR_SIZE; ++k) {
+            buff[k] = (file_cl < 0) ? 0 : file_byte(file_cl * CLUSTER_SECTORS * SECTOR_SIZE + ((sector - DATA_START) % CLUSTER_SECTORS) * SECTOR_SIZE + k);
+        }
+    }
+    return RES_OK;
+}
+
+DRESULT disk_write(BYTE pdrv, const BYTE *buff, DWORD sector, UINT count)
+{
+    (void)pdrv; (void)buff; (void)sector; (void)count;
+    return RES_WRPRT;
+}
+
+DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void *buff)
+{
+    (void)pdrv; (void)buff;
+    return (cmd == CTRL_SYNC) ? RES_OK : RES_PARERR;
+}
+
+DWORD get_fattime(void)
+{
+    return 0;
+}
+
+/* -------------------- */
+// Tests
+/* -------------------- */
+FATFS fs;
+FIL fp;
+wav_seek_t seek;
+DWORD clmt[SEEK_CLMT_LEN];
+uint16_t refill_buf[PLAY_PCM_BUFF_SIZE];  // The PCM buffer of the player
+int errors = 0;
+
+/**
+ * @brief Estimated time of the SD card reads since the counters were cleared
+ */
+double sd_time_us(void)
+{
+    return read_calls * SD_ACCESS_US + read_sectors * SECTOR_SIZE * SD_BYTE_US;
+}
+
+/**
+ * @brief Open the song like open_wav_file() in main.c
+ * @param fast_seek Map the clusters for fast seek
+ */
+void open_song(bool fast_seek)
+{
+    uint8_t header[64];
+    UINT n;
+
+    if (f_open(&fp, "SONG.WAV", FA_READ) != FR_OK) {
+        printf("can't open the song\n");
+        exit(1);
+    }
+    f_read(&fp, header, sizeof(header), &n);
+    read_calls = read_sectors = 0;
+    wav_seek_open(&seek, &fp, WAV_HEADER_SIZE, SONG_FRAMES * 4, 4, fast_seek ? clmt : NULL, SEEK_CLMT_LEN);
+    printf("  open: fast seek %s, CLMT needs %u DWORDs (%d given), %u sector reads\n", seek.fast_seek ? "on" : "off",
+           fast_seek ? (unsigned)clmt[0] : 0, fast_seek ? SEEK_CLMT_LEN : 0, read_sectors);
+}
+
+/**
+ * @brief Play from a frame, seek, and refill, like play_seek() and the refill in main.c
+ * @param from Frame being played
+ * @param delta_sec Seconds to jump
+ * @return Estimated time from the key to the new samples, in us
+ */
+double seek_once(uint32_t from, int32_t delta_sec)
+{
+    uint32_t frame, got;
+    int64_t target = (int64_t)from + (int64_t)delta_sec * SAMPLE_RATE;
+    UINT n;
+
+    // Playing at from, the file is after the buffer that is being played
+    wav_seek_to_frame(&seek, &fp, from);
+    f_read(&fp, refill_buf, sizeof(refill_buf), &n);
+
+    read_calls = read_sectors = 0;
+    frame = wav_seek_snap(&seek, target);
+    wav_seek_to_frame(&seek, &fp, frame);
+    f_read(&fp, refill_buf, sizeof(refill_buf), &n);
+
+    // The samples are from the snapped frame, it's on a sector boundary, and at most a sector before the target
+    got = refill_buf[0] | ((uint32_t)refill_buf[1] << 16);
+    if (target < 0) target = 0;
+    if (target > SONG_FRAMES - 1) target = SONG_FRAMES - 1;
+    if (got != frame || (frame != 0 && (WAV_HEADER_SIZE + frame * 4) % SECTOR_SIZE != 0) ||
+        frame > target || target - frame >= SECTOR_SIZE / 4) {
+        errors += 1;
+    }
+    return sd_time_us();
+}
+
+/**
+ * @brief Seeks from many places of the song, print the average and the worst
+ * @param name Name of the seek
+ * @param delta_sec Seconds to jump
+ */
+void seek_from_everywhere(const char *name, int32_t delta_sec)
+{
+    uint32_t i, n = 200, worst_sectors = 0, sectors = 0;
+    double t, sum = 0, worst = 0;
+
+    for (i = 0; i < n; ++i) {
+        t = seek_once((uint32_t)((uint64_t)SONG_FRAMES * i / n), delta_sec);
+        sum += t;
+        sectors += read_sectors;
+        if (t > worst) {
+            worst = t;
+            worst_sectors = read_sectors;
+        }
+    }
+    printf("  %-14s avg %5.1f ms (%4.1f sectors)  worst %5.1f ms (%3u sectors)\n", name,
+           sum / n / 1000, (double)sectors / n, worst / 1000, worst_sectors);
+}
+
+/**
+ * @brief Seeks of a layout of the file
+ * @param fragmented Layout of the file
+ * @param fast_seek Use fast seek
+ */
+void test_layout(bool fragmented, bool fast_seek)
+{
+    printf("%s file, fast seek %s\n", fragmented ? "Fragmented (1 cluster pieces)" : "Contiguous",
+           fast_seek ? "requested" : "off");
+    make_image(fragmented);
+    f_mount(&fs, "", 1);
+    open_song(fast_seek);
+    seek_from_everywhere("+5 s", 5);
+    seek_from_everywhere("-5 s", -5);
+    seek_from_everywhere("+30 s", 30);
+    seek_from_everywhere("-30 s", -30);
+    seek_from_everywhere("scan +2 s", 2);
+    seek_from_everywhere("to the start", -SONG_SEC);
+    f_close(&fp);
+    f_mount(NULL, "", 0);
+}
+
+int main(void)
+{
+    printf("Song %d s, %u clusters of 32 KB, SD model %.0f us a block + %.1f us a byte\n\n",
+           SONG_SEC, (unsigned)FILE_CLUSTERS, SD_ACCESS_US, SD_BYTE_US);
+    test_layout(false, true);
+    test_layout(false, false);
+    test_layout(true, true);
+    test_layout(true, false);
+    printf("\nSeek errors: %d\n", errors);
+    return (errors == 0) ? 0 : 1;
+}
@@ -0,0 +1,179 @@
+/**
+ * @brief Decoder of the binary event trace (utils/trace.h), on a PC
+ * @details
+ *   Reads the raw bytes drained from the player, from the UART (saved by a terminal) or from the trace file
+ *   on the SD card, prints each record with its time and named arguments, then a summary per event:
+ *   count, and the interval between two records of the same event, min / avg / max.
+ *   Bytes that aren't records, like a profiler dump on the same UART, are skipped and counted,
+ *   a gap in the sequence numbers is reported as records lost on the way, DROPPED records as lost in the ring.
+ *   The timestamps wrap around, they are unwrapped from one record to the next. The clock comes from the
+ *   START record, 12 MHz (timer 0 counts, see ui_timestamp()) until one is seen.
+ * @usage gcc -O2 -Wall -DTRACE_HOST -Iutils trace_decode.c -o trace_decode
+ *   ./trace_decode trace.bin       // Records and summary
+ *   ./trace_decode -s trace.bin    // Summary only
+ *   ./trace_decode < trace.bin
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "trace.h"
+
+#define DEFAULT_CLOCK_HZ 12000000
+
+typedef struct event_info_t {
+    const char *name;
+    const char *a;
+    const char *b;
+} event_info_t;
+
+static const event_info_t events[TRACE_ID_NUM] = {
+#define TRACE_INFO(name, a, b) {#name, a, b},
+    TRACE_EVENTS(TRACE_INFO)
+#undef TRACE_INFO
+};
+
+typedef struct event_stats_t {
+    uint32_t count;
+    int64_t last;
+    int64_t min_gap;
+    int64_t max_gap;
+    int64_t sum_gap;
+} event_stats_t;
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void parse(const uint8_t *p, trace_rec_t *r)
+{
+    r->time = get_u32(p);
+    r->magic = p[4];
+    r->id = p[5];
+    r->seq = (uint16_t)(p[6] | (p[7] << 8));
+    r->a = get_u32(p + 8);
+    r->b = get_u32(p + 12);
+}
+
+static bool is_record(const uint8_t *p)
+{
+    return p[4] == TRACE_MAGIC && p[5] < TRACE_ID_NUM;
+}
+
+static uint8_t *read_all(FILE *f, size_t *len)
+{
+    size_t cap = 1 << 16, n;
+    uint8_t *buf = malloc(cap);
+
+    *len = 0;
+    while (buf != NULL && (n = fread(buf + *len, 1, cap - *len, f)) > 0) {
+        *len += n;
+        if (*len == cap) {
+            cap *= 2;
+            buf = realloc(buf, cap);
+        }
+    }
+    return buf;
+}
+
+static double to_us(int64_t ticks, uint32_t hz)
+{
+    return (double)ticks * 1000000.0 / hz;
+}
+
+int main(int argc, char **argv)
+{
+    bool summary_only = false;
+    const char *path = NULL;
+    FILE *f = stdin;
+    uint8_t *buf;
+    size_t len, pos = 0;
+    trace_rec_t r;
+    event_stats_t stats[TRACE_ID_NUM];
+    uint32_t hz = DEFAULT_CLOCK_HZ, records = 0, skipped = 0, lost = 0, dropped = 0, last_time = 0;
+    uint16_t seq = 0;
+    bool have_seq = false, have_time = false, synced = false;
+    int64_t t = 0;
+    int i;
+
+    for (i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-s") == 0) summary_only = true;
+        else path = argv[i];
+    }
+    if (path != NULL && (f = fopen(path, "rb")) == NULL) {
+        fprintf(stderr, "Can't open %s\n", path);
+        return 1;
+    }
+    buf = read_all(f, &len);
+    if (f != stdin) fclose(f);
+    if (buf == NULL) return 1;
+    memset(stats, 0, sizeof(stats));
+
+    while (pos + TRACE_REC_SIZE <= len) {
+        // Out of sync, after garbage, the next record must line up too, unless it's the last
+        if (!is_record(&buf[pos]) ||
+            (!synced && pos + 2 * TRACE_REC_SIZE <= len && !is_record(&buf[pos + TRACE_REC_SIZE]))) {
+            synced = false;
+            pos += 1;
+            skipped += 1;
+            continue;
+        }
+        synced = true;
+        parse(&buf[pos], &r);
+        pos += TRACE_REC_SIZE;
+        records += 1;
+
+        // Unwrap the time, relative to the first record
+        if (have_time) t += (int32_t)(r.time - last_time);
+        have_time = true;
+        last_time = r.time;
+
+        if (r.id == TRACE_START) {
+            hz = r.a;
+            have_seq = false;
+        }
+        if (r.id == TRACE_DROPPED) {
+            dropped += r.a;
+        } else {
+            if (have_seq && r.seq != (uint16_t)(seq + 1)) lost += (uint16_t)(r.seq - seq - 1);
+            have_seq = true;
+            seq = r.seq;
+        }
+
+        if (stats[r.id].count > 0) {
+            int64_t gap = t - stats[r.id].last;
+            if (stats[r.id].count == 1 || gap < stats[r.id].min_gap) stats[r.id].min_gap = gap;
+            if (gap > stats[r.id].max_gap) stats[r.id].max_gap = gap;
+            stats[r.id].sum_gap += gap;
+        }
+        stats[r.id].count += 1;
+        stats[r.id].last = t;
+
+        if (!summary_only) {
+            printf("%12.3f ms  %-12s", to_us(t, hz) / 1000.0, events[r.id].name);
+            if (strcmp(events[r.id].a, "-") != 0) printf("  %s=%u", events[r.id].a, r.a);
+            if (strcmp(events[r.id].b, "-") != 0) printf("  %s=%u", events[r.id].b, r.b);
+            printf("\n");
+        }
+    }
+    skipped += (uint32_t)(len - pos);
+
+    printf("\n%u records over %.3f ms, clock %u Hz\n", records, to_us(t, hz) / 1000.0, hz);
+    printf("%u bytes skipped, %u records lost after the ring, %u dropped in the ring\n", skipped, lost, dropped);
+    printf("%-12s %8s %12s %12s %12s\n", "event", "count", "min us", "avg us", "max us");
+    for (i = 0; i < TRACE_ID_NUM; ++i) {
+        if (stats[i].count == 0) continue;
+        if (stats[i].count == 1) {
+            printf("%-12s %8u\n", events[i].name, stats[i].count);
+        } else {
+            printf("%-12s %8u %12.1f %12.1f %12.1f\n", events[i].name, stats[i].count, to_us(stats[i].min_gap, hz),
+                   to_us(stats[i].sum_gap / (stats[i].count - 1), hz), to_us(stats[i].max_gap, hz));
+        }
+    }
+    free(buf);
+    return 0;
+}
@@ -0,0 +1,162 @@
+/**
+ * @brief Stress test of the event trace (utils/trace.c), on a PC
+ * @details
+ *   Several producer threads write records with TRACE() at the same time, like the IRQ handlers and the
+ *   main loop, and one consumer thread drains them into memory through a sink that takes a random
+ *   number of bytes each call, like a UART FIFO with a few free bytes. The timestamps come from one
+ *   shared counter that starts just below the wrap around.
+ *
+ *   A record carries its producer in b and the producer's own count in a, so the stream can be checked:
+ *   every record has the magic byte and the next sequence number, comes from a known producer, in order,
+ *   and the records that are missing add up to the DROPPED records.
+ *   The stream is saved as /tmp/trace_test.bin (STREAM_PATH), with a line of text in the middle like a profiler dump on the
+ *   same UART, for trying the decoder.
+ * @usage gcc -O2 -Wall -pthread -DTRACE_HOST -Iutils trace_host_test.c utils/trace.c -o trace_host_test && ./trace_host_test
+ *   Then: ./trace_decode /tmp/trace_test.bin
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "trace.h"
+
+#define PRODUCER_NUM 3
+#define RECORDS_PER_PRODUCER 200000
+#define STREAM_SIZE ((PRODUCER_NUM * RECORDS_PER_PRODUCER + 1) * TRACE_REC_SIZE * 2)
+// Out of the source tree, for trace_decode
+#define STREAM_PATH "/tmp/trace_test.bin"
+
+static const trace_id_t producer_id[PRODUCER_NUM] = {TRACE_KEY, TRACE_REFILL_REQ, TRACE_HCLK};
+static atomic_uint clock_count;
+static atomic_int producers_running;
+static uint8_t *stream;
+static uint32_t stream_len = 0;
+static unsigned sink_seed = 1;
+static int errors = 0;
+
+static uint32_t now(void)
+{
+    return atomic_fetch_add(&clock_count, 1);
+}
+
+// Takes 1 to 16 bytes, sometimes none
+static uint32_t sink(const uint8_t *data, uint32_t len)
+{
+    uint32_t n;
+
+    sink_seed = sink_seed * 1103515245u + 12345u;
+    n = (sink_seed >> 16) % (TRACE_REC_SIZE + 1);
+    if (n > len) n = len;
+    memcpy(&stream[stream_len], data, n);
+    stream_len += n;
+    return n;
+}
+
+static void *producer(void *arg)
+{
+    uint32_t p = (uint32_t)(uintptr_t)arg, i;
+
+    for (i = 0; i < RECORDS_PER_PRODUCER; ++i) {
+        trace_write(producer_id[p], i, p);
+        if ((i & 0xF) == 0) sched_yield();
+    }
+    atomic_fetch_sub(&producers_running, 1);
+    return NULL;
+}
+
+static void *consumer(void *arg)
+{
+    (void)arg;
+    while (atomic_load(&producers_running) > 0 || trace_pending()) {
+        if (trace_drain(sink, 64) == 0) sched_yield();
+    }
+    return NULL;
+}
+
+static void check_stream(void)
+{
+    trace_rec_t r;
+    uint32_t pos, received = 0, dropped = 0, next_a[PRODUCER_NUM] = {0};
+    uint16_t seq = 0;
+    bool first = true;
+
+    if (stream_len % TRACE_REC_SIZE != 0) {
+        printf("  stream of %u bytes, not whole records\n", stream_len);
+        errors += 1;
+    }
+    for (pos = 0; pos + TRACE_REC_SIZE <= stream_len; pos += TRACE_REC_SIZE) {
+        memcpy(&r, &stream[pos], TRACE_REC_SIZE);
+        if (r.magic != TRACE_MAGIC || r.id >= TRACE_ID_NUM) {
+            printf("  bad record at %u\n", pos);
+            errors += 1;
+            return;
+        }
+        if (r.id == TRACE_DROPPED) {
+            dropped += r.a;
+            continue;
+        }
+        if (!first && r.seq != (uint16_t)(seq + 1)) {
+            printf("  seq %u after %u\n", r.seq, seq);
+            errors += 1;
+        }
+        first = false;
+        seq = r.seq;
+        if (r.id == TRACE_START) continue;
+        if (r.b >= PRODUCER_NUM || r.id != producer_id[r.b] || r.a < next_a[r.b]) {
+            printf("  record %u of producer %u out of order or corrupt\n", r.a, r.b);
+            errors += 1;
+            continue;
+        }
+        next_a[r.b] = r.a + 1;
+        received += 1;
+    }
+    printf("%u records received, %u dropped, of %u\n", received, dropped, PRODUCER_NUM * RECORDS_PER_PRODUCER);
+    if (received + dropped != PRODUCER_NUM * RECORDS_PER_PRODUCER) {
+        printf("  %d records lost without a DROPPED record\n", (int)(PRODUCER_NUM * RECORDS_PER_PRODUCER - received - dropped));
+        errors += 1;
+    }
+}
+
+static void save_stream(const char *path)
+{
+    const char text[] = "refill_read: 1000 x, 1.1/11.8/141.4 us\n";
+    uint32_t half = (stream_len / TRACE_REC_SIZE / 2) * TRACE_REC_SIZE + 5;
+    FILE *f = fopen(path, "wb");
+
+    if (f == NULL) return;
+    // Text in the middle of a record, the decoder has to find the records again
+    fwrite(stream, 1, half, f);
+    fwrite(text, 1, sizeof(text) - 1, f);
+    fwrite(&stream[half], 1, stream_len - half, f);
+    fclose(f);
+    printf("Saved %s\n", path);
+}
+
+int main(void)
+{
+    pthread_t producers[PRODUCER_NUM], cons;
+    uint32_t p;
+
+    stream = malloc(STREAM_SIZE);
+    atomic_store(&clock_count, 0xFFFFFF00u);
+    trace_init(now, 1000000);
+    atomic_store(&producers_running, PRODUCER_NUM);
+    pthread_create(&cons, NULL, consumer, NULL);
+    for (p = 0; p < PRODUCER_NUM; ++p) {
+        pthread_create(&producers[p], NULL, producer, (void *)(uintptr_t)p);
+    }
+    for (p = 0; p < PRODUCER_NUM; ++p) pthread_join(producers[p], NULL);
+    pthread_join(cons, NULL);
+
+    check_stream();
+    save_stream(STREAM_PATH);
+    free(stream);
+    printf("\nErrors: %d\n", errors);
+    return (errors == 0) ? 0 : 1;
+}
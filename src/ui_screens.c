@@ -0,0 +1,107 @@
+#include "ui_screens.h"
+
+#define MLH_LCD
+#define MLH_PROTOTYPES_ONLY
+#include "myLib.h"
+
+/**
+ * @brief Draws the screens shown when the program starts
+ * @param page 0: the program name and author, 1: the usage
+ */
+void ui_draw_start(uint8_t page)
+{
+    if (page == 0) {
+        mlh_print_line_lcd_buf(0, 0 * 16, 8, "   WAV PLAYER   ");
+        mlh_print_line_lcd_buf(0, 1 * 16, 8, "Author          ");
+        mlh_print_line_lcd_buf(0, 2 * 16, 8, "    Jorden Huang");
+        mlh_print_line_lcd_buf(0, 3*16+8, 5, "Press any key to continue...");
+    } else {
+        mlh_print_line_lcd_buf(0, 0 * 16, 8, "     2 to UP    ");
+        mlh_print_line_lcd_buf(0, 0 * 16, 5, "Usage");
+        mlh_print_line_lcd_buf(0, 1 * 16, 8, "     5 to select");
+        mlh_print_line_lcd_buf(0, 2 * 16, 8, "     8 to DOWN  ");
+        mlh_print_line_lcd_buf(0, 3*16,   5, "Use INT1 to quit song ");
+        mlh_print_line_lcd_buf(0, 3*16+8, 5, "Press any key to start");
+    }
+}
+
+/**
+ * @brief Draws the scroll bar on the right of the LCD, erasing the old one
+ * @param idx index of the selected item
+ * @param num number of items
+ */
+void ui_draw_scroll_bar(uint16_t idx, uint16_t num)
+{
+    uint16_t top = idx * LCD_Ymax / num;
+    uint16_t bottom = (idx + 1) * LCD_Ymax / num - 1;
+    // Only the part outside the bar is erased, so the unchanged pixels stay clean
+    if (top > 0) mlh_draw_rectangle_lcd_buf(LCD_Xmax-UI_SCROLL_BAR_WIDTH, 0, LCD_Xmax-1, top - 1, BG_COLOR, true);
+    if (bottom < LCD_Ymax - 1) mlh_draw_rectangle_lcd_buf(LCD_Xmax-UI_SCROLL_BAR_WIDTH, bottom + 1, LCD_Xmax-1, LCD_Ymax-1, BG_COLOR, true);
+    mlh_draw_rectangle_lcd_buf(LCD_Xmax-UI_SCROLL_BAR_WIDTH, top, LCD_Xmax-1, bottom, FG_COLOR, true);
+}
+
+/**
+ * @brief Draws the modes for selection
+ * @param idx index of the selected mode
+ * @param num number of modes, at most 3
+ * @param name name of each mode
+ */
+void ui_draw_mode_menu(uint16_t idx, uint16_t num, ui_name_fn name)
+{
+    uint16_t i, offset = 8;
+    ui_draw_scroll_bar(idx, num);
+    mlh_print_line_lcd_buf(0, 0, 5, "Mode selection");
+    for (i = 0; i < num; ++i) {
+        mlh_print_line_lcd_buf(0, i * 16 + offset, 8, (i == idx) ? "> " : "  ");
+        mlh_print_line_lcd_buf(2 * 8, i * 16 + offset, 8, "%s", name(i));
+    }
+}
+
+/**
+ * @brief Draws 4 lines of the songs for selection
+ * @param idx index of the selected song
+ * @param line line of the selected song on the lcd
+ * @param num number of songs
+ * @param name file name of each song
+ */
+void ui_draw_song_menu(uint16_t idx, uint16_t line, uint16_t num, ui_name_fn name)
+{ // TODO: top line shows "Song selection", only when 0 <= idx <= 2 ,(only shows 3 lines of option)
+    uint16_t i;
+    ui_draw_scroll_bar(idx, num);
+    idx -= line;
+    for (i = 0; i < 4; ++i) {
+        // Names are padded to 8.3, to erase the longer name that was there
+        if (idx + i < num) {
+            mlh_print_line_lcd_buf(0, i * 16, 8, (i == line) ? "> " : "  ");
+            mlh_print_line_lcd_buf(2 * 8, i * 16, 8, "%-12s", name(idx + i));
+        }
+    }
+}
+
+/**
+ * @brief Draws the now playing screen
+ * @param file_name file name of the song
+ * @param paused true to show "Paused"
+ * @param elapsed elapsed seconds of the song
+ * @param remaining remaining seconds of the song
+ */
+void ui_draw_now_playing(const char *file_name, bool paused, uint32_t elapsed, uint32_t remaining)
+{
+    mlh_print_line_lcd_buf(2 * 8, 1 * 16, 8, "%s", file_name);
+    ui_draw_play_status(paused, elapsed, remaining);
+    mlh_print_line_lcd_buf(0, 3*16+8, 5, "5:pause 9:FFT 8:tone");
+}
+
+/**
+ * @brief Draws "Now playing" or "Paused", and the elapsed and remaining time of the song, "mm:ss / -mm:ss"
+ * @param paused true to show "Paused"
+ * @param elapsed elapsed seconds of the song
+ * @param remaining remaining seconds of the song
+ */
+void ui_draw_play_status(bool paused, uint32_t elapsed, uint32_t remaining)
+{
+    // Padded, to erase the longer one
+    mlh_print_line_lcd_buf(0, 0 * 16, 8, "%-11s", paused ? "Paused" : "Now playing");
+    mlh_print_line_lcd_buf(0, 2 * 16, 8, "%02u:%02u / -%02u:%02u",
+                           elapsed / 60 % 100, elapsed % 60, remaining / 60 % 100, remaining % 60);
+}
@@ -0,0 +1,30 @@
+/**
+ * @brief The screens of the player, drawn into the lcd buf of myLib.h
+ * @details
+ *   Only the drawing is here, the caller waits for the LCD, clears the lcd buf when a screen is entered,
+ *   and flushes it. The menus and the play status are drawn over the last frame without clearing, so
+ *   only what changed is sent to the LCD.
+ *   main.c shows them on the LCD, and lcd_host_test.c checks them on the emulated LCD, both with this file.
+ */
+
+#ifndef _UI_SCREENS_H_
+#define _UI_SCREENS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define UI_SCROLL_BAR_WIDTH 5
+
+/**
+ * @brief Name of item idx of a menu
+ */
+typedef const char *(*ui_name_fn)(uint16_t idx);
+
+void ui_draw_start(uint8_t page);
+void ui_draw_scroll_bar(uint16_t idx, uint16_t num);
+void ui_draw_mode_menu(uint16_t idx, uint16_t num, ui_name_fn name);
+void ui_draw_song_menu(uint16_t idx, uint16_t line, uint16_t num, ui_name_fn name);
+void ui_draw_now_playing(const char *file_name, bool paused, uint32_t elapsed, uint32_t remaining);
+void ui_draw_play_status(bool paused, uint32_t elapsed, uint32_t remaining);
+
+#endif // _UI_SCREENS_H_
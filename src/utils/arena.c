@@ -0,0 +1,74 @@
+#include <stddef.h>
+
+#include "arena.h"
+
+/**
+ * @brief Set up an empty arena
+ * @param a The arena
+ * @param base The region, aligned to ARENA_ALIGN
+ * @param size Bytes of the region
+ */
+void arena_init(arena_t *a, void *base, uint32_t size)
+{
+    a->base = (uint8_t *)base;
+    a->size = size;
+    a->top = 0;
+    a->peak = 0;
+    a->failed = 0;
+}
+
+/**
+ * @brief Carve a buffer, not cleared
+ * @param a The arena
+ * @param size Bytes
+ * @return The buffer, aligned to ARENA_ALIGN, or NULL if it doesn't fit (counted in failed)
+ */
+void *arena_alloc(arena_t *a, uint32_t size)
+{
+    uint32_t start = (a->top + ARENA_ALIGN - 1) & ~(uint32_t)(ARENA_ALIGN - 1);
+
+    if (start > a->size || size > a->size - start) {
+        a->failed += 1;
+        return NULL;
+    }
+    a->top = start + size;
+    if (a->top > a->peak) a->peak = a->top;
+    return a->base + start;
+}
+
+/**
+ * @brief Where the next buffer would be carved, for arena_release()
+ * @param a The arena
+ */
+uint32_t arena_mark(const arena_t *a)
+{
+    return a->top;
+}
+
+/**
+ * @brief Free every buffer carved since the mark, the older ones stay
+ * @param a The arena
+ * @param mark From arena_mark()
+ */
+void arena_release(arena_t *a, uint32_t mark)
+{
+    if (mark < a->top) a->top = mark;
+}
+
+/**
+ * @brief Free every buffer
+ * @param a The arena
+ */
+void arena_reset(arena_t *a)
+{
+    a->top = 0;
+}
+
+/**
+ * @brief Bytes left, the largest buffer that can still be carved is up to ARENA_ALIGN - 1 less
+ * @param a The arena
+ */
+uint32_t arena_free(const arena_t *a)
+{
+    return a->size - a->top;
+}
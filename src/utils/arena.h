@@ -0,0 +1,42 @@
+/**
+ * @brief Static arena, buffers with the lifetime of a mode carved out of one region
+ * @details
+ *   arena_alloc() takes the next bytes of the region, there is no free of a single buffer.
+ *   arena_mark() and arena_release() free everything carved after the mark at once, arena_reset() frees all,
+ *   both only move the top back. So a mode carves its buffers when it starts, sized for that mode alone,
+ *   and they are gone when it leaves, the next mode gets the whole region again.
+ *   A buffer that doesn't fit isn't carved, arena_alloc() returns NULL, nothing is ever allocated from a heap.
+ *   Not for interrupt handlers, the region belongs to the main loop.
+ */
+
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <stdint.h>
+
+#define ARENA_ALIGN 8   // Every buffer starts on this, enough for any type
+
+/**
+ * @brief Arena state, the region is given by the user
+ */
+typedef struct arena_t {
+    uint8_t *base;
+    uint32_t size;
+    uint32_t top;       // Bytes carved
+    uint32_t peak;      // Most bytes ever carved, for sizing the region
+    uint16_t failed;    // Buffers that didn't fit
+} arena_t;
+
+// Carves a buffer of count elements of type, NULL if it doesn't fit
+#define ARENA_NEW(a, type, count) ((type *)arena_alloc((a), (uint32_t)sizeof(type) * (count)))
+// Bytes of the region a buffer of count elements of type takes, with the alignment, to size a region at compile time
+#define ARENA_SIZE_OF(type, count) (((uint32_t)sizeof(type) * (count) + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN)
+
+void arena_init(arena_t *a, void *base, uint32_t size);
+void *arena_alloc(arena_t *a, uint32_t size);
+uint32_t arena_mark(const arena_t *a);
+void arena_release(arena_t *a, uint32_t mark);
+void arena_reset(arena_t *a);
+uint32_t arena_free(const arena_t *a);
+
+#endif // _ARENA_H_
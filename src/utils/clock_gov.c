@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include "MCU_init.h"
+#include "NUC100Series.h"
+#include "clock_gov.h"
+
+/**
+ * @brief Rate of a bus clock that comes from HCLK
+ */
+typedef struct clock_gov_bus_t {
+    uint32_t nominal;    // The rate its driver asked for
+    uint32_t applied;    // The rate the governor set last, 0 before the first change
+} clock_gov_bus_t;
+
+// HCLK of each operating point, the PLL gets as close as it can
+static const uint32_t s_point_hz[CLOCK_GOV_POINT_NUM] = {__HXT, 25000000, 36000000, 50000000};
+static clock_gov_point_t s_point = CLOCK_GOV_50MHZ;
+
+#ifdef MCU_INTERFACE_SPI1
+static clock_gov_bus_t s_spi1;
+#endif
+#ifdef MCU_INTERFACE_SPI3
+static clock_gov_bus_t s_spi3;
+#endif
+#ifdef MCU_INTERFACE_I2C0
+static clock_gov_bus_t s_i2c0;
+#endif
+
+/**
+ * @brief Take the rate of a bus before HCLK changes
+ * @param now The rate of the bus, from the old HCLK
+ * @param bus The bus
+ */
+static void keep_bus_clock(uint32_t now, clock_gov_bus_t *bus)
+{
+    // Changed by its driver since the last switch, like the SD card after its init, otherwise the
+    // nominal rate stays, so the rounding of each point doesn't add up
+    if (now != bus->applied) bus->nominal = now;
+}
+
+/**
+ * @brief Open a timer again for the new HCLK, it keeps running if it was
+ * @param timer The timer
+ * @param mode Same as TIMER_Open()
+ * @param freq Same as TIMER_Open()
+ */
+static void reopen_timer(TIMER_T *timer, uint32_t mode, uint32_t freq)
+{
+    // TIMER_Open() stops the timer and disables its interrupt
+    uint32_t keep = timer->TCSR & (TIMER_TCSR_CEN_Msk | TIMER_TCSR_IE_Msk | TIMER_TCSR_TDR_EN_Msk);
+    TIMER_Open(timer, mode, freq);
+    timer->TCSR |= keep;
+}
+
+/**
+ * @brief Start from the HCLK SYS_Init() has set, call it once after SYS_Init()
+ */
+void clock_gov_init(void)
+{
+    uint8_t i;
+
+    s_point = CLOCK_GOV_50MHZ;
+    for (i = 0; i < CLOCK_GOV_POINT_NUM; ++i) {
+        if (CLK_GetHCLKFreq() <= s_point_hz[i]) {
+            s_point = (clock_gov_point_t)i;
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Switch HCLK to an operating point, and derive the bus clocks again
+ * @param point The operating point
+ * @return false if point is out of range
+ * @note No SPI or I2C transfer may start until it returns. The SD card and the codec are only used by the main loop,
+ *       the caller masks the interrupts that use a bus, like timer 0 for the background flush of the LCD,
+ *       see hclk_set_point() of main.c
+ */
+bool clock_gov_set_point(clock_gov_point_t point)
+{
+    if (point >= CLOCK_GOV_POINT_NUM) return false;
+    if (point == s_point) return true;
+
+    // The rates the drivers set, from the old HCLK
+#ifdef MCU_INTERFACE_SPI1
+    while (SPI_IS_BUSY(SPI1));
+    keep_bus_clock(SPI_GetBusClock(SPI1), &s_spi1);
+#endif
+#ifdef MCU_INTERFACE_SPI3
+    while (SPI_IS_BUSY(SPI3));
+    keep_bus_clock(SPI_GetBusClock(SPI3), &s_spi3);
+#endif
+#ifdef MCU_INTERFACE_I2C0
+    keep_bus_clock(I2C_GetBusClockFreq(I2C0), &s_i2c0);
+#endif
+
+    SYS_UnlockReg();
+    // Off the PLL before it changes, the HXT always runs
+    CLK_SetHCLK(CLK_CLKSEL0_HCLK_S_HXT, CLK_CLKDIV_HCLK(1));
+    if (point == CLOCK_GOV_12MHZ) {
+        CLK_DisablePLL();
+    } else {
+        // Waits for the PLL to lock, the interrupts run from the HXT meanwhile
+        CLK_EnablePLL(CLK_PLLCON_PLL_SRC_HXT, s_point_hz[point]);
+        CLK_SetHCLK(CLK_CLKSEL0_HCLK_S_PLL, CLK_CLKDIV_HCLK(1));
+    }
+    SYS_LockReg();
+    s_point = point;
+
+#ifdef MCU_INTERFACE_SPI1
+    s_spi1.applied = SPI_SetBusClock(SPI1, s_spi1.nominal);
+#endif
+#ifdef MCU_INTERFACE_SPI3
+    s_spi3.applied = SPI_SetBusClock(SPI3, s_spi3.nominal);
+#endif
+#ifdef MCU_INTERFACE_I2C0
+    s_i2c0.applied = I2C_SetBusClockFreq(I2C0, s_i2c0.nominal);
+#endif
+#ifdef TMR0_CLOCK_SOURCE_HCLK
+    reopen_timer(TIMER0, TMR0_OPERATING_MODE, TMR0_OPERATING_FREQ);
+#endif
+#ifdef TMR1_CLOCK_SOURCE_HCLK
+    reopen_timer(TIMER1, TMR1_OPERATING_MODE, TMR1_OPERATING_FREQ);
+#endif
+#ifdef TMR2_CLOCK_SOURCE_HCLK
+    reopen_timer(TIMER2, TMR2_OPERATING_MODE, TMR2_OPERATING_FREQ);
+#endif
+#ifdef TMR3_CLOCK_SOURCE_HCLK
+    reopen_timer(TIMER3, TMR3_OPERATING_MODE, TMR3_OPERATING_FREQ);
+#endif
+    return true;
+}
+
+/**
+ * @brief Pick the operating point for the load of the last window, and switch to it
+ * @details The load is turned into cycles per second at the current point. Time spent waiting for a bus
+ *          doesn't shrink with HCLK, so the load at another point is overestimated, never underestimated.
+ *          When the CPU never slept the real load is unknown, it steps up at least one point.
+ * @param awake_permille Time the CPU was awake in the window, per mille
+ * @return The operating point
+ * @note Same as clock_gov_set_point(), no bus may be in use
+ */
+clock_gov_point_t clock_gov_update(uint16_t awake_permille)
+{
+    // Cycles per second, at most 1000 * 50000 kHz, divided by a point in kHz it is the load there in per mille
+    uint32_t demand = (uint32_t)awake_permille * (s_point_hz[s_point] / 1000);
+    uint8_t p = s_point;
+
+    if (awake_permille > CLOCK_GOV_UP_PERMILLE) {
+        // The lowest faster point that runs it below the up threshold
+        do {
+            p += 1;
+        } while (p < CLOCK_GOV_POINT_NUM - 1 && demand / (s_point_hz[p] / 1000) > CLOCK_GOV_UP_PERMILLE);
+        if (p >= CLOCK_GOV_POINT_NUM) p = CLOCK_GOV_POINT_NUM - 1;
+    } else {
+        while (p > 0 && demand / (s_point_hz[p - 1] / 1000) < CLOCK_GOV_DOWN_PERMILLE) {
+            p -= 1;
+        }
+    }
+    clock_gov_set_point((clock_gov_point_t)p);
+    return s_point;
+}
+
+/**
+ * @brief The current operating point
+ */
+clock_gov_point_t clock_gov_point(void)
+{
+    return s_point;
+}
+
+/**
+ * @brief The current HCLK in Hz, as the PLL made it
+ */
+uint32_t clock_gov_hclk(void)
+{
+    return CLK_GetHCLKFreq();
+}
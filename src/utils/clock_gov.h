@@ -0,0 +1,43 @@
+/**
+ * @brief HCLK governor, runs the core at the lowest operating point that keeps up with the measured load
+ * @details
+ *   The operating points are the HXT itself and the PLL at a few frequencies, see clock_gov_hclk().
+ *   The caller measures the time the CPU is awake over a window and passes it to clock_gov_update(),
+ *   the governor turns it into cycles per second and picks the lowest point that runs them below
+ *   CLOCK_GOV_UP_PERMILLE of the time. It steps down only when the lower point stays below CLOCK_GOV_DOWN_PERMILLE,
+ *   so it doesn't swing between two points.
+ *
+ *   On every change the bus clocks that come from HCLK (SPI1, SPI3, I2C0, and the timers set to HCLK in MCU_init.h)
+ *   are derived again for the same rate as before. Clocks from the HXT, like the I2S and timer 0, don't change.
+ *   Interrupts stay enabled during the change, HCLK runs from the HXT or the HIRC while the PLL locks.
+ */
+
+#ifndef _CLOCK_GOV_H_
+#define _CLOCK_GOV_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Step up when the load at the current point is above this, per mille of the time
+#define CLOCK_GOV_UP_PERMILLE   700
+// Step down only when the load at the lower point would be below this
+#define CLOCK_GOV_DOWN_PERMILLE 500
+
+/**
+ * @brief Operating points, from the slowest
+ */
+typedef enum clock_gov_point_t {
+    CLOCK_GOV_12MHZ,    // HXT, the PLL is off
+    CLOCK_GOV_25MHZ,
+    CLOCK_GOV_36MHZ,
+    CLOCK_GOV_50MHZ,    // MCU_CLOCK_FREQUENCY, as SYS_Init() sets it
+    CLOCK_GOV_POINT_NUM,
+} clock_gov_point_t;
+
+void clock_gov_init(void);
+bool clock_gov_set_point(clock_gov_point_t point);
+clock_gov_point_t clock_gov_update(uint16_t awake_permille);
+clock_gov_point_t clock_gov_point(void);
+uint32_t clock_gov_hclk(void);
+
+#endif // _CLOCK_GOV_H_
@@ -0,0 +1,126 @@
+#include <stddef.h>
+
+#include "coop_sched.h"
+
+// Orders the deadline against the count that publishes it, a compiler barrier is enough on the single core M0
+#ifdef COOP_SCHED_HOST
+#define COOP_SCHED_BARRIER() __sync_synchronize()
+#else
+#include "NUC100Series.h"
+#define COOP_SCHED_BARRIER() __DMB()
+#endif
+
+/**
+ * @brief Checks if a task has work to do
+ */
+static bool task_ready(const sched_task_t *t)
+{
+    return t->state == SCHED_YIELDED || t->ready();
+}
+
+/**
+ * @brief Set up the scheduler, every task starts from the beginning
+ * @param s The scheduler
+ * @param tasks The tasks, highest priority first, name, run and ready filled in
+ * @param num Number of tasks
+ * @param now Clock for the deadlines and the statistics
+ */
+void sched_init(sched_t *s, sched_task_t *tasks, uint8_t num, uint32_t (*now)(void))
+{
+    uint8_t i;
+
+    s->tasks = tasks;
+    s->num = num;
+    s->now = now;
+    for (i = 0; i < num; ++i) {
+        tasks[i].lc = 0;
+        tasks[i].state = SCHED_ENDED;
+        tasks[i].deadline_done = tasks[i].deadline_set;
+    }
+    sched_reset_stats(s);
+}
+
+/**
+ * @brief Give the task a deadline, it runs before the tasks without one until it reaches SCHED_END()
+ * @details Only one context may set the deadlines of a task, a later one replaces a pending one
+ * @param t The task
+ * @param deadline In ticks of the clock
+ */
+void sched_set_deadline(sched_task_t *t, uint32_t deadline)
+{
+    t->deadline = deadline;
+    // The scheduler must see the deadline before the count
+    COOP_SCHED_BARRIER();
+    t->deadline_set += 1;
+}
+
+/**
+ * @brief Checks if any task is ready, call it with interrupts masked before sleeping
+ */
+bool sched_ready(const sched_t *s)
+{
+    uint8_t i;
+
+    for (i = 0; i < s->num; ++i) {
+        if (task_ready(&s->tasks[i])) return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Run one step of the task that goes first
+ * @param s The scheduler
+ * @return false if no task is ready
+ */
+bool sched_dispatch(sched_t *s)
+{
+    sched_task_t *t = NULL, *c;
+    uint32_t start, elapsed, deadline = 0;
+    uint8_t i, set = 0, ret;
+
+    // Earliest deadline first, the timestamps wrap around
+    for (i = 0; i < s->num; ++i) {
+        c = &s->tasks[i];
+        if (c->deadline_set == c->deadline_done || !task_ready(c)) continue;
+        if (t == NULL || (int32_t)(c->deadline - t->deadline) < 0) t = c;
+    }
+    // Then by priority
+    for (i = 0; t == NULL && i < s->num; ++i) {
+        if (task_ready(&s->tasks[i])) t = &s->tasks[i];
+    }
+    if (t == NULL) return false;
+
+    // A deadline set during the step is for the next round
+    set = t->deadline_set;
+    COOP_SCHED_BARRIER();
+    deadline = t->deadline;
+
+    start = s->now();
+    ret = t->run(t);
+    elapsed = s->now() - start;
+    t->state = ret;
+
+    t->runs += 1;
+    t->time += elapsed;
+    if (elapsed > t->max_time) t->max_time = elapsed;
+    if (ret == SCHED_ENDED && set != t->deadline_done) {
+        if ((int32_t)(start + elapsed - deadline) > 0) t->misses += 1;
+        t->deadline_done = set;
+    }
+    return true;
+}
+
+/**
+ * @brief Clear the statistics of all the tasks
+ */
+void sched_reset_stats(sched_t *s)
+{
+    uint8_t i;
+
+    for (i = 0; i < s->num; ++i) {
+        s->tasks[i].runs = 0;
+        s->tasks[i].time = 0;
+        s->tasks[i].max_time = 0;
+        s->tasks[i].misses = 0;
+    }
+}
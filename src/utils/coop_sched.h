@@ -0,0 +1,87 @@
+/**
+ * @brief Cooperative scheduler for stackless tasks, protothreads style
+ * @details
+ *   A task is a function that runs one step and returns, its place is kept in the task (lc) by the SCHED_* macros,
+ *   so it continues after the SCHED_YIELD() or SCHED_WAIT_UNTIL() where it left off on the next call.
+ *   Local variables don't survive a yield, keep the state in globals. No switch statement may span a yield.
+ *
+ *   The tasks are given highest priority first. sched_dispatch() runs one step of the first task that
+ *   yielded in its last step or whose ready() is true, but a task with a deadline (sched_set_deadline(), also from an interrupt handler) goes
+ *   before them all, the earliest deadline first. The deadline is done when the task reaches SCHED_END(),
+ *   and counted as missed if that is later.
+ *   The time of each step is taken with the clock given to sched_init(), for the statistics.
+ *
+ *   Nothing preempts a step, so a long task yields between its parts, and a task with a deadline
+ *   waits at most one step of another task.
+ */
+
+#ifndef _COOP_SCHED_H_
+#define _COOP_SCHED_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief Return value of a step
+ */
+enum {
+    SCHED_WAITING,  // Stopped at SCHED_WAIT_UNTIL()
+    SCHED_YIELDED,  // Stopped at SCHED_YIELD()
+    SCHED_ENDED,    // Reached SCHED_END(), starts from SCHED_BEGIN() the next time
+};
+
+#define SCHED_BEGIN(t)  switch ((t)->lc) { case 0:
+#define SCHED_END(t)    } (t)->lc = 0; return SCHED_ENDED
+// Continues after it on the next step
+#define SCHED_YIELD(t) \
+    do { \
+        (t)->lc = __LINE__; \
+        return SCHED_YIELDED; \
+        case __LINE__:; \
+    } while (0)
+// Checks cond again on each step, and goes on once it's true
+#define SCHED_WAIT_UNTIL(t, cond) \
+    do { \
+        (t)->lc = __LINE__; \
+        case __LINE__: \
+        if (!(cond)) return SCHED_WAITING; \
+    } while (0)
+
+typedef struct sched_task_t sched_task_t;
+
+/**
+ * @brief One task, the name, run and ready are given by the user
+ */
+struct sched_task_t {
+    const char *name;
+    uint8_t (*run)(sched_task_t *t);    // One step
+    bool (*ready)(void);                // true if a step has work to do, no side effects, called with interrupts masked
+    uint16_t lc;                        // Line to continue at, 0 for the start
+    uint8_t state;                      // Return value of the last step, a task that yielded is ready again
+    // Deadline, see sched_set_deadline()
+    volatile uint32_t deadline;
+    volatile uint8_t deadline_set;      // Only written by sched_set_deadline(), free running
+    uint8_t deadline_done;              // Only written by the scheduler, a deadline is pending while they differ
+    // Statistics, in ticks of the clock
+    uint32_t runs;
+    uint64_t time;
+    uint32_t max_time;
+    uint16_t misses;                    // Deadlines missed
+};
+
+/**
+ * @brief Scheduler state
+ */
+typedef struct sched_t {
+    sched_task_t *tasks;                // Highest priority first
+    uint8_t num;
+    uint32_t (*now)(void);              // Clock for the deadlines and the statistics, wraps around
+} sched_t;
+
+void sched_init(sched_t *s, sched_task_t *tasks, uint8_t num, uint32_t (*now)(void));
+void sched_set_deadline(sched_task_t *t, uint32_t deadline);
+bool sched_ready(const sched_t *s);
+bool sched_dispatch(sched_t *s);
+void sched_reset_stats(sched_t *s);
+
+#endif // _COOP_SCHED_H_
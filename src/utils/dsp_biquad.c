@@ -0,0 +1,197 @@
+#include <string.h>
+#include <math.h>
+
+#include "dsp_biquad.h"
+
+/**
+ * @brief Initialize the biquad cascade instance, and clear its state
+ * @param S The instance
+ * @param numStages Number of 2nd order stages
+ * @param pCoeffs Coefficients, 6 per stage
+ * @param pState State buffer, 4 per stage
+ * @param postShift Shift applied to the output, to match the coefficients format
+ */
+void dsp_biquad_cascade_df1_init_q15(dsp_biquad_casd_df1_inst_q15 *S, uint8_t numStages, const dsp_q15_t *pCoeffs, dsp_q15_t *pState, int8_t postShift)
+{
+    S->numStages = numStages;
+    S->pCoeffs = pCoeffs;
+    S->pState = pState;
+    S->postShift = postShift;
+    memset(pState, 0, 4 * numStages * sizeof(dsp_q15_t));
+}
+
+/**
+ * @brief Run the biquad cascade on a block of samples
+ * @param S The instance
+ * @param pSrc Input samples
+ * @param pDst Output samples, can be the same as pSrc
+ * @param blockSize Number of samples to process (of this channel)
+ * @param stride Distance between two samples of this channel, 1 for mono, 2 for interleaved stereo
+ * @details
+ *   y[n] = b0 * x[n] + b1 * x[n-1] + b2 * x[n-2] + a1 * y[n-1] + a2 * y[n-2]
+ *   Every product is q15 * q15, which fits in 32 bits, so a single MULS does it.
+ *   The sum is kept in 64 bits (ADDS/ADCS only), so no intermediate overflow.
+ *   It is shifted down by its two words, a shift of an int64 by a variable count is a library call on the M0.
+ *   The truncation error is fed back to the next sample (first order error feedback).
+ * @note postShift must be 0 ~ 14
+ */
+void dsp_biquad_cascade_df1_q15(const dsp_biquad_casd_df1_inst_q15 *S, const dsp_q15_t *pSrc, dsp_q15_t *pDst, uint32_t blockSize, uint32_t stride)
+{
+    const dsp_q15_t *pCoeffs = S->pCoeffs;
+    dsp_q15_t *pState = S->pState;
+    uint32_t shift = 15 - S->postShift;
+    uint32_t frac_mask = (1ul << shift) - 1;
+    int32_t b0, b1, b2, a1, a2;
+    int32_t x1, x2, y1, y2, x0, out, err;
+    int64_t acc;
+    uint32_t acc_lo;
+    int32_t acc_hi;
+    uint32_t stage, n;
+
+    for (stage = 0; stage < (uint32_t)S->numStages; ++stage) {
+        b0 = pCoeffs[0];
+        b1 = pCoeffs[2];
+        b2 = pCoeffs[3];
+        a1 = pCoeffs[4];
+        a2 = pCoeffs[5];
+        pCoeffs += 6;
+
+        x1 = pState[0];
+        x2 = pState[1];
+        y1 = pState[2];
+        y2 = pState[3];
+        err = 0;
+
+        for (n = 0; n < blockSize; ++n) {
+            x0 = pSrc[n * stride];
+
+            acc  = err;
+            acc += (int32_t)(b0 * x0);
+            acc += (int32_t)(b1 * x1);
+            acc += (int32_t)(b2 * x2);
+            acc += (int32_t)(a1 * y1);
+            acc += (int32_t)(a2 * y2);
+
+            // out = acc >> shift, it fits in 32 bits since the products are q30 and the sum is at most 6 of them
+            acc_lo = (uint32_t)acc;
+            acc_hi = (int32_t)(acc >> 32);
+            out = (int32_t)((acc_lo >> shift) | ((uint32_t)acc_hi << (32 - shift)));
+            // Feed the truncated bits back to the next sample, else low cut-off filters drift off by a large DC
+            err = (int32_t)(acc_lo & frac_mask);
+            // Saturate to q15
+            if (out > 32767) out = 32767;
+            else if (out < -32768) out = -32768;
+
+            x2 = x1;
+            x1 = x0;
+            y2 = y1;
+            y1 = out;
+
+            pDst[n * stride] = (dsp_q15_t)out;
+        }
+
+        pState[0] = (dsp_q15_t)x1;
+        pState[1] = (dsp_q15_t)x2;
+        pState[2] = (dsp_q15_t)y1;
+        pState[3] = (dsp_q15_t)y2;
+        pState += 4;
+
+        // Following stages work on the output of this stage
+        pSrc = pDst;
+    }
+}
+
+/**
+ * @brief Design one biquad stage (RBJ audio EQ cookbook), in the layout of dsp_biquad_cascade_df1_q15()
+ * @param type Filter type
+ * @param fs Sample rate
+ * @param f0 Cut-off or center frequency
+ * @param q Quality factor, 0.707 for butterworth
+ * @param gain_db Gain, for peaking and shelving filters only
+ * @param postShift Post shift of the instance, the coefficients must be within (-2^postShift, 2^postShift)
+ * @param pCoeffs[out] 6 coefficients of this stage
+ * @return 0 if success, 1 if the coefficients are out of range of the postShift, or a pole near DC fell on the
+ *         unit circle and was moved inside (2nd order stages with f0 of a few tens of Hz at 44.1 kHz)
+ * @note 2nd order stages lose accuracy well before that, below a few hundred Hz, see dsp_biquad_host_test.c,
+ *       for a high pass there use DSP_BIQUAD_HIGHPASS_1ST
+ * @note Uses float, call it on init or when the settings change, not per sample
+ */
+uint8_t dsp_biquad_design_q15(dsp_biquad_type_t type, uint32_t fs, uint32_t f0, float q, float gain_db, int8_t postShift, dsp_q15_t *pCoeffs)
+{
+    float A = powf(10.0f, gain_db / 40.0f);
+    float w0 = 2.0f * 3.14159265f * (float)f0 / (float)fs;
+    float cw = cosf(w0);
+    float alpha = sinf(w0) / (2.0f * q);
+    float sq = 2.0f * sqrtf(A) * alpha;
+    float b[3], a[3], c[5], scale, dc_gain;
+    uint8_t i, status = 0;
+    int32_t v[5], one;
+
+    switch (type) {
+    case DSP_BIQUAD_LOWPASS:
+        b[0] = (1.0f - cw) / 2.0f; b[1] = 1.0f - cw; b[2] = b[0];
+        a[0] = 1.0f + alpha; a[1] = -2.0f * cw; a[2] = 1.0f - alpha;
+        break;
+    case DSP_BIQUAD_HIGHPASS:
+        b[0] = (1.0f + cw) / 2.0f; b[1] = -(1.0f + cw); b[2] = b[0];
+        a[0] = 1.0f + alpha; a[1] = -2.0f * cw; a[2] = 1.0f - alpha;
+        break;
+    case DSP_BIQUAD_HIGHPASS_1ST:
+        // Bilinear transform of s / (s + w0), q is not used
+        b[0] = 1.0f; b[1] = -1.0f; b[2] = 0.0f;
+        a[0] = 1.0f + tanf(w0 / 2.0f); a[1] = tanf(w0 / 2.0f) - 1.0f; a[2] = 0.0f;
+        break;
+    case DSP_BIQUAD_PEAKING:
+        b[0] = 1.0f + alpha * A; b[1] = -2.0f * cw; b[2] = 1.0f - alpha * A;
+        a[0] = 1.0f + alpha / A; a[1] = -2.0f * cw; a[2] = 1.0f - alpha / A;
+        break;
+    case DSP_BIQUAD_LOWSHELF:
+        b[0] = A * ((A + 1.0f) - (A - 1.0f) * cw + sq);
+        b[1] = 2.0f * A * ((A - 1.0f) - (A + 1.0f) * cw);
+        b[2] = A * ((A + 1.0f) - (A - 1.0f) * cw - sq);
+        a[0] = (A + 1.0f) + (A - 1.0f) * cw + sq;
+        a[1] = -2.0f * ((A - 1.0f) + (A + 1.0f) * cw);
+        a[2] = (A + 1.0f) + (A - 1.0f) * cw - sq;
+        break;
+    case DSP_BIQUAD_HIGHSHELF:
+    default:
+        b[0] = A * ((A + 1.0f) + (A - 1.0f) * cw + sq);
+        b[1] = -2.0f * A * ((A - 1.0f) + (A + 1.0f) * cw);
+        b[2] = A * ((A + 1.0f) + (A - 1.0f) * cw - sq);
+        a[0] = (A + 1.0f) - (A - 1.0f) * cw + sq;
+        a[1] = 2.0f * ((A - 1.0f) - (A + 1.0f) * cw);
+        a[2] = (A + 1.0f) - (A - 1.0f) * cw - sq;
+        break;
+    }
+
+    // Normalize by a0, and negate a1, a2 as the CMSIS layout
+    c[0] = b[0] / a[0];
+    c[1] = b[1] / a[0];
+    c[2] = b[2] / a[0];
+    c[3] = -a[1] / a[0];
+    c[4] = -a[2] / a[0];
+
+    scale = 32768.0f / (float)(1 << postShift);
+    for (i = 0; i < 5; ++i) {
+        v[i] = (int32_t)(c[i] * scale + (c[i] >= 0.0f ? 0.5f : -0.5f));
+    }
+
+    // The rounding alone can put a pole near DC on or past the unit circle (a 2nd order 30 Hz high pass at
+    // 44.1 kHz has 1 - a1 - a2 below one LSB), keep it at least one LSB inside, but that isn't the filter designed
+    one = (int32_t)scale;
+    if (one - v[3] - v[4] < 1) {
+        v[3] = one - v[4] - 1;
+        status = 1;
+    }
+    // Then b1 is picked so the gain at DC is the designed one, e.g. exactly 0 for the high pass
+    dc_gain = (c[0] + c[1] + c[2]) / (1.0f - c[3] - c[4]);
+    v[1] = (int32_t)(dc_gain * (float)(one - v[3] - v[4]) + (dc_gain >= 0.0f ? 0.5f : -0.5f)) - v[0] - v[2];
+
+    for (i = 0; i < 5; ++i) {
+        if (v[i] > 32767 || v[i] < -32768) return 1;
+        pCoeffs[(i == 0) ? 0 : i + 1] = (dsp_q15_t)v[i];
+    }
+    pCoeffs[1] = 0;
+
+    return status;
+}
@@ -0,0 +1,47 @@
+/**
+ * @brief Fixed-point biquad cascade for software EQ and filtering
+ * @details
+ *   Same shape as arm_biquad_cascade_df1_q15() in CMSIS arm_math.h (same coefficient layout and postShift),
+ *   but written for the Cortex-M0: only the 32x32->32 MULS is used, and saturation is done by compare,
+ *   since the M0 has neither SMLAD nor SSAT.
+ *   Interleaved stereo is handled by the stride parameter, with one instance per channel.
+ *
+ *   The time it takes on the target is measured by the PROF_SW_FILTER probe of main.c, see prof_dump().
+ *   The accuracy against a double reference is checked by dsp_biquad_host_test.c.
+ *   Filtering that the codec can do (5-band EQ, 3D, limiter) should be done by the codec, see wau8822.h
+ */
+
+#ifndef _DSP_BIQUAD_H_
+#define _DSP_BIQUAD_H_
+
+#include <stdint.h>
+
+#include "dsp_types.h"
+
+/**
+ * @brief Instance of a Q15 biquad cascade, direct form I
+ */
+typedef struct dsp_biquad_casd_df1_inst_q15 {
+    int8_t numStages;           // Number of 2nd order stages
+    dsp_q15_t *pState;          // 4 * numStages: x[n-1], x[n-2], y[n-1], y[n-2] of each stage
+    const dsp_q15_t *pCoeffs;   // 6 * numStages: b0, 0, b1, b2, a1, a2 of each stage (a1, a2 are negated, as CMSIS)
+    int8_t postShift;           // Coefficients are scaled by 2^-postShift to fit in Q15
+} dsp_biquad_casd_df1_inst_q15;
+
+/**
+ * @brief Filter types for dsp_biquad_design_q15()
+ */
+typedef enum dsp_biquad_type_t {
+    DSP_BIQUAD_LOWPASS,
+    DSP_BIQUAD_HIGHPASS,
+    DSP_BIQUAD_HIGHPASS_1ST,    // 1st order, 6 dB/octave, its pole can be placed in Q15 down to a few Hz
+    DSP_BIQUAD_PEAKING,
+    DSP_BIQUAD_LOWSHELF,
+    DSP_BIQUAD_HIGHSHELF,
+} dsp_biquad_type_t;
+
+void dsp_biquad_cascade_df1_init_q15(dsp_biquad_casd_df1_inst_q15 *S, uint8_t numStages, const dsp_q15_t *pCoeffs, dsp_q15_t *pState, int8_t postShift);
+void dsp_biquad_cascade_df1_q15(const dsp_biquad_casd_df1_inst_q15 *S, const dsp_q15_t *pSrc, dsp_q15_t *pDst, uint32_t blockSize, uint32_t stride);
+uint8_t dsp_biquad_design_q15(dsp_biquad_type_t type, uint32_t fs, uint32_t f0, float q, float gain_db, int8_t postShift, dsp_q15_t *pCoeffs);
+
+#endif // _DSP_BIQUAD_H_
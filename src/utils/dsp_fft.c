@@ -0,0 +1,98 @@
+#include "dsp_fft.h"
+
+/* cos(2 * pi * k / 128), sin(2 * pi * k / 128) in q15, k = 0 ~ 63 */
+static const dsp_q15_t s_twiddle_q15[DSP_FFT_MAX_LEN] = {
+     32767,      0,  32728,   1608,  32609,   3212,  32412,   4808,
+     32137,   6393,  31785,   7962,  31356,   9512,  30852,  11039,
+     30273,  12539,  29621,  14010,  28898,  15446,  28105,  16846,
+     27245,  18204,  26319,  19519,  25329,  20787,  24279,  22005,
+     23170,  23170,  22005,  24279,  20787,  25329,  19519,  26319,
+     18204,  27245,  16846,  28105,  15446,  28898,  14010,  29621,
+     12539,  30273,  11039,  30852,   9512,  31356,   7962,  31785,
+      6393,  32137,   4808,  32412,   3212,  32609,   1608,  32728,
+         0,  32767,  -1608,  32728,  -3212,  32609,  -4808,  32412,
+     -6393,  32137,  -7962,  31785,  -9512,  31356, -11039,  30852,
+    -12539,  30273, -14010,  29621, -15446,  28898, -16846,  28105,
+    -18204,  27245, -19519,  26319, -20787,  25329, -22005,  24279,
+    -23170,  23170, -24279,  22005, -25329,  20787, -26319,  19519,
+    -27245,  18204, -28105,  16846, -28898,  15446, -29621,  14010,
+    -30273,  12539, -30852,  11039, -31356,   9512, -31785,   7962,
+    -32137,   6393, -32412,   4808, -32609,   3212, -32728,   1608,
+};
+
+/**
+ * @brief Complex FFT, radix-2, in place
+ * @param pSrc Interleaved complex data, 2 * fftLen values
+ * @param fftLen FFT size, power of 2, 2 ~ DSP_FFT_MAX_LEN
+ * @note The result is scaled by 1 / fftLen
+ */
+void dsp_cfft_radix2_q15(dsp_q15_t *pSrc, uint16_t fftLen)
+{
+    uint32_t i, j, k, bit;
+    uint32_t half, step, tw_step, tw_idx;
+    int32_t wr, wi, xr, xi, tr, ti;
+    dsp_q15_t tmp;
+
+    // Bit reversal
+    j = 0;
+    for (i = 0; i < (uint32_t)fftLen - 1; ++i) {
+        if (i < j) {
+            tmp = pSrc[2 * i];     pSrc[2 * i] = pSrc[2 * j];         pSrc[2 * j] = tmp;
+            tmp = pSrc[2 * i + 1]; pSrc[2 * i + 1] = pSrc[2 * j + 1]; pSrc[2 * j + 1] = tmp;
+        }
+        bit = fftLen >> 1;
+        while (j & bit) {
+            j ^= bit;
+            bit >>= 1;
+        }
+        j |= bit;
+    }
+
+    // Butterflies, W = cos - j*sin
+    tw_step = DSP_FFT_MAX_LEN / 2;
+    for (half = 1; half < fftLen; half <<= 1) {
+        step = half << 1;
+        tw_idx = 0;
+        for (k = 0; k < half; ++k) {
+            wr = s_twiddle_q15[2 * tw_idx];
+            wi = s_twiddle_q15[2 * tw_idx + 1];
+            tw_idx += tw_step;
+            for (i = k; i < fftLen; i += step) {
+                j = i + half;
+                xr = pSrc[2 * j];
+                xi = pSrc[2 * j + 1];
+                // Rounded, not truncated, else each stage adds a bias of half an LSB
+                tr = (wr * xr + wi * xi + 0x4000) >> 15;
+                ti = (wr * xi - wi * xr + 0x4000) >> 15;
+                xr = pSrc[2 * i];
+                xi = pSrc[2 * i + 1];
+                pSrc[2 * i]     = (dsp_q15_t)((xr + tr + 1) >> 1);
+                pSrc[2 * i + 1] = (dsp_q15_t)((xi + ti + 1) >> 1);
+                pSrc[2 * j]     = (dsp_q15_t)((xr - tr + 1) >> 1);
+                pSrc[2 * j + 1] = (dsp_q15_t)((xi - ti + 1) >> 1);
+            }
+        }
+        tw_step >>= 1;
+    }
+}
+
+/**
+ * @brief Approximated magnitude of complex values, max + min / 2 (error within 12%)
+ * @param pSrc Interleaved complex data
+ * @param pDst Magnitudes
+ * @param numSamples Number of complex values
+ */
+void dsp_cmplx_mag_approx_q15(const dsp_q15_t *pSrc, dsp_q15_t *pDst, uint32_t numSamples)
+{
+    uint32_t i;
+    int32_t re, im, mag;
+
+    for (i = 0; i < numSamples; ++i) {
+        re = pSrc[2 * i];
+        im = pSrc[2 * i + 1];
+        if (re < 0) re = -re;
+        if (im < 0) im = -im;
+        mag = (re > im) ? (re + (im >> 1)) : (im + (re >> 1));
+        pDst[i] = (dsp_q15_t)((mag > 32767) ? 32767 : mag);
+    }
+}
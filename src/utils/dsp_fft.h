@@ -0,0 +1,26 @@
+/**
+ * @brief Fixed-point FFT, for the spectrum analyzer
+ * @details
+ *   Radix-2 decimation in time, in the shape of arm_cfft_radix2_q15() in CMSIS arm_math.h:
+ *   in place, interleaved complex data (re, im, re, im, ...), bit reversal included.
+ *   Each stage scales down by 2 and rounds, so the output is the DFT divided by fftLen, and it never overflows
+ *   as long as |z| of the input is within q15, e.g. real input.
+ *
+ *   The time it takes on the target is measured by the PROF_VIS_FFT probe of main.c, see prof_dump().
+ *   The accuracy against a DFT in double is checked by dsp_fft_host_test.c.
+ */
+
+#ifndef _DSP_FFT_H_
+#define _DSP_FFT_H_
+
+#include <stdint.h>
+
+#include "dsp_types.h"
+
+// Largest FFT size supported by the twiddle table
+#define DSP_FFT_MAX_LEN 128
+
+void dsp_cfft_radix2_q15(dsp_q15_t *pSrc, uint16_t fftLen);
+void dsp_cmplx_mag_approx_q15(const dsp_q15_t *pSrc, dsp_q15_t *pDst, uint32_t numSamples);
+
+#endif // _DSP_FFT_H_
@@ -0,0 +1,12 @@
+/**
+ * @brief Fixed-point types shared by the dsp functions
+ */
+
+#ifndef _DSP_TYPES_H_
+#define _DSP_TYPES_H_
+
+#include <stdint.h>
+
+typedef int16_t dsp_q15_t;
+
+#endif // _DSP_TYPES_H_
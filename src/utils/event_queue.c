@@ -0,0 +1,121 @@
+#include <stddef.h>
+
+#include "event_queue.h"
+
+// Orders the event against the index store, a compiler barrier is enough on the single core M0
+#ifdef EVENT_QUEUE_HOST
+#define EVENT_QUEUE_BARRIER() __sync_synchronize()
+#else
+#include "NUC100Series.h"
+#define EVENT_QUEUE_BARRIER() __DMB()
+#endif
+
+/**
+ * @brief Set up an empty queue, before the producer's interrupt is enabled
+ * @param q The queue
+ * @param buf Buffer for the events
+ * @param size Number of events in buf, a power of 2, at most 128
+ */
+void event_queue_init(event_queue_t *q, event_t *buf, uint8_t size)
+{
+    q->buf = buf;
+    q->mask = size - 1;
+    q->head = 0;
+    q->tail = 0;
+    q->dropped = 0;
+    q->peak = 0;
+}
+
+/**
+ * @brief Add an event, called by the producer only
+ * @param q The queue
+ * @param type Type of the event
+ * @param arg Argument of the event
+ * @param time Timestamp
+ * @return true if added, false if the queue is full (the event is counted in dropped)
+ */
+bool event_queue_push(event_queue_t *q, uint8_t type, uint8_t arg, uint32_t time)
+{
+    uint8_t head = q->head, count;
+    event_t *e;
+
+    if ((uint8_t)(head - q->tail) > q->mask) {
+        if (q->dropped < 255) q->dropped += 1;
+        return false;
+    }
+    e = &q->buf[head & q->mask];
+    e->time = time;
+    e->type = type;
+    e->arg = arg;
+    // The consumer must see the event before the new head
+    EVENT_QUEUE_BARRIER();
+    q->head = head + 1;
+    // A lower bound, the consumer may have taken some since
+    count = (uint8_t)(head + 1 - q->tail);
+    if (count > q->peak) q->peak = count;
+    return true;
+}
+
+/**
+ * @brief Number of events waiting, exact for the consumer, a lower bound for anyone else
+ * @param q The queue
+ */
+uint8_t event_queue_count(const event_queue_t *q)
+{
+    return (uint8_t)(q->head - q->tail);
+}
+
+/**
+ * @brief Take the oldest event, called by the consumer only
+ * @param q The queue
+ * @param e[out] The event
+ * @return true if an event is taken, false if the queue is empty
+ */
+bool event_queue_pop(event_queue_t *q, event_t *e)
+{
+    uint8_t tail = q->tail;
+
+    if (q->head == tail) return false;
+    EVENT_QUEUE_BARRIER();
+    *e = q->buf[tail & q->mask];
+    // The event must be copied before the producer can reuse its slot
+    EVENT_QUEUE_BARRIER();
+    q->tail = tail + 1;
+    return true;
+}
+
+/**
+ * @brief Take the event with the oldest timestamp from several queues, called by their consumer only
+ * @param qs The queues
+ * @param n Number of queues
+ * @param e[out] The event
+ * @return true if an event is taken, false if all the queues are empty
+ */
+bool event_queue_pop_oldest(event_queue_t *const *qs, uint8_t n, event_t *e)
+{
+    event_queue_t *oldest = NULL;
+    uint32_t oldest_time = 0, time;
+    uint8_t i;
+
+    for (i = 0; i < n; ++i) {
+        if (qs[i]->head == qs[i]->tail) continue;
+        EVENT_QUEUE_BARRIER();
+        time = qs[i]->buf[qs[i]->tail & qs[i]->mask].time;
+        // Timestamps wrap around, compare the difference
+        if (oldest == NULL || (int32_t)(time - oldest_time) < 0) {
+            oldest = qs[i];
+            oldest_time = time;
+        }
+    }
+    if (oldest == NULL) return false;
+    return event_queue_pop(oldest, e);
+}
+
+/**
+ * @brief Drop all the waiting events, called by the consumer only
+ * @param q The queue
+ */
+void event_queue_clear(event_queue_t *q)
+{
+    q->tail = q->head;
+}
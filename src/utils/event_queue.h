@@ -0,0 +1,46 @@
+/**
+ * @brief Fixed-size lock-free event queue, from an interrupt handler to the main loop
+ * @details
+ *   Single producer, single consumer: head is only written by the producer and tail only by the consumer,
+ *   both are bytes, so every store is atomic on the M0 and neither side needs to mask interrupts.
+ *   The event is written before head moves, and read before tail moves, with a barrier in between.
+ *   Several interrupt handlers each get their own queue, event_queue_pop_oldest() merges them by timestamp.
+ *   When a queue is full the new event is dropped and counted, the producer never waits.
+ *   The producer also keeps the most events that ever waited, a queue that never gets near its size can shrink.
+ */
+
+#ifndef _EVENT_QUEUE_H_
+#define _EVENT_QUEUE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief One event, the meaning of type and arg is up to the user
+ */
+typedef struct event_t {
+    uint32_t time;  // Timestamp taken by the producer, wraps around
+    uint8_t type;
+    uint8_t arg;
+} event_t;
+
+/**
+ * @brief Queue state, the buffer is given by the user
+ */
+typedef struct event_queue_t {
+    event_t *buf;
+    uint8_t mask;             // Size - 1
+    volatile uint8_t head;    // Only written by the producer, free running
+    volatile uint8_t tail;    // Only written by the consumer, free running
+    volatile uint8_t dropped; // Only written by the producer, events lost because the queue was full, saturates at 255
+    volatile uint8_t peak;    // Only written by the producer, most events ever waiting, for sizing the queue
+} event_queue_t;
+
+void event_queue_init(event_queue_t *q, event_t *buf, uint8_t size);
+bool event_queue_push(event_queue_t *q, uint8_t type, uint8_t arg, uint32_t time);
+uint8_t event_queue_count(const event_queue_t *q);
+bool event_queue_pop(event_queue_t *q, event_t *e);
+bool event_queue_pop_oldest(event_queue_t *const *qs, uint8_t n, event_t *e);
+void event_queue_clear(event_queue_t *q);
+
+#endif // _EVENT_QUEUE_H_
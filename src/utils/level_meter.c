@@ -0,0 +1,128 @@
+#include "level_meter.h"
+
+// The update may preempt the fold, the few stores of each are done with interrupts off.
+// The fold runs in the I2S interrupt, so the mask is put back as it was, not turned on
+#ifdef LEVEL_METER_HOST
+#define LEVEL_METER_LOCK(primask) ((void)((primask) = 0))
+#define LEVEL_METER_UNLOCK(primask) ((void)(primask))
+#else
+#include "NUC100Series.h"
+#define LEVEL_METER_LOCK(primask) do { (primask) = __get_PRIMASK(); __disable_irq(); } while (0)
+#define LEVEL_METER_UNLOCK(primask) do { if ((primask) == 0) __enable_irq(); } while (0)
+#endif
+
+/* 32767 * 10^(-dB / 20), dB = 0 ~ 60 */
+static const uint16_t s_db_threshold[61] = {
+    32767, 29204, 26028, 23197, 20675, 18426, 16422, 14636, 13045, 11626,
+    10362,  9235,  8231,  7336,  6538,  5827,  5193,  4628,  4125,  3677,
+     3277,  2920,  2603,  2320,  2067,  1843,  1642,  1464,  1304,  1163,
+     1036,   923,   823,   734,   654,   583,   519,   463,   413,   368,
+      328,   292,   260,   232,   207,   184,   164,   146,   130,   116,
+      104,    92,    82,    73,    65,    58,    52,    46,    41,    37,
+       33,
+};
+
+/**
+ * @brief Clear the meter
+ * @param m The meter
+ */
+void level_meter_reset(level_meter_t *m)
+{
+    m->acc_peak = 0;
+    m->acc_sum_sq = 0;
+    m->acc_count = 0;
+    m->peak = 0;
+    m->rms = 0;
+}
+
+/**
+ * @brief Fold the values accumulated by the sample path into the meter
+ * @param m The meter
+ * @param peak Peak of the samples
+ * @param sum_sq Sum of squares of the samples
+ * @param count Number of samples
+ * @note Called from the sample path, the update may preempt it, so this is done with interrupts off (a few stores)
+ */
+void level_meter_fold(level_meter_t *m, uint32_t peak, uint32_t sum_sq, uint32_t count)
+{
+    uint32_t primask;
+
+    LEVEL_METER_LOCK(primask);
+    if (peak > m->acc_peak) m->acc_peak = peak;
+    m->acc_sum_sq += sum_sq;
+    m->acc_count += count;
+    LEVEL_METER_UNLOCK(primask);
+}
+
+/**
+ * @brief Integer square root
+ * @param x The value
+ * @return floor(sqrt(x))
+ */
+static uint32_t isqrt(uint32_t x)
+{
+    uint32_t res = 0, bit = 1UL << 30;
+
+    while (bit > x) bit >>= 2;
+    while (bit != 0) {
+        if (x >= res + bit) {
+            x -= res + bit;
+            res = (res >> 1) + bit;
+        } else {
+            res >>= 1;
+        }
+        bit >>= 2;
+    }
+    return res;
+}
+
+/**
+ * @brief Take the accumulated values and apply the ballistics
+ * @param m The meter
+ * @details
+ *   Peak: instant attack, decays by 1/8 per update (about -23dB/s at 20 updates per second)
+ *   RMS: attacks by 1/2, decays by 1/8 per update
+ */
+void level_meter_update(level_meter_t *m)
+{
+    uint32_t peak, sum_sq, count, rms, primask;
+
+    LEVEL_METER_LOCK(primask);
+    peak = m->acc_peak;
+    sum_sq = m->acc_sum_sq;
+    count = m->acc_count;
+    m->acc_peak = 0;
+    m->acc_sum_sq = 0;
+    m->acc_count = 0;
+    LEVEL_METER_UNLOCK(primask);
+
+    // The mean keeps its fraction, at -40dBFS it is about 1.6 and the RMS would be 22% low without it
+    rms = (count > 0) ? isqrt((uint32_t)(((uint64_t)sum_sq << 15) / count)) : 0;
+    if (rms > 32767) rms = 32767;
+    // -32768 is full scale too
+    if (peak > 32767) peak = 32767;
+
+    if (peak >= m->peak) m->peak = (uint16_t)peak;
+    else m->peak -= (m->peak - peak + 7) >> 3;
+
+    if (rms >= m->rms) m->rms += (rms - m->rms + 1) >> 1;
+    else m->rms -= (m->rms - rms + 7) >> 3;
+}
+
+/**
+ * @brief Level to dB below full scale
+ * @param level The level, full scale is 32767
+ * @return 0 ~ 60, for 0dBFS ~ -60dBFS (60 for anything lower)
+ */
+uint8_t level_meter_to_db(uint16_t level)
+{
+    uint8_t lo = 0, hi = 60, mid;
+
+    // First threshold that the level reaches
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (level >= s_db_threshold[mid]) hi = mid;
+        else lo = mid + 1;
+    }
+    return lo;
+}
@@ -0,0 +1,51 @@
+/**
+ * @brief Peak and RMS level metering, computed in the sample path
+ * @details
+ *   The sample path (I2S IRQ handler) accumulates peak and sum of squares into local variables
+ *   with LEVEL_METER_ACCUMULATE() while it converts the samples, so the samples are read only once,
+ *   and folds them into the meter with level_meter_fold() once per interrupt.
+ *   Per sample that is abs, compare, MULS, add, shift and add, level_meter_host_test.c measures what it adds to
+ *   the stereo TX handler of i2s_play.c.
+ *   level_meter_update() is called periodically (e.g. every 50ms from a timer) to apply the ballistics.
+ *
+ *   Built with LEVEL_METER_HOST it runs on a PC, without the interrupt masking.
+ */
+
+#ifndef _LEVEL_METER_H_
+#define _LEVEL_METER_H_
+
+#include <stdint.h>
+
+/**
+ * @brief Level meter state
+ */
+typedef struct level_meter_t {
+    // Written by the sample path
+    volatile uint32_t acc_peak;     // Abs peak since last update
+    volatile uint32_t acc_sum_sq;   // Sum of (s * s) >> 15, rounded, since last update
+    volatile uint32_t acc_count;    // Number of samples since last update
+    // Output of the ballistics, full scale is 32767
+    uint16_t peak;
+    uint16_t rms;
+} level_meter_t;
+
+/**
+ * @brief Accumulate one sample into the local peak and sum of squares
+ * @param peak Local uint32_t variable for the peak
+ * @param sum_sq Local uint32_t variable for the sum of squares
+ * @param sample The sample, int16_t
+ */
+#define LEVEL_METER_ACCUMULATE(peak, sum_sq, sample)                \
+    do {                                                            \
+        int32_t _a = (int32_t)(sample);                             \
+        if (_a < 0) _a = -_a;                                       \
+        if ((uint32_t)_a > (peak)) (peak) = (uint32_t)_a;           \
+        (sum_sq) += ((uint32_t)(_a * _a) + 0x4000) >> 15;           \
+    } while (0)
+
+void level_meter_reset(level_meter_t *m);
+void level_meter_fold(level_meter_t *m, uint32_t peak, uint32_t sum_sq, uint32_t count);
+void level_meter_update(level_meter_t *m);
+uint8_t level_meter_to_db(uint16_t level);
+
+#endif // _LEVEL_METER_H_
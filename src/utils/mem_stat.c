@@ -0,0 +1,142 @@
+#include <string.h>
+
+#include "mem_stat.h"
+
+#ifdef MEM_STAT_HOST
+// Below the stack pointer of the caller, the red zone of the host ABI isn't painted
+#define MEM_STAT_SP_MARGIN 256
+#define MEM_STAT_SP() ((uintptr_t)&sp_probe)
+#else
+#include "NUC100Series.h"
+#define MEM_STAT_SP_MARGIN 32
+#define MEM_STAT_SP() ((uintptr_t)__get_MSP())
+// End of the RAM the linker placed. The project links without a scatter file (umfTarg 0), so armlink only
+// defines the image wide symbols, not the ones of an execution region like RW_IRAM1
+extern uint32_t Image$$ZI$$Limit;
+#define MEM_STAT_RAM_BASE 0x20000000u
+#endif
+
+static uint32_t *s_stack = NULL;
+static uint32_t s_stack_size = 0;
+
+/**
+ * @brief Fill a region with MEM_STAT_PAINT
+ * @param base Start of the region, word aligned
+ * @param size Bytes, rounded down to words
+ */
+void mem_stat_paint(void *base, uint32_t size)
+{
+    volatile uint32_t *p = (volatile uint32_t *)base;
+    uint32_t i;
+
+    for (i = 0; i < size / 4; ++i) p[i] = MEM_STAT_PAINT;
+}
+
+/**
+ * @brief Bytes at the low end of a painted region that still have the paint, the part a stack never reached
+ * @param base Start of the region, word aligned
+ * @param size Bytes, rounded down to words
+ */
+uint32_t mem_stat_untouched(const void *base, uint32_t size)
+{
+    const volatile uint32_t *p = (const volatile uint32_t *)base;
+    uint32_t i;
+
+    for (i = 0; i < size / 4 && p[i] == MEM_STAT_PAINT; ++i);
+    return i * 4;
+}
+
+/**
+ * @brief Paint the stack below the stack pointer, as early as possible in main()
+ * @details The part above is in use, it counts as used. If the stack pointer isn't in the region,
+ *          e.g. the stack of a thread that isn't started yet, all of it is painted
+ * @param stack_base Lowest address of the stack, MEM_STAT_STACK_BASE on the target
+ * @param stack_size Bytes, MEM_STAT_STACK_SIZE on the target
+ */
+void mem_stat_init(void *stack_base, uint32_t stack_size)
+{
+    volatile uint32_t sp_probe = 0;
+    uintptr_t base = (uintptr_t)stack_base, sp = MEM_STAT_SP() - MEM_STAT_SP_MARGIN;
+    volatile uint32_t *p = (volatile uint32_t *)stack_base;
+    uint32_t i, words = stack_size / 4;
+
+    (void)sp_probe;
+    s_stack = (uint32_t *)stack_base;
+    s_stack_size = stack_size;
+    if (sp > base && sp < base + stack_size) words = (uint32_t)(sp - base) / 4;
+    // Not mem_stat_paint(), its frame would be in the part being painted
+    for (i = 0; i < words; ++i) p[i] = MEM_STAT_PAINT;
+}
+
+/**
+ * @brief Get the totals
+ * @param s[out] The totals
+ */
+void mem_stat_get(mem_stat_t *s)
+{
+    s->ram_size = MEM_STAT_RAM_SIZE;
+#ifdef MEM_STAT_HOST
+    s->linked_size = 0;
+#else
+    s->linked_size = (uint32_t)(uintptr_t)&Image$$ZI$$Limit - MEM_STAT_RAM_BASE;
+#endif
+    s->stack_size = s_stack_size;
+    s->stack_peak = (s_stack == NULL) ? 0 : s_stack_size - mem_stat_untouched(s_stack, s_stack_size);
+}
+
+/**
+ * @brief Add up a map by module
+ * @param map The buffers
+ * @param n Number of buffers
+ * @param modules[out] The modules, in the order they first appear, MEM_STAT_MODULE_MAX at most
+ * @param totals[out] Bytes of each module
+ * @return Number of modules
+ */
+uint8_t mem_stat_modules(const mem_stat_entry_t *map, uint8_t n, const char **modules, uint32_t *totals)
+{
+    uint8_t i, m, count = 0;
+
+    for (i = 0; i < n; ++i) {
+        for (m = 0; m < count && strcmp(modules[m], map[i].module) != 0; ++m);
+        if (m == count) {
+            if (count == MEM_STAT_MODULE_MAX) continue;
+            modules[m] = map[i].module;
+            totals[m] = 0;
+            count += 1;
+        }
+        totals[m] += map[i].size;
+    }
+    return count;
+}
+
+/**
+ * @brief Print the totals and the map, a module with its buffers under it
+ * @details Lines are short, to fit the buffer of mlh_write_format_text_uart()
+ * @param map The buffers
+ * @param n Number of buffers
+ * @param print A printf like function, e.g. mlh_write_format_text_uart
+ */
+void mem_stat_dump(const mem_stat_entry_t *map, uint8_t n, void (*print)(const char *format, ...))
+{
+    const char *modules[MEM_STAT_MODULE_MAX];
+    uint32_t totals[MEM_STAT_MODULE_MAX], sum = 0;
+    uint8_t i, m, count;
+    mem_stat_t s;
+
+    mem_stat_get(&s);
+    if (s.linked_size > 0) {
+        print("ram: %u of %u bytes, %u free\n", (unsigned)s.linked_size, (unsigned)s.ram_size,
+              (unsigned)(s.ram_size - s.linked_size));
+    }
+    print("stack: %u of %u bytes at most\n", (unsigned)s.stack_peak, (unsigned)s.stack_size);
+
+    count = mem_stat_modules(map, n, modules, totals);
+    for (m = 0; m < count; ++m) {
+        print("%s: %u\n", modules[m], (unsigned)totals[m]);
+        for (i = 0; i < n; ++i) {
+            if (strcmp(map[i].module, modules[m]) == 0) print("  %s: %u\n", map[i].name, (unsigned)map[i].size);
+        }
+        sum += totals[m];
+    }
+    print("map: %u bytes in %u buffers\n", (unsigned)sum, (unsigned)n);
+}
@@ -0,0 +1,62 @@
+/**
+ * @brief RAM budget of the 16 KB SRAM, the high-water mark of the stack and a map of the big buffers
+ * @details
+ *   mem_stat_init() paints the free part of the stack, below the stack pointer, with MEM_STAT_PAINT.
+ *   The lowest word that lost the paint is the deepest the stack went since, main() and the interrupt handlers
+ *   together, as they share the MSP.
+ *   The map is a table of the big buffers and the module each one belongs to, written by the user with
+ *   MEM_STAT_VAR(), mem_stat_dump() prints it with the totals per module, the stack, and the RAM the linker
+ *   placed (data, bss, stack and heap).
+ *
+ *   Built with MEM_STAT_HOST it runs on a PC, the stack is any region given to mem_stat_init(), e.g. a thread's,
+ *   and the size the linker placed isn't known.
+ */
+
+#ifndef _MEM_STAT_H_
+#define _MEM_STAT_H_
+
+#include <stdint.h>
+
+#define MEM_STAT_RAM_SIZE 0x4000    // IRAM of the target, 0x20000000 - 0x20003FFF
+#define MEM_STAT_PAINT 0xC5C5C5C5u
+#define MEM_STAT_MODULE_MAX 16      // Modules in a map
+
+#ifndef MEM_STAT_HOST
+#define MEM_STAT_STACK_SIZE 0x400   // Stack_Size of startup_NUC100Series.s
+// Top of the stack, from the startup file
+extern uint32_t __initial_sp;
+#define MEM_STAT_STACK_BASE ((void *)((uint8_t *)&__initial_sp - MEM_STAT_STACK_SIZE))
+#endif
+
+/**
+ * @brief A buffer in the map
+ */
+typedef struct mem_stat_entry_t {
+    const char *module;
+    const char *name;
+    uint32_t size;      // Bytes
+} mem_stat_entry_t;
+
+// An entry for a global, its size from its type
+#define MEM_STAT_VAR(module, var) {(module), #var, sizeof(var)}
+// An entry for a buffer that is static in its module
+#define MEM_STAT_SIZE(module, name, size) {(module), (name), (size)}
+
+/**
+ * @brief Totals, in bytes
+ */
+typedef struct mem_stat_t {
+    uint32_t ram_size;
+    uint32_t linked_size;   // RAM placed by the linker, stack included, 0 on the host
+    uint32_t stack_size;
+    uint32_t stack_peak;    // High-water mark of the stack
+} mem_stat_t;
+
+void mem_stat_paint(void *base, uint32_t size);
+uint32_t mem_stat_untouched(const void *base, uint32_t size);
+void mem_stat_init(void *stack_base, uint32_t stack_size);
+void mem_stat_get(mem_stat_t *s);
+uint8_t mem_stat_modules(const mem_stat_entry_t *map, uint8_t n, const char **modules, uint32_t *totals);
+void mem_stat_dump(const mem_stat_entry_t *map, uint8_t n, void (*print)(const char *format, ...));
+
+#endif // _MEM_STAT_H_
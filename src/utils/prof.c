@@ -0,0 +1,140 @@
+#include <string.h>
+
+#include "prof.h"
+
+#ifdef PROF_HOST
+#include <time.h>
+#endif
+
+static const char *const s_name[PROF_PROBE_NUM] = {
+    "i2s_isr",
+    "refill_read",
+    "disk_read",
+    "lcd_show",
+    "codec_write",
+    "sw_filter",
+    "vis_fft",
+};
+static prof_probe_t s_probe[PROF_PROBE_NUM];
+
+#ifdef PROF_HOST
+/**
+ * @brief Clock of the host build, in ns
+ */
+uint32_t prof_host_clock(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec);
+}
+#define PROF_LOCK(key) ((void)(key))
+#define PROF_UNLOCK(key) ((void)(key))
+#else
+// Keeps the interrupts masked if the caller had them masked
+#define PROF_LOCK(key) do { (key) = __get_PRIMASK(); __disable_irq(); } while (0)
+#define PROF_UNLOCK(key) __set_PRIMASK(key)
+#endif
+
+/**
+ * @brief Start timer 1 free running for the clock, and clear the statistics
+ */
+void prof_init(void)
+{
+#ifndef PROF_HOST
+    // No prescaler, counts on past the compare value, and TDR follows the counter
+    TIMER1->TCSR = TIMER_TCSR_CRST_Msk;
+    TIMER1->TCMPR = PROF_MASK;
+    TIMER1->TCSR = TIMER_CONTINUOUS_MODE | TIMER_TCSR_TDR_EN_Msk | TIMER_TCSR_CEN_Msk;
+#endif
+    prof_reset();
+}
+
+/**
+ * @brief Add a time to a probe, PROF_STOP() calls it
+ * @param id The probe
+ * @param ticks The time, in ticks of PROF_CLOCK_HZ
+ */
+void prof_record(prof_probe_id_t id, uint32_t ticks)
+{
+    prof_probe_t *p = &s_probe[id];
+    uint32_t v = ticks / PROF_HIST_MIN;
+    uint8_t bin = 0;
+
+    // No CLZ on the M0
+    while (v > 0 && bin < PROF_HIST_BINS - 1) {
+        v >>= 1;
+        bin += 1;
+    }
+    p->hist[bin] += 1;
+    if (p->count == 0 || ticks < p->min) p->min = ticks;
+    if (ticks > p->max) p->max = ticks;
+    p->sum += ticks;
+    p->count += 1;
+}
+
+/**
+ * @brief Clear the statistics of all the probes
+ */
+void prof_reset(void)
+{
+    uint32_t key;
+    uint8_t i;
+
+    for (i = 0; i < PROF_PROBE_NUM; ++i) {
+        PROF_LOCK(key);
+        memset(&s_probe[i], 0, sizeof(s_probe[i]));
+        PROF_UNLOCK(key);
+    }
+}
+
+/**
+ * @brief Copy the statistics of a probe, consistent even if its writer is an IRQ handler
+ * @param id The probe
+ * @param p[out] The statistics
+ */
+void prof_get(prof_probe_id_t id, prof_probe_t *p)
+{
+    uint32_t key;
+
+    PROF_LOCK(key);
+    *p = s_probe[id];
+    PROF_UNLOCK(key);
+}
+
+/**
+ * @brief Turn ticks into tenths of a us
+ */
+static uint32_t ticks_to_tenth_us(uint64_t ticks)
+{
+    return (uint32_t)(ticks * 10000000u / PROF_CLOCK_HZ);
+}
+
+/**
+ * @brief Print the statistics of the probes that ran, a line each and a line per bin of the histogram that isn't empty
+ * @details The lines are short, for the 64 bytes buffer of mlh_write_format_text_uart()
+ * @param print Like printf, e.g. mlh_write_format_text_uart
+ */
+void prof_dump(void (*print)(const char *format, ...))
+{
+    prof_probe_t p;
+    uint32_t min, avg, max, edge;
+    uint8_t i, k;
+
+    for (i = 0; i < PROF_PROBE_NUM; ++i) {
+        prof_get((prof_probe_id_t)i, &p);
+        if (p.count == 0) continue;
+        min = ticks_to_tenth_us(p.min);
+        avg = ticks_to_tenth_us(p.sum / p.count);
+        max = ticks_to_tenth_us(p.max);
+        print("%s: %u x, %u.%u/%u.%u/%u.%u us\n", s_name[i], (unsigned)p.count,
+              (unsigned)(min / 10), (unsigned)(min % 10), (unsigned)(avg / 10), (unsigned)(avg % 10),
+              (unsigned)(max / 10), (unsigned)(max % 10));
+        for (k = 0; k < PROF_HIST_BINS; ++k) {
+            if (p.hist[k] == 0) continue;
+            // Bin k is below PROF_HIST_MIN << k, the last one is open
+            edge = ticks_to_tenth_us((uint64_t)PROF_HIST_MIN << ((k < PROF_HIST_BINS - 1) ? k : k - 1));
+            print("  %s%u.%u us: %u\n", (k < PROF_HIST_BINS - 1) ? "< " : ">=", (unsigned)(edge / 10),
+                  (unsigned)(edge % 10), (unsigned)p.hist[k]);
+        }
+    }
+}
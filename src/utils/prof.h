@@ -0,0 +1,79 @@
+/**
+ * @brief Profiler of the hot paths, min / avg / max and a histogram of the time each one takes
+ * @details
+ *   A probe is timed with PROF_START() and PROF_STOP(), on the free running timer 1 (24 bits at the HXT,
+ *   so HCLK changes of the governor don't move it, and a probe may take up to 1.39 s). Reading it is one load,
+ *   recording is a few adds and a loop over the bits of the time, no printing, so it can stay in an IRQ handler.
+ *   Each probe must have one writer, an IRQ handler or the main loop, prof_dump() copies it with interrupts masked.
+ *   The histogram bins are powers of two, bin k holds times from PROF_HIST_MIN << (k - 1) ticks.
+ *
+ *   Built with PROF_HOST it runs on a PC, the clock is clock_gettime() in ns.
+ *   With PROFILING set to 0 the probes compile to nothing.
+ */
+
+#ifndef _PROF_H_
+#define _PROF_H_
+
+#include <stdint.h>
+
+// 1 to time the probes, 0 to leave them out
+#ifndef PROFILING
+#define PROFILING 1
+#endif
+
+#define PROF_HIST_BINS 16
+#define PROF_HIST_MIN 8     // Ticks, the upper end of bin 0
+
+#ifdef PROF_HOST
+#define PROF_CLOCK_HZ 1000000000u
+#define PROF_MASK 0xFFFFFFFFu
+uint32_t prof_host_clock(void);
+#define PROF_NOW() prof_host_clock()
+#else
+#include "NUC100Series.h"
+#define PROF_CLOCK_HZ __HXT
+#define PROF_MASK 0x00FFFFFFu
+#define PROF_NOW() (TIMER1->TDR)
+#endif
+
+/**
+ * @brief The probes, each one is a hot path
+ */
+typedef enum prof_probe_id_t {
+    PROF_I2S_ISR,       // I2S_IRQHandler(), a FIFO threshold interrupt
+    PROF_REFILL_READ,   // f_read() of a PCM buffer
+    PROF_DISK_READ,     // disk_read(), the sectors from the SD card
+    PROF_LCD_SHOW,      // mlh_show_lcd(), a blocking frame
+    PROF_CODEC_WRITE,   // I2C_WriteWAU8822(), one register
+    PROF_SW_FILTER,     // apply_sw_filter(), a PCM buffer through the biquad cascade
+    PROF_VIS_FFT,       // The FFT and the magnitudes of a visualizer frame
+    PROF_PROBE_NUM,
+} prof_probe_id_t;
+
+/**
+ * @brief Statistics of a probe, in ticks of PROF_CLOCK_HZ
+ */
+typedef struct prof_probe_t {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+    uint32_t hist[PROF_HIST_BINS];
+} prof_probe_t;
+
+#if (PROFILING == 1)
+// Start of a probe, keep it in a uint32_t
+#define PROF_START() ((uint32_t)PROF_NOW())
+#define PROF_STOP(id, start) prof_record((id), ((uint32_t)PROF_NOW() - (start)) & PROF_MASK)
+#else
+#define PROF_START() 0
+#define PROF_STOP(id, start) ((void)(start))
+#endif
+
+void prof_init(void);
+void prof_record(prof_probe_id_t id, uint32_t ticks);
+void prof_reset(void);
+void prof_get(prof_probe_id_t id, prof_probe_t *p);
+void prof_dump(void (*print)(const char *format, ...));
+
+#endif // _PROF_H_
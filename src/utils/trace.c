@@ -0,0 +1,185 @@
+#include <string.h>
+
+#include "trace.h"
+
+// Orders the record against its sequence number, a compiler barrier is enough on the single core M0
+#ifdef TRACE_HOST
+#define TRACE_BARRIER() __sync_synchronize()
+#else
+#include "NUC100Series.h"
+#define TRACE_BARRIER() __DMB()
+#endif
+
+static trace_rec_t s_ring[TRACE_RING_SIZE];
+// Free running indexes, head is reserved by the writers, tail is taken by the consumer
+static volatile uint32_t s_head = 0;
+static volatile uint32_t s_tail = 0;
+static volatile uint32_t s_dropped = 0;
+static volatile uint32_t s_peak = 0;
+static uint32_t (*s_now)(void);
+
+// Consumer only: the record being sent, and the drops already reported
+static uint8_t s_out[TRACE_REC_SIZE];
+static uint8_t s_out_len = 0, s_out_off = 0;
+static uint32_t s_dropped_sent = 0;
+
+/**
+ * @brief Take the next index for a writer
+ * @param idx[out] The index
+ * @return false if the ring is full, the record is counted as dropped
+ */
+static bool reserve(uint32_t *idx)
+{
+#ifdef TRACE_HOST
+    uint32_t i = __atomic_load_n(&s_head, __ATOMIC_RELAXED);
+
+    do {
+        if (i - s_tail >= TRACE_RING_SIZE) {
+            __atomic_fetch_add(&s_dropped, 1, __ATOMIC_RELAXED);
+            return false;
+        }
+    } while (!__atomic_compare_exchange_n(&s_head, &i, i + 1, true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+    // Not exact with several threads, good enough for sizing
+    if (i + 1 - s_tail > s_peak) s_peak = i + 1 - s_tail;
+    *idx = i;
+    return true;
+#else
+    // No LDREX/STREX on the M0, so the interrupts are masked for the few instructions of the reservation
+    uint32_t primask = __get_PRIMASK();
+    bool ok;
+
+    __disable_irq();
+    ok = (s_head - s_tail) < TRACE_RING_SIZE;
+    if (ok) {
+        *idx = s_head;
+        s_head += 1;
+        if (s_head - s_tail > s_peak) s_peak = s_head - s_tail;
+    } else {
+        s_dropped += 1;
+    }
+    __set_PRIMASK(primask);
+    return ok;
+#endif
+}
+
+/**
+ * @brief Start an empty trace, before the interrupts that write to it, and write a START record
+ * @param now Clock of the timestamps, wraps around
+ * @param clock_hz Its frequency, for the decoder
+ */
+void trace_init(uint32_t (*now)(void), uint32_t clock_hz)
+{
+    uint32_t i;
+
+    s_now = now;
+    s_head = 0;
+    s_tail = 0;
+    s_dropped = 0;
+    s_peak = 0;
+    s_dropped_sent = 0;
+    s_out_len = 0;
+    s_out_off = 0;
+    // Not committed, a slot is committed when its seq is the index the consumer waits for
+    for (i = 0; i < TRACE_RING_SIZE; ++i) {
+        s_ring[i].seq = (uint16_t)(i - TRACE_RING_SIZE);
+    }
+    trace_write(TRACE_START, clock_hz, TRACE_RING_SIZE);
+}
+
+/**
+ * @brief Add a record, from any context, use TRACE() instead
+ * @param id The event
+ * @param a First argument
+ * @param b Second argument
+ */
+void trace_write(trace_id_t id, uint32_t a, uint32_t b)
+{
+    uint32_t time = s_now(), idx;
+    trace_rec_t *r;
+
+    if (!reserve(&idx)) return;
+    r = &s_ring[idx & (TRACE_RING_SIZE - 1)];
+    r->time = time;
+    r->magic = TRACE_MAGIC;
+    r->id = (uint8_t)id;
+    r->a = a;
+    r->b = b;
+    // The consumer must see the record before its sequence number
+    TRACE_BARRIER();
+    *(volatile uint16_t *)&r->seq = (uint16_t)idx;
+}
+
+/**
+ * @brief Checks if there is anything to drain, no side effects
+ */
+bool trace_pending(void)
+{
+    const trace_rec_t *r = &s_ring[s_tail & (TRACE_RING_SIZE - 1)];
+
+    return s_out_off < s_out_len || s_dropped != s_dropped_sent ||
+           *(const volatile uint16_t *)&r->seq == (uint16_t)s_tail;
+}
+
+/**
+ * @brief Most records that ever waited in the ring, for sizing TRACE_RING_SIZE
+ */
+uint32_t trace_peak(void)
+{
+    return s_peak;
+}
+
+/**
+ * @brief Take the next record to send, from the consumer
+ * @return false if there is none, or the next one isn't committed yet
+ */
+static bool next_record(void)
+{
+    trace_rec_t *r = &s_ring[s_tail & (TRACE_RING_SIZE - 1)];
+    trace_rec_t d;
+    uint32_t dropped = s_dropped;
+
+    if (dropped != s_dropped_sent) {
+        // Not in the ring, it would need a free slot just when there is none
+        d.time = s_now();
+        d.magic = TRACE_MAGIC;
+        d.id = TRACE_DROPPED;
+        d.seq = 0;
+        d.a = dropped - s_dropped_sent;
+        d.b = 0;
+        s_dropped_sent = dropped;
+        memcpy(s_out, &d, TRACE_REC_SIZE);
+    } else {
+        if (*(volatile uint16_t *)&r->seq != (uint16_t)s_tail) return false;
+        TRACE_BARRIER();
+        memcpy(s_out, r, TRACE_REC_SIZE);
+        // The writers may take the slot again
+        TRACE_BARRIER();
+        s_tail += 1;
+    }
+    s_out_len = TRACE_REC_SIZE;
+    s_out_off = 0;
+    return true;
+}
+
+/**
+ * @brief Send records to a sink, from the consumer only
+ * @details A record the sink takes only a part of is continued on the next call
+ * @param sink Takes up to len bytes, returns how many it took, 0 if it can't take any now
+ * @param max_bytes Bytes to send at most in this call
+ * @return Bytes sent
+ */
+uint32_t trace_drain(uint32_t (*sink)(const uint8_t *data, uint32_t len), uint32_t max_bytes)
+{
+    uint32_t sent = 0, len, n;
+
+    while (sent < max_bytes) {
+        if (s_out_off >= s_out_len && !next_record()) break;
+        len = s_out_len - s_out_off;
+        if (len > max_bytes - sent) len = max_bytes - sent;
+        n = sink(&s_out[s_out_off], len);
+        if (n == 0) break;
+        s_out_off += n;
+        sent += n;
+    }
+    return sent;
+}
@@ -0,0 +1,83 @@
+/**
+ * @brief Binary event trace, fixed size records in a RAM ring, written from any context and drained later
+ * @details
+ *   TRACE() stores a timestamp, the event and two arguments in the ring, it never prints or waits, so it can
+ *   stay in the IRQ handlers where a printf would break the timing. Any number of interrupt handlers and
+ *   the main loop may write, a writer reserves its record with a few instructions, then fills it and
+ *   commits it with its sequence number. A full ring drops the new record and counts it.
+ *   One consumer (a low priority task) calls trace_drain() with a sink, e.g. the UART or a file, it sends
+ *   the committed records in order as raw bytes, and a DROPPED record when some were lost.
+ *
+ *   On the wire a record is 16 bytes, little endian, laid out as trace_rec_t. The magic byte lets the
+ *   decoder (trace_decode.c) find the records again after garbage, like text on the same UART.
+ *   The records are in the order of their sequence numbers, the time of a record whose writer was
+ *   interrupted right after taking it can be older than the one before.
+ *
+ *   Built with TRACE_HOST it runs on a PC. With TRACING set to 0 the TRACE() calls compile to nothing.
+ */
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// 1 to record the events, 0 to leave them out
+#ifndef TRACING
+#define TRACING 1
+#endif
+
+#define TRACE_RING_SIZE 64      // Records, a power of 2
+#define TRACE_REC_SIZE 16       // Bytes of a record on the wire
+#define TRACE_MAGIC 0x7E
+
+/**
+ * @brief The events, X(name, argument a, argument b), the decoder names them from the same list
+ */
+#define TRACE_EVENTS(X) \
+    X(START,       "clock_hz",    "ring_size") \
+    X(DROPPED,     "count",       "-")         \
+    X(EINT1,       "-",           "-")         \
+    X(KEY,         "key",         "down")      \
+    X(REFILL_REQ,  "frames_left", "-")         \
+    X(REFILL_DONE, "bytes",       "read_ticks") \
+    X(UNDERRUN,    "frames_left", "-")         \
+    X(SONG_END,    "frames",      "-")         \
+    X(SEEK,        "frame",       "delta_sec") \
+    X(PAUSE,       "paused",      "-")         \
+    X(HCLK,        "mhz",         "awake_permille") \
+    X(PLAYBACK_TX, "words",       "buffered")  \
+    X(PLAYBACK_RX, "words",       "buffered")
+
+typedef enum trace_id_t {
+#define TRACE_ENUM(name, a, b) TRACE_##name,
+    TRACE_EVENTS(TRACE_ENUM)
+#undef TRACE_ENUM
+    TRACE_ID_NUM,
+} trace_id_t;
+
+/**
+ * @brief A record, also its layout on the wire
+ */
+typedef struct trace_rec_t {
+    uint32_t time;      // Ticks of the clock given to trace_init()
+    uint8_t magic;      // TRACE_MAGIC
+    uint8_t id;         // trace_id_t
+    uint16_t seq;       // Sequence number, a gap on the wire means bytes were lost after the ring
+    uint32_t a;
+    uint32_t b;
+} trace_rec_t;
+
+#if (TRACING == 1)
+#define TRACE(name, a, b) trace_write(TRACE_##name, (uint32_t)(a), (uint32_t)(b))
+#else
+#define TRACE(name, a, b) ((void)0)
+#endif
+
+void trace_init(uint32_t (*now)(void), uint32_t clock_hz);
+void trace_write(trace_id_t id, uint32_t a, uint32_t b);
+bool trace_pending(void);
+uint32_t trace_peak(void);
+uint32_t trace_drain(uint32_t (*sink)(const uint8_t *data, uint32_t len), uint32_t max_bytes);
+
+#endif // _TRACE_H_
@@ -1,17 +1,56 @@
 #include <stdio.h>
+#include <stdint.h>
+#ifndef WAU8822_HOST
 #include "MCU_init.h"
 #include "NUC100Series.h"
 #include "SYS_init.h"
 #include "NVT_I2C.h"
+#endif
 
 #include "wau8822.h"
+#include "prof.h"
+#ifdef WAU8822_HOST
+#include "debug_printf.h"
+#else
 #include "DEBUG_PRINTF.h"
+#endif
+
+/* Reset values of register 0 ~ 61, from the register overview in the datasheet */
+static const uint16_t s_au16RegDefault[WAU8822_REG_CACHE_NUM] = {
+    0x000, 0x000, 0x000, 0x000, 0x050, 0x000, 0x140, 0x000, 0x000, 0x000,   /*  0 ~  9 */
+    0x000, 0x0FF, 0x0FF, 0x000, 0x100, 0x0FF, 0x0FF, 0x000, 0x12C, 0x02C,   /* 10 ~ 19 */
+    0x02C, 0x02C, 0x02C, 0x000, 0x032, 0x000, 0x000, 0x000, 0x000, 0x000,   /* 20 ~ 29 */
+    0x000, 0x000, 0x038, 0x00B, 0x032, 0x010, 0x008, 0x00C, 0x093, 0x0E9,   /* 30 ~ 39 */
+    0x000, 0x000, 0x000, 0x000, 0x033, 0x010, 0x010, 0x100, 0x100, 0x002,   /* 40 ~ 49 */
+    0x001, 0x001, 0x039, 0x039, 0x039, 0x039, 0x001, 0x001, 0x000, 0x000,   /* 50 ~ 59 */
+    0x020, 0x000,                                                           /* 60 ~ 61 */
+};
+
+/* The codec is write only through I2C here, so keep a copy of what has been written */
+static uint16_t s_au16RegCache[WAU8822_REG_CACHE_NUM];
+
+/* Set once WAU8822_Setup() has configured the codec, the registers are kept in standby */
+static uint8_t s_u8SetUp = 0;
+static WAU8822_Power_t s_ePower = WAU8822_POWER_OFF;
 
 /*---------------------------------------------------------------------------------------------------------*/
 /*  Write 9-bit data to 7-bit address register of WAU8822 with I2C0                                        */
 /*---------------------------------------------------------------------------------------------------------*/
 void I2C_WriteWAU8822(uint8_t u8addr, uint16_t u16data)
 {
+    uint32_t i;
+    uint32_t u32ProfStart = PROF_START();
+
+    /* Keep the register cache in sync */
+    if (u8addr == 0) {
+        for (i = 0; i < WAU8822_REG_CACHE_NUM; ++i) s_au16RegCache[i] = s_au16RegDefault[i];
+    } else if (u8addr < WAU8822_REG_CACHE_NUM) {
+        s_au16RegCache[u8addr] = u16data & 0x1FF;
+    }
+
+#ifdef WAU8822_HOST
+    WAU8822_HostWrite(u8addr, u16data);
+#else
     /* Send START */
     I2C_START(I2C0);
     I2C_WAIT_READY(I2C0);
@@ -33,6 +72,37 @@ void I2C_WriteWAU8822(uint8_t u8addr, uint16_t u16data)
 
     /* Send STOP */
     I2C_STOP(I2C0);
+#endif
+    PROF_STOP(PROF_CODEC_WRITE, u32ProfStart);
+}
+
+/**
+ * @brief Read back the value last written to the register
+ * @param u8addr Register address, 1 ~ 61
+ * @return The cached value
+ */
+uint16_t WAU8822_ReadCache(uint8_t u8addr)
+{
+    if (u8addr >= WAU8822_REG_CACHE_NUM) return 0;
+    return s_au16RegCache[u8addr];
+}
+
+/**
+ * @brief Change some bits of a register, the I2C write is skipped if nothing changes
+ * @param u8addr Register address, 1 ~ 61
+ * @param u16mask The bits to change
+ * @param u16data New value of the bits
+ */
+void WAU8822_UpdateBits(uint8_t u8addr, uint16_t u16mask, uint16_t u16data)
+{
+    uint16_t u16new;
+
+    if (u8addr == 0 || u8addr >= WAU8822_REG_CACHE_NUM) return;
+
+    u16new = (s_au16RegCache[u8addr] & ~u16mask) | (u16data & u16mask);
+    if (u16new != s_au16RegCache[u8addr]) {
+        I2C_WriteWAU8822(u8addr, u16new);
+    }
 }
 
 static void RoughDelay(uint32_t t)
@@ -44,105 +114,116 @@ static void RoughDelay(uint32_t t)
     while(delay-- >= 0);
 }
 
+/* Clock tree of the codec, fed by the 12MHz MCLK from the NUC140 (I2S_EnableMCLK)
+ *   MCLK -> [/2 if PLLMCLK] -> f1 -> PLL (x N.K) -> f2 -> /4 -> [MCLKSEL] -> IMCLK (256 * fs) -> [BCLKSEL] -> BCLK
+ * The PLL only locks with 6 <= N <= 12, and f2 should stay within 90MHz ~ 100MHz (see datasheet, PLL section) */
+#define WAU8822_MCLK_IN         12000000
+#define WAU8822_PLL_F2_MIN      90000000
+#define WAU8822_PLL_F2_MAX      100000000
+#define WAU8822_PLL_N_MIN       6
+#define WAU8822_PLL_N_MAX       12
+/* BCLK = IMCLK / 8 = 32 * fs, which is 16-bit stereo */
+#define WAU8822_BCLKSEL_DIV8    3
+
+/* MCLKSEL dividers (register 6, bits 7:5), in unit of 0.5 */
+static const uint8_t s_au8MclkDivHalf[8] = {2, 3, 4, 6, 8, 12, 16, 24};
+
+/* Sample rates of the internal filter coefficients (register 7, SMPLR bits 3:1) */
+static const uint32_t s_au32FilterRate[6] = {48000, 32000, 24000, 16000, 12000, 8000};
+
+/**
+ * @brief Solve the PLL and divider settings for the sample rate
+ * @param u32SampleRate The sample rate to solve for
+ * @param psCfg[out] The solved settings, only written if solved
+ * @return 0 if success, 1 if no setting gives a PLL ratio that locks (6 <= N <= 12), or the rate is 0
+ * @details
+ *   Every combination of PLL prescaler and MCLK divider is tried, the one that keeps f2 in range is picked.
+ *   If f2 is out of range for all of them, the one closest to the range is used. If no combination gives a ratio that
+ *   locks, 1 is returned and psCfg is left as it was. WAU8822_ConfigSampleRate() then returns 0 without touching the
+ *   clock registers, and the player ends the song like a format it can't play.
+ *   The rates with a PLL that locks are about 2.9 kHz ~ 140 kHz, so 176.4 kHz and 192 kHz can't be solved.
+ */
+uint8_t WAU8822_SolveClock(uint32_t u32SampleRate, WAU8822_ClkCfg_t *psCfg)
+{
+    uint64_t u64F2, u64Num;
+    uint32_t u32F1, u32Dist, u32BestDist = 0xFFFFFFFF;
+    uint32_t u32Pre, u32Sel, i;
+    int64_t i64Err;
+    WAU8822_ClkCfg_t sCfg;
+
+    if (u32SampleRate == 0) return 1;
+    for (u32Pre = 0; u32Pre < 2; ++u32Pre) {
+        u32F1 = WAU8822_MCLK_IN >> u32Pre;
+        for (u32Sel = 0; u32Sel < 8; ++u32Sel) {
+            // f2 = 256 * fs * 4 * (div_half / 2)
+            u64F2 = (uint64_t)u32SampleRate * 512 * s_au8MclkDivHalf[u32Sel];
+            if ((u64F2 / u32F1) < WAU8822_PLL_N_MIN || (u64F2 / u32F1) > WAU8822_PLL_N_MAX) continue;
+
+            if (u64F2 < WAU8822_PLL_F2_MIN) u32Dist = WAU8822_PLL_F2_MIN - (uint32_t)u64F2;
+            else if (u64F2 > WAU8822_PLL_F2_MAX) u32Dist = (uint32_t)u64F2 - WAU8822_PLL_F2_MAX;
+            else u32Dist = 0;
+
+            if (u32Dist < u32BestDist) {
+                u32BestDist = u32Dist;
+                sCfg.u8PllPrescale = (uint8_t)u32Pre;
+                sCfg.u8PllN = (uint8_t)(u64F2 / u32F1);
+                sCfg.u32PllK = (uint32_t)(((u64F2 % u32F1) << 24) / u32F1);
+                sCfg.u8MclkSel = (uint8_t)u32Sel;
+            }
+        }
+    }
+    // No ratio in the lock range, the PLL would run off
+    if (u32BestDist == 0xFFFFFFFF) return 1;
+
+    sCfg.u8BclkSel = WAU8822_BCLKSEL_DIV8;
+
+    // Pick the nearest filter coefficient set
+    sCfg.u8Smplr = 0;
+    for (i = 1; i < 6; ++i) {
+        if (u32SampleRate <= (s_au32FilterRate[i] + s_au32FilterRate[i - 1]) / 2) sCfg.u8Smplr = (uint8_t)i;
+    }
+
+    // Rate that comes out of the solved setting: fs = f2 / (512 * div_half), f2 = f1 * (N + K / 2^24)
+    u32F1 = WAU8822_MCLK_IN >> sCfg.u8PllPrescale;
+    u64Num = (uint64_t)u32F1 * (((uint64_t)sCfg.u8PllN << 24) + sCfg.u32PllK);
+    sCfg.u32ActualRate = (uint32_t)((u64Num + ((uint64_t)s_au8MclkDivHalf[sCfg.u8MclkSel] << 32)) / ((uint64_t)s_au8MclkDivHalf[sCfg.u8MclkSel] << 33));
+
+    i64Err = ((int64_t)sCfg.u32ActualRate - (int64_t)u32SampleRate) * 1000000;
+    sCfg.i32ErrorPpm = (int32_t)(i64Err / (int64_t)u32SampleRate);
+
+    *psCfg = sCfg;
+    return 0;
+}
+
 /**
  * @brief Configure WAU8822 base on the sample rate
  * @param u32SampleRate 
+ * @return The sample rate that the codec actually runs at, 0 if the rate can't be solved, the clock registers are then left as they were
  */
-void WAU8822_ConfigSampleRate(uint32_t u32SampleRate)
+uint32_t WAU8822_ConfigSampleRate(uint32_t u32SampleRate)
 {
+    WAU8822_ClkCfg_t sCfg;
+
     DEBUG_PRINTF("[NAU8822] Configure Sampling Rate to %d\n", u32SampleRate);
 
-    if((u32SampleRate % 8) == 0) {
-        I2C_WriteWAU8822(36, 0x008);    //12.288Mhz
-        I2C_WriteWAU8822(37, 0x00C);
-        I2C_WriteWAU8822(38, 0x093);
-        I2C_WriteWAU8822(39, 0x0E9);
-    } else if(u32SampleRate == 44100) {
-        // I2C_WriteWAU8822(36, 0x007);    //11.2896Mhz, for 44.1k
-        // I2C_WriteWAU8822(37, 0x021);
-        // I2C_WriteWAU8822(38, 0x161);
-        // I2C_WriteWAU8822(39, 0x026);
-        I2C_WriteWAU8822(36, 0x008);    //12.288Mhz
-        I2C_WriteWAU8822(37, 0x00C);
-        I2C_WriteWAU8822(38, 0x093);
-        I2C_WriteWAU8822(39, 0x0E9);
-    } else {
-        I2C_WriteWAU8822(36, 0x00B);    //16.934Mhz
-        I2C_WriteWAU8822(37, 0x011);
-        I2C_WriteWAU8822(38, 0x153);
-        I2C_WriteWAU8822(39, 0x1F0);
+    if (WAU8822_SolveClock(u32SampleRate, &sCfg) != 0) {
+        DEBUG_PRINTF("[NAU8822] No PLL setting for %d Hz\n", u32SampleRate);
+        return 0;
     }
+    DEBUG_PRINTF("[NAU8822] N=%d K=0x%06X MCLKSEL=%d, actual %d Hz (%d ppm)\n",
+                 sCfg.u8PllN, sCfg.u32PllK, sCfg.u8MclkSel, sCfg.u32ActualRate, sCfg.i32ErrorPpm);
 
-    switch (u32SampleRate) {
-    case 16000:
-        I2C_WriteWAU8822(6, 0x1AD);   /* Divide by 6, 16K */
-        I2C_WriteWAU8822(7, 0x006);   /* 16K for internal filter cofficients */
-        break;
-
-    case 32000:
-        I2C_WriteWAU8822(6, 0x16D);    /* Divide by 3, 32K */
-        I2C_WriteWAU8822(7, 0x002);    /* 32K for internal filter cofficients */
-        break;
-
-    case 44100:
-        // duriation super long
-        // I2C_WriteWAU8822(6, 0x1C7); // PLL divide by 4 for 44.1 kHz
-        // I2C_WriteWAU8822(7, 0x000); // Internal filter coefficients
-
-        // weird sound, and a little longer than 5 seconds (Do_5sec.wav)
-        I2C_WriteWAU8822(6, 0x14D);    /* Divide by 1, 48K */
-        I2C_WriteWAU8822(7, 0x000);    /* 48K for internal filter cofficients */
-
-        // slow
-        // I2C_WriteWAU8822(6, 0x187); // PLL divider for 44.1 kHz
-        // I2C_WriteWAU8822(7, 0x000); // Filter coefficients for 44.1 kHz
-
-        // slow
-        // I2C_WriteWAU8822(6, 0x16D);    /* Divide by 3, 32K */
-        // I2C_WriteWAU8822(7, 0x002);    /* 32K for internal filter cofficients */
-        break;
-
-    case 48000:
-        I2C_WriteWAU8822(6, 0x14D);    /* Divide by 1, 48K */
-        I2C_WriteWAU8822(7, 0x000);    /* 48K for internal filter cofficients */
-        break;
-
-    case 11025:
-        I2C_WriteWAU8822(6, 0x1ED);    /* Divide by 12 */
-        break;
-
-    case 22050:
-        I2C_WriteWAU8822(6, 0x1AD);    /* Divide by 6 */
-        // I2C_WriteWAU8822(7, 0x006);    /* 16K for internal filter cofficients */
-
-        // slow
-        // I2C_WriteWAU8822(6, 0x1ED);    /* Divide by 12 */
-        // I2C_WriteWAU8822(7, 0x008);    /* 48K for internal filter cofficients */
-
-        // fast
-        // I2C_WriteWAU8822(6, 0x14D);    /* Divide by 1, 48K */
-        // I2C_WriteWAU8822(7, 0x000);    /* 48K for internal filter cofficients */
-
-        // still fast
-        // I2C_WriteWAU8822(6, 0x16D);    /* Divide by 3, 32K */
-        // I2C_WriteWAU8822(7, 0x002);    /* 32K for internal filter cofficients */
-
-        // Ok
-        // I2C_WriteWAU8822(6, 0x185); // PLL divider for 44.1 kHz, divide by 4
-        // I2C_WriteWAU8822(6, 0x181); // PLL divider for 44.1 kHz, divide by 4
-        // I2C_WriteWAU8822(7, 0x00A); // Filter coefficients for 44.1 kHz
-        break;
-
-    case 192000:
-//      I2C_WriteWAU8822(6, 0x109);     //16bit/192k
-        I2C_WriteWAU8822(6, 0x105);     //32bit/192k
-        I2C_WriteWAU8822(72, 0x017);
-        break;
-    default:
-        I2C_WriteWAU8822(6, 0x1ED);   /* Divide by 12, 8K */
-        I2C_WriteWAU8822(7, 0x00A);   /* 8K for internal filter coefficients */
-        break;
-    }
+    I2C_WriteWAU8822(36, (sCfg.u8PllPrescale << 4) | sCfg.u8PllN);
+    I2C_WriteWAU8822(37, (sCfg.u32PllK >> 18) & 0x03F);
+    I2C_WriteWAU8822(38, (sCfg.u32PllK >> 9) & 0x1FF);
+    I2C_WriteWAU8822(39, sCfg.u32PllK & 0x1FF);
+
+    /* Clock from PLL, MCLK divider, BCLK divider, master mode */
+    I2C_WriteWAU8822(6, 0x101 | (sCfg.u8MclkSel << 5) | (sCfg.u8BclkSel << 2));
+    /* Internal filter coefficients */
+    I2C_WriteWAU8822(7, sCfg.u8Smplr << 1);
+
+    return sCfg.u32ActualRate;
 }
 
 /**
@@ -157,9 +238,7 @@ void WAU8822_Setup(void)
     RoughDelay(0x200);
 
 #if 1
-	I2C_WriteWAU8822(1,  0x02F);        
-	I2C_WriteWAU8822(2,  0x1B3);	// Enable L/R Headphone, ADC Mix/Boost, ADC
-    I2C_WriteWAU8822(3,  0x07F);   /* Enable L/R main mixer, DAC */
+    /* Registers 1 ~ 3 stay off after the reset, WAU8822_SetPowerProfile() powers the blocks of the mode */
     I2C_WriteWAU8822(4,  0x010);   /* 16-bit word length, I2S format, Stereo */
     I2C_WriteWAU8822(5,  0x000);   /* Companding control and loop back mode (all disable) */
 
@@ -188,7 +267,7 @@ void WAU8822_Setup(void)
 	I2C_WriteWAU8822(47, 0x007);	// LLIN connected, and its Gain value
 	I2C_WriteWAU8822(48, 0x007);	// RLIN connected, and its Gain value
 	// I2C_WriteWAU8822(49, 0x047);
-	I2C_WriteWAU8822(49, 0x0F7);
+	I2C_WriteWAU8822(49, 0x0F7);	// LDACRMX and RDACLMX (0x060) set, each DAC goes to both output mixers
 	// I2C_WriteWAU8822(50, 0x001);	// Left DAC connected to LMIX
 	// I2C_WriteWAU8822(51, 0x001);	// Right DAC connected to RMIX
  	I2C_WriteWAU8822(54, 0x139);	// LSPKOUT Volume
@@ -213,13 +292,265 @@ void WAU8822_Setup(void)
     I2C_WriteWAU8822(51, 0x001);   /* Right DAC connected to RMIX */
 #endif
 
+#ifndef WAU8822_HOST
     GPIO_SetMode(PE, BIT14 | BIT15, GPIO_MODE_OUTPUT);
     PE14 = 0;
     PE15 = 0;
+#endif
 
+    s_u8SetUp = 1;
+    s_ePower = WAU8822_POWER_OFF;
     DEBUG_PRINTF("[OK]\n");
 }
 
+/**
+ * @brief Check if WAU8822_Setup() has been done, after that the codec only needs to be woken up
+ * @return 1 if set up
+ */
+uint8_t WAU8822_IsSetUp(void)
+{
+    return s_u8SetUp;
+}
+
+/* Power management registers 1 ~ 3 of each profile
+ *   1: PLLEN (0x020), ABIASEN (0x008), IOBUFEN (0x004), REFIMP (bits 1:0, 1 = 80k, 2 = 300k, 3 = 3k)
+ *   2: RHPEN, LHPEN (0x180), SLEEP (0x040), R/LBSTEN (0x030), R/LPGAEN (0x00C), R/LADCEN (0x003)
+ *   3: R/LSPKEN (0x060), R/LMIXEN (0x00C), R/LDACEN (0x003), and bit 4 as WAU8822_Setup() always had it */
+static const uint16_t s_au16PowerReg[WAU8822_POWER_NUM][3] = {
+    {0x000, 0x000, 0x000},  /* Off */
+    {0x002, 0x040, 0x000},  /* Standby, VREF held through 300k */
+    {0x02D, 0x180, 0x07F},  /* Playback */
+    {0x02D, 0x033, 0x000},  /* Capture, AUXIN through the boost stage (registers 47, 48) */
+    {0x02D, 0x1B3, 0x07F},  /* Duplex, as WAU8822_Setup() used to power it */
+};
+#define WAU8822_PWR2_DRIVERS    0x180
+#define WAU8822_PWR3_DRIVERS    0x1E0
+#define WAU8822_PWR3_DAC        0x003
+
+/* VREF charge from off with the 3k divider, and the soft mute ramp of the DAC */
+#define WAU8822_VREF_CHARGE_MS  100
+#define WAU8822_MUTE_MS         10
+
+/**
+ * @brief Busy wait, from SysTick so it doesn't depend on HCLK
+ */
+static void DelayMs(uint32_t u32Ms)
+{
+#ifdef WAU8822_HOST
+    (void)u32Ms;
+#else
+    while (u32Ms--) CLK_SysTickDelay(1000);
+#endif
+}
+
+/**
+ * @brief Mute or unmute the headphone and speaker outputs, and soft mute the DAC
+ * @details The right channel register is written with the update bit, so both channels change together
+ */
+static void MuteOutputs(uint8_t u8Mute)
+{
+    uint16_t u16Mute = u8Mute ? 0x040 : 0;
+
+    WAU8822_UpdateBits(10, 0x040, u16Mute);
+    WAU8822_UpdateBits(52, 0x040, u16Mute);
+    WAU8822_UpdateBits(53, 0x140, 0x100 | u16Mute);
+    WAU8822_UpdateBits(54, 0x040, u16Mute);
+    WAU8822_UpdateBits(55, 0x140, 0x100 | u16Mute);
+}
+
+/**
+ * @brief Power the blocks of a mode and nothing else, in an order that doesn't pop
+ * @details Muted first, then the output drivers go off before what feeds them, and come on after it.
+ *          VREF is charged fast through 3k only when it was off. In standby it is held, so waking up takes
+ *          only the I2C writes and the PLL lock, and the other registers are kept, no WAU8822_Setup() needed.
+ *          Only changed registers are written, see WAU8822_UpdateBits()
+ * @param ePower The profile
+ * @note Call it while MCLK runs, the PLL needs it to lock
+ */
+void WAU8822_SetPowerProfile(WAU8822_Power_t ePower)
+{
+    const uint16_t *pu16Old, *pu16New;
+
+    if (ePower >= WAU8822_POWER_NUM || ePower == s_ePower) return;
+    pu16Old = s_au16PowerReg[s_ePower];
+    pu16New = s_au16PowerReg[ePower];
+
+    /* Mute, and let the DAC ramp down if it was playing */
+    MuteOutputs(1);
+    if (pu16Old[2] & WAU8822_PWR3_DAC) DelayMs(WAU8822_MUTE_MS);
+
+    /* Output drivers the new profile doesn't use go off first */
+    WAU8822_UpdateBits(2, WAU8822_PWR2_DRIVERS, pu16Old[1] & pu16New[1]);
+    WAU8822_UpdateBits(3, WAU8822_PWR3_DRIVERS, pu16Old[2] & pu16New[2]);
+
+    /* Bias up: out of sleep, and VREF charged fast if it was off */
+    if (pu16New[0] & 0x008) {
+        if ((WAU8822_ReadCache(1) & 0x003) == 0) {
+            WAU8822_UpdateBits(1, 0x00F, 0x00F);
+            DelayMs(WAU8822_VREF_CHARGE_MS);
+        }
+        WAU8822_UpdateBits(2, 0x040, 0);
+        WAU8822_UpdateBits(1, 0x1FF, pu16New[0]);
+    }
+
+    /* Mixers, DAC, ADC, boost and PGA */
+    WAU8822_UpdateBits(2, ~WAU8822_PWR2_DRIVERS & 0x1BF, pu16New[1]);
+    WAU8822_UpdateBits(3, ~WAU8822_PWR3_DRIVERS & 0x1FF, pu16New[2]);
+
+    /* Output drivers of the new profile, still muted */
+    WAU8822_UpdateBits(2, WAU8822_PWR2_DRIVERS, pu16New[1]);
+    WAU8822_UpdateBits(3, WAU8822_PWR3_DRIVERS, pu16New[2]);
+
+    /* Bias down last, into sleep */
+    if (!(pu16New[0] & 0x008)) {
+        WAU8822_UpdateBits(1, 0x1FF, pu16New[0]);
+        WAU8822_UpdateBits(2, 0x040, pu16New[1]);
+    }
+
+    if (pu16New[2] & WAU8822_PWR3_DRIVERS) MuteOutputs(0);
+    s_ePower = ePower;
+}
+
+/**
+ * @brief The power profile set last
+ */
+WAU8822_Power_t WAU8822_GetPowerProfile(void)
+{
+    return s_ePower;
+}
+
+/* Hardware tone presets, gains in dB for band 1 (low shelf) to band 5 (high shelf) */
+static const WAU8822_ToneCfg_t s_asTonePreset[WAU8822_TONE_PRESET_NUM] = {
+    /* Gain (dB)              Freq sel          Wide  3D  Limiter, threshold, boost */
+    {{ 0,  0,  0,  0,  0}, {1, 1, 1, 1, 1}, 0x00,  0,  0, 0, 0},  /* Flat */
+    {{ 8,  4,  0,  0,  0}, {1, 0, 1, 1, 1}, 0x02,  0,  1, 0, 0},  /* Bass boost */
+    {{ 0,  0,  0,  3,  6}, {1, 1, 1, 2, 1}, 0x08,  0,  1, 0, 0},  /* Treble boost */
+    {{-4, -2,  2,  4,  0}, {2, 1, 2, 1, 1}, 0x0C,  0,  0, 0, 0},  /* Vocal */
+    {{ 6,  2,  0,  0,  4}, {0, 1, 1, 1, 2}, 0x02,  0,  1, 2, 4},  /* Loudness */
+    {{ 2,  0,  0,  0,  2}, {1, 1, 1, 1, 1}, 0x00, 10,  0, 0, 0},  /* Wide (3D) */
+};
+
+static const char s_aszTonePresetName[WAU8822_TONE_PRESET_NUM][9] = {
+    "Flat", "Bass", "Treble", "Vocal", "Loudness", "Wide",
+};
+
+/**
+ * @brief Encode one EQ band to its register value (register 18 ~ 22)
+ * @param u8Band Band number, 1 ~ 5
+ * @param u8FreqSel Cut-off or center frequency selection, 0 ~ 3 (see EQxCF in datasheet)
+ * @param i8GainDb Gain in dB, -12 ~ +12, clamped
+ * @param u8Wide 1 for wide band characteristic, only for band 2 ~ 4
+ * @return The 9-bit register value
+ * @note EQM (register 18 bit 8) is always set, so the EQ works on the DAC path
+ */
+uint16_t WAU8822_EncodeEqBand(uint8_t u8Band, uint8_t u8FreqSel, int8_t i8GainDb, uint8_t u8Wide)
+{
+    uint16_t u16data;
+
+    if (i8GainDb > 12) i8GainDb = 12;
+    if (i8GainDb < -12) i8GainDb = -12;
+
+    // 00000 is +12dB, 01100 is 0dB, 11000 is -12dB
+    u16data = (uint16_t)(12 - i8GainDb) | ((u8FreqSel & 0x3) << 5);
+
+    if (u8Band == 1) {
+        u16data |= 0x100;
+    } else if (u8Band >= 2 && u8Band <= 4 && u8Wide) {
+        u16data |= 0x100;
+    }
+    return u16data;
+}
+
+/**
+ * @brief Set one band of the codec's 5-band equalizer
+ * @param u8Band Band number, 1 ~ 5
+ * @param u8FreqSel Cut-off or center frequency selection, 0 ~ 3
+ * @param i8GainDb Gain in dB, -12 ~ +12
+ * @param u8Wide 1 for wide band characteristic, only for band 2 ~ 4
+ */
+void WAU8822_SetEqBand(uint8_t u8Band, uint8_t u8FreqSel, int8_t i8GainDb, uint8_t u8Wide)
+{
+    if (u8Band < 1 || u8Band > 5) return;
+    WAU8822_UpdateBits(17 + u8Band, 0x1FF, WAU8822_EncodeEqBand(u8Band, u8FreqSel, i8GainDb, u8Wide));
+}
+
+/**
+ * @brief Set the depth of 3D stereo enhancement
+ * @param u8Depth 0 (disabled) ~ 15 (100%), in 6.67% steps
+ */
+void WAU8822_Set3DDepth(uint8_t u8Depth)
+{
+    if (u8Depth > 15) u8Depth = 15;
+    WAU8822_UpdateBits(41, 0x00F, u8Depth);
+}
+
+/**
+ * @brief Set the DAC limiter, which is also used as the loudness boost on playback
+ * @param u8Enable 1 to enable the limiter
+ * @param u8Threshold Limiter threshold, 0 (-1dB) ~ 5 (-6dB)
+ * @param u8BoostDb Maximum boost in dB, 0 ~ 12
+ * @note Attack and decay are left to the datasheet defaults (272us and 4.36ms at 44.1kHz)
+ */
+void WAU8822_SetDacLimiter(uint8_t u8Enable, uint8_t u8Threshold, uint8_t u8BoostDb)
+{
+    if (u8Threshold > 5) u8Threshold = 5;
+    if (u8BoostDb > 12) u8BoostDb = 12;
+    WAU8822_UpdateBits(25, 0x07F, (u8Threshold << 4) | u8BoostDb);
+    WAU8822_UpdateBits(24, 0x100, u8Enable ? 0x100 : 0x000);
+}
+
+/**
+ * @brief Set the ALC, which works on the input PGA, for the recorder
+ * @param u8Enable 1 to enable the ALC on both channels
+ * @param u8TargetLevel Target level at ADC output, 0 (-22.5dBFS) ~ 15 (-1.5dBFS)
+ * @param u8Limiter 1 for limiter mode, 0 for normal ALC mode
+ */
+void WAU8822_SetAlc(uint8_t u8Enable, uint8_t u8TargetLevel, uint8_t u8Limiter)
+{
+    WAU8822_UpdateBits(33, 0x00F, u8TargetLevel & 0xF);
+    WAU8822_UpdateBits(34, 0x100, u8Limiter ? 0x100 : 0x000);
+    WAU8822_UpdateBits(32, 0x180, u8Enable ? 0x180 : 0x000);
+}
+
+/**
+ * @brief Program the EQ, 3D and limiter blocks of the codec
+ * @param psCfg The tone settings
+ * @details Only the registers that change are written, so it can be called while the audio is playing
+ */
+void WAU8822_SetTone(const WAU8822_ToneCfg_t *psCfg)
+{
+    uint8_t i;
+
+    for (i = 0; i < 5; ++i) {
+        WAU8822_SetEqBand(i + 1, psCfg->au8FreqSel[i], psCfg->ai8GainDb[i], (psCfg->u8WideMask >> i) & 1);
+    }
+    WAU8822_Set3DDepth(psCfg->u83DDepth);
+    WAU8822_SetDacLimiter(psCfg->u8LimEnable, psCfg->u8LimThreshold, psCfg->u8LimBoostDb);
+}
+
+/**
+ * @brief Apply one of the built-in tone presets
+ * @param ePreset The preset
+ */
+void WAU8822_ApplyTonePreset(WAU8822_TonePreset_t ePreset)
+{
+    if (ePreset >= WAU8822_TONE_PRESET_NUM) return;
+    DEBUG_PRINTF("[NAU8822] Tone preset %s\n", s_aszTonePresetName[ePreset]);
+    WAU8822_SetTone(&s_asTonePreset[ePreset]);
+}
+
+/**
+ * @brief Name of the tone preset, for showing on the LCD
+ * @param ePreset The preset
+ * @return The name
+ */
+const char *WAU8822_GetTonePresetName(WAU8822_TonePreset_t ePreset)
+{
+    if (ePreset >= WAU8822_TONE_PRESET_NUM) return "";
+    return s_aszTonePresetName[ePreset];
+}
+
+#ifndef WAU8822_HOST
 void Init_I2C(void)
 {
     I2C_Open(I2C0, I2C0_CLOCK_FREQUENCY);
@@ -234,3 +565,4 @@ void Init_I2C(void)
     I2C_EnableInt(I2C0);       // Enable I2C0 interrupt generation
     // // NVIC_EnableIRQ(I2C0_IRQn); // Enable NVIC I2C0 interrupt input
 }
+#endif
@@ -2,11 +2,82 @@
 #define _WAU8822_H_
 
 #define WAU8822_ADDR    0x1A                /* WAU8822 Device ID */
+#define WAU8822_REG_CACHE_NUM   62          /* Register 0 ~ 61 are cached */
+
+/**
+ * @brief Clock settings of the codec for one sample rate, solved by WAU8822_SolveClock()
+ */
+typedef struct WAU8822_ClkCfg_t {
+    uint8_t  u8PllPrescale;     // Register 36 bit 4, divide MCLK by 2 before the PLL
+    uint8_t  u8PllN;            // Register 36 bits 3:0, integer part of the PLL ratio
+    uint32_t u32PllK;           // Registers 37 ~ 39, 24-bit fractional part of the PLL ratio
+    uint8_t  u8MclkSel;         // Register 6 bits 7:5
+    uint8_t  u8BclkSel;         // Register 6 bits 4:2
+    uint8_t  u8Smplr;           // Register 7 bits 3:1
+    uint32_t u32ActualRate;     // The sample rate the codec will run at
+    int32_t  i32ErrorPpm;       // Error of the actual rate to the requested rate
+} WAU8822_ClkCfg_t;
+
+/**
+ * @brief Power profiles of the codec, see WAU8822_SetPowerProfile()
+ */
+typedef enum WAU8822_Power_t {
+    WAU8822_POWER_OFF,          // After reset, VREF discharged
+    WAU8822_POWER_STANDBY,      // Sleep, only VREF is held so the next wake is fast
+    WAU8822_POWER_PLAYBACK,     // DAC, mixers, headphone and speaker drivers
+    WAU8822_POWER_CAPTURE,      // Input boost and ADC
+    WAU8822_POWER_DUPLEX,       // Both
+    WAU8822_POWER_NUM,
+} WAU8822_Power_t;
+
+/**
+ * @brief Built-in tone presets, see WAU8822_ApplyTonePreset()
+ */
+typedef enum WAU8822_TonePreset_t {
+    WAU8822_TONE_FLAT,
+    WAU8822_TONE_BASS,
+    WAU8822_TONE_TREBLE,
+    WAU8822_TONE_VOCAL,
+    WAU8822_TONE_LOUDNESS,
+    WAU8822_TONE_WIDE,
+    WAU8822_TONE_PRESET_NUM,
+} WAU8822_TonePreset_t;
+
+/**
+ * @brief Settings of the codec's EQ, 3D and DAC limiter blocks
+ */
+typedef struct WAU8822_ToneCfg_t {
+    int8_t  ai8GainDb[5];       // Gain of EQ band 1 ~ 5, -12 ~ +12 dB
+    uint8_t au8FreqSel[5];      // Cut-off or center frequency selection of EQ band 1 ~ 5, 0 ~ 3
+    uint8_t u8WideMask;         // Bit n set for wide band characteristic of band n+1 (band 2 ~ 4 only)
+    uint8_t u83DDepth;          // 3D depth, 0 ~ 15
+    uint8_t u8LimEnable;        // DAC limiter enable
+    uint8_t u8LimThreshold;     // DAC limiter threshold, 0 (-1dB) ~ 5 (-6dB)
+    uint8_t u8LimBoostDb;       // DAC limiter boost, 0 ~ 12 dB
+} WAU8822_ToneCfg_t;
 
 void I2C_WriteWAU8822(uint8_t u8addr, uint16_t u16data);
-void RoughDelay(uint32_t t);
-void WAU8822_ConfigSampleRate(uint32_t u32SampleRate);
+uint16_t WAU8822_ReadCache(uint8_t u8addr);
+void WAU8822_UpdateBits(uint8_t u8addr, uint16_t u16mask, uint16_t u16data);
+uint8_t WAU8822_SolveClock(uint32_t u32SampleRate, WAU8822_ClkCfg_t *psCfg);
+uint32_t WAU8822_ConfigSampleRate(uint32_t u32SampleRate);
 void WAU8822_Setup(void);
+uint8_t WAU8822_IsSetUp(void);
+void WAU8822_SetPowerProfile(WAU8822_Power_t ePower);
+WAU8822_Power_t WAU8822_GetPowerProfile(void);
+uint16_t WAU8822_EncodeEqBand(uint8_t u8Band, uint8_t u8FreqSel, int8_t i8GainDb, uint8_t u8Wide);
+void WAU8822_SetEqBand(uint8_t u8Band, uint8_t u8FreqSel, int8_t i8GainDb, uint8_t u8Wide);
+void WAU8822_Set3DDepth(uint8_t u8Depth);
+void WAU8822_SetDacLimiter(uint8_t u8Enable, uint8_t u8Threshold, uint8_t u8BoostDb);
+void WAU8822_SetAlc(uint8_t u8Enable, uint8_t u8TargetLevel, uint8_t u8Limiter);
+void WAU8822_SetTone(const WAU8822_ToneCfg_t *psCfg);
+void WAU8822_ApplyTonePreset(WAU8822_TonePreset_t ePreset);
+const char *WAU8822_GetTonePresetName(WAU8822_TonePreset_t ePreset);
 void Init_I2C(void);
 
+#ifdef WAU8822_HOST
+// The I2C transfer of a register write, given by the host test
+void WAU8822_HostWrite(uint8_t u8addr, uint16_t u16data);
+#endif
+
 #endif // _WAU8822_H_
@@ -0,0 +1,75 @@
+#include <stddef.h>
+
+#include "wav_seek.h"
+
+/**
+ * @brief Set up seeking in an opened wav file, and map its clusters for fast seek if possible
+ * @param s The seek state
+ * @param fp The file, opened for reading
+ * @param data_offset File offset of the first frame
+ * @param data_size Bytes of the data chunk
+ * @param block_align Bytes of a frame
+ * @param clmt Buffer for the cluster link map, kept while the file is open, NULL to seek by the FAT
+ * @param clmt_len Number of DWORDs in clmt, 2 per fragment of the file plus 2
+ * @return FR_OK, or FR_NOT_ENOUGH_CORE if the file has too many fragments for clmt (seeking still works, by the FAT)
+ */
+FRESULT wav_seek_open(wav_seek_t *s, FIL *fp, uint32_t data_offset, uint32_t data_size, uint16_t block_align, DWORD *clmt, UINT clmt_len)
+{
+    FRESULT res = FR_OK;
+
+    s->data_offset = data_offset;
+    s->block_align = (block_align > 0) ? block_align : 1;
+    s->total_frames = data_size / s->block_align;
+    s->fast_seek = false;
+
+#if FF_USE_FASTSEEK
+    if (clmt != NULL && clmt_len >= 4) {
+        FSIZE_t fptr = f_tell(fp);
+        clmt[0] = clmt_len;
+        fp->cltbl = clmt;
+        res = f_lseek(fp, CREATE_LINKMAP);
+        if (res == FR_OK) {
+            s->fast_seek = true;
+        } else {
+            fp->cltbl = NULL;
+        }
+        f_lseek(fp, fptr);
+    }
+#else
+    (void)fp; (void)clmt; (void)clmt_len;
+#endif
+    return res;
+}
+
+/**
+ * @brief Snap a frame to the nearest one before it, that starts at a sector boundary of the file
+ * @param s The seek state
+ * @param frame The frame, clamped to the data, the last frame is never passed
+ * @return The snapped frame
+ * @note If no frame of the sector starts at its boundary (block_align doesn't divide it), the frame is kept
+ */
+uint32_t wav_seek_snap(const wav_seek_t *s, int64_t frame)
+{
+    uint32_t offset, sector_offset;
+
+    if (frame <= 0 || s->total_frames == 0) return 0;
+    if (frame > (int64_t)s->total_frames - 1) frame = s->total_frames - 1;
+
+    offset = s->data_offset + (uint32_t)frame * s->block_align;
+    sector_offset = offset & ~(uint32_t)(WAV_SEEK_SECTOR_SIZE - 1);
+    if (sector_offset < s->data_offset) return 0;
+    if ((sector_offset - s->data_offset) % s->block_align != 0) return (uint32_t)frame;
+    return (sector_offset - s->data_offset) / s->block_align;
+}
+
+/**
+ * @brief Move the file to a frame
+ * @param s The seek state
+ * @param fp The file
+ * @param frame The frame, from wav_seek_snap()
+ * @return Result of f_lseek()
+ */
+FRESULT wav_seek_to_frame(const wav_seek_t *s, FIL *fp, uint32_t frame)
+{
+    return f_lseek(fp, s->data_offset + (FSIZE_t)frame * s->block_align);
+}
@@ -0,0 +1,34 @@
+/**
+ * @brief Seeking in the sample data of an opened wav file
+ * @details
+ *   A jump lands on a frame whose file offset is a multiple of the sector size, so the refills after
+ *   the jump read whole sectors straight into the PCM buffer, and the first one needs no extra sector.
+ *   With FF_USE_FASTSEEK, the cluster chain of the file is mapped once when it's opened (CLMT),
+ *   and f_lseek() finds any cluster without reading the FAT, so a jump costs the same anywhere in the file.
+ */
+
+#ifndef _WAV_SEEK_H_
+#define _WAV_SEEK_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ff.h"
+
+#define WAV_SEEK_SECTOR_SIZE 512
+
+/**
+ * @brief Where the sample data is in the file
+ */
+typedef struct wav_seek_t {
+    uint32_t data_offset;   // File offset of the first frame
+    uint32_t total_frames;  // Frames in the data chunk
+    uint16_t block_align;   // Bytes of a frame
+    bool fast_seek;         // The cluster link map is created
+} wav_seek_t;
+
+FRESULT wav_seek_open(wav_seek_t *s, FIL *fp, uint32_t data_offset, uint32_t data_size, uint16_t block_align, DWORD *clmt, UINT clmt_len);
+uint32_t wav_seek_snap(const wav_seek_t *s, int64_t frame);
+FRESULT wav_seek_to_frame(const wav_seek_t *s, FIL *fp, uint32_t frame);
+
+#endif // _WAV_SEEK_H_
@@ -0,0 +1,139 @@
+/**
+ * @brief Test of the EQ encoding and the tone presets of the codec (utils/wau8822.c), on a PC
+ * @details
+ *   WAU8822_EncodeEqBand() is checked against the EQxGC/EQxCF encodings of the datasheet: 0 dB at the default
+ *   frequency must give the reset values of registers 18 ~ 22, the gain runs from 00000 (+12 dB) to 11000
+ *   (-12 dB) and is clamped, and the wide band bit is only taken by band 2 ~ 4.
+ *   Then each preset is applied after WAU8822_Setup(), the EQ, 3D and limiter registers must hold the values
+ *   worked out by hand from the datasheet. The I2C writes are counted by WAU8822_HostWrite(): applying a
+ *   preset again must write nothing, and moving to the next one only the registers that change.
+ * @usage gcc -O2 -Wall -DWAU8822_HOST -DPROF_HOST -Iutils wau8822_eq_host_test.c utils/wau8822.c utils/prof.c -o wau8822_eq_host_test && ./wau8822_eq_host_test
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "wau8822.h"
+
+// The registers a preset sets, in this order
+static const uint8_t tone_reg[] = {18, 19, 20, 21, 22, 24, 25, 41};
+#define TONE_REG_NUM (sizeof(tone_reg) / sizeof(tone_reg[0]))
+
+// Values from the datasheet for each preset, register 24 keeps 0x032 (attack, decay) from the reset
+static const uint16_t preset_reg[WAU8822_TONE_PRESET_NUM][TONE_REG_NUM] = {
+    {0x12C, 0x02C, 0x02C, 0x02C, 0x02C, 0x032, 0x000, 0x000},  /* Flat, the reset values */
+    {0x124, 0x108, 0x02C, 0x02C, 0x02C, 0x132, 0x000, 0x000},  /* Bass boost */
+    {0x12C, 0x02C, 0x02C, 0x149, 0x026, 0x132, 0x000, 0x000},  /* Treble boost */
+    {0x150, 0x02E, 0x14A, 0x128, 0x02C, 0x032, 0x000, 0x000},  /* Vocal */
+    {0x106, 0x12A, 0x02C, 0x02C, 0x048, 0x132, 0x024, 0x000},  /* Loudness */
+    {0x12A, 0x02C, 0x02C, 0x02C, 0x02A, 0x032, 0x000, 0x00A},  /* Wide (3D) */
+};
+
+static int errors = 0;
+static uint32_t writes = 0;
+
+void WAU8822_HostWrite(uint8_t u8addr, uint16_t u16data)
+{
+    (void)u8addr;
+    (void)u16data;
+    writes += 1;
+}
+
+static void expect_eq(uint8_t band, uint8_t freq, int8_t gain, uint8_t wide, uint16_t value)
+{
+    uint16_t got = WAU8822_EncodeEqBand(band, freq, gain, wide);
+
+    if (got != value) {
+        printf("  band %u, freq %u, %+d dB, wide %u: 0x%03X, 0x%03X expected\n", band, freq, gain, wide, got, value);
+        errors += 1;
+    }
+}
+
+static void test_encode(void)
+{
+    uint8_t band;
+    int8_t gain;
+    int before = errors;
+
+    // Reset values: band 1 with EQM set, all at 0 dB and frequency 1
+    expect_eq(1, 1, 0, 0, 0x12C);
+    for (band = 2; band <= 5; ++band) expect_eq(band, 1, 0, 0, 0x02C);
+
+    // Every gain step, 1 dB each
+    for (gain = -12; gain <= 12; ++gain) expect_eq(3, 0, gain, 0, (uint16_t)(12 - gain));
+    expect_eq(3, 0, 20, 0, 0x000);
+    expect_eq(3, 0, -20, 0, 0x018);
+    expect_eq(3, 0, 127, 0, 0x000);
+    expect_eq(3, 0, -128, 0, 0x018);
+
+    // Frequency in bits 6:5, masked to 0 ~ 3
+    expect_eq(2, 3, 0, 0, 0x06C);
+    expect_eq(2, 7, 0, 0, 0x06C);
+
+    // Wide band bit, band 1's bit 8 is EQM and is always set, band 5 has no bit
+    expect_eq(1, 0, 0, 1, 0x10C);
+    for (band = 2; band <= 4; ++band) expect_eq(band, 2, 0, 1, 0x14C);
+    expect_eq(5, 2, 0, 1, 0x04C);
+
+    printf("Encode: %s\n", (errors == before) ? "ok" : "failed");
+}
+
+static void test_presets(void)
+{
+    uint8_t p, i;
+    int before = errors;
+
+    WAU8822_Setup();
+    for (p = 0; p < WAU8822_TONE_PRESET_NUM; ++p) {
+        WAU8822_ApplyTonePreset((WAU8822_TonePreset_t)p);
+        for (i = 0; i < TONE_REG_NUM; ++i) {
+            if (WAU8822_ReadCache(tone_reg[i]) != preset_reg[p][i]) {
+                printf("  %s: register %u is 0x%03X, 0x%03X expected\n", WAU8822_GetTonePresetName((WAU8822_TonePreset_t)p),
+                       tone_reg[i], WAU8822_ReadCache(tone_reg[i]), preset_reg[p][i]);
+                errors += 1;
+            }
+        }
+    }
+    // Out of range, nothing changes
+    WAU8822_ApplyTonePreset(WAU8822_TONE_PRESET_NUM);
+    if (WAU8822_ReadCache(41) != preset_reg[WAU8822_TONE_WIDE][7]) errors += 1;
+
+    printf("Presets: %s\n", (errors == before) ? "ok" : "failed");
+}
+
+static void test_writes(void)
+{
+    uint8_t p, q, i, changed;
+    int before = errors;
+
+    for (p = 0; p < WAU8822_TONE_PRESET_NUM; ++p) {
+        WAU8822_ApplyTonePreset((WAU8822_TonePreset_t)p);
+        writes = 0;
+        WAU8822_ApplyTonePreset((WAU8822_TonePreset_t)p);
+        if (writes != 0) {
+            printf("  %s again: %u writes\n", WAU8822_GetTonePresetName((WAU8822_TonePreset_t)p), writes);
+            errors += 1;
+        }
+
+        q = (p + 1) % WAU8822_TONE_PRESET_NUM;
+        for (i = 0, changed = 0; i < TONE_REG_NUM; ++i) changed += (preset_reg[p][i] != preset_reg[q][i]);
+        writes = 0;
+        WAU8822_ApplyTonePreset((WAU8822_TonePreset_t)q);
+        printf("  %-8s -> %-8s: %u writes\n", WAU8822_GetTonePresetName((WAU8822_TonePreset_t)p),
+               WAU8822_GetTonePresetName((WAU8822_TonePreset_t)q), writes);
+        if (writes != changed) {
+            printf("  %u expected\n", changed);
+            errors += 1;
+        }
+    }
+    printf("Writes: %s\n", (errors == before) ? "ok" : "failed");
+}
+
+int main(void)
+{
+    test_encode();
+    test_presets();
+    test_writes();
+    printf("\nErrors: %d\n", errors);
+    return (errors == 0) ? 0 : 1;
+}